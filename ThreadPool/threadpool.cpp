@@ -6,34 +6,68 @@
 //
 
 #include "threadpool.hpp"
+#include "executor.hpp"
+#include "priorityqueue.hpp"
 #include <functional>
 #include <thread>
-#include <iostream>
+#include <climits>
+#include <algorithm>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 const int TASK_MAX_THRESHHOLD = 1024;
 const int THREAD_MAX_THRESHHOLD = 10;
-const int THREAD_MAX_IDLE_TIME = 10;//单位：秒
+const int THREAD_SPIN_COUNT = 128;//空闲线程睡眠前自旋检查任务的次数
+const int THREAD_YIELD_COUNT = 8;//自旋之后让出CPU再检查任务的次数
+const int PRIORITY_AGING_TIME = 20;//低一级的任务多等待这么久相当于提升一级，单位：毫秒
  
 //线程池构造
 ThreadPool::ThreadPool()
 :initThreadSize_(4)
-,taskSize_(0)
-,idleThreadSize_(0)
+,threadSizeThreshHold_(THREAD_MAX_THRESHHOLD)
 ,curThreadSize_(0)
+,idleThreadSize_(0)
+,taskSize_(0)
 ,taskQueMaxThreshHold_(TASK_MAX_THRESHHOLD)
-,threadSizeThreshHold_(THREAD_MAX_THRESHHOLD)
 ,poolMode_(PoolMode::MODE_FIXED)
 ,isPoolRunning_(false)
-{}
+,queueMode_(QueueMode::MODE_MUTEX)
+,idle_(std::make_unique<SpinParkIdle>(THREAD_SPIN_COUNT, THREAD_YIELD_COUNT))
+,blockedSubmitSize_(0)
+,priorityQue_(std::make_unique<PriorityTaskQueue<std::shared_ptr<TaskBase>>>(3, std::chrono::milliseconds(PRIORITY_AGING_TIME)))
+,priorityTaskSize_(0)
+,completedTaskSize_(0)
+,retireThreadSize_(0)
+{
+    taskQue_ = makeTaskQueue();
+}
 
 //线程池析构
 ThreadPool::~ThreadPool(){
     isPoolRunning_ = false;
+    //先停止控制线程，保证析构过程中不会再创建新线程
+    if(monitor_.joinable()){
+        {
+            std::unique_lock<std::mutex> lock(monitorMtx_);
+            monitorCond_.notify_all();
+        }
+        monitor_.join();
+    }
     //等待线程池里面所有线程返回  有两种状态 阻塞&正在执行任务中
-//    notEmpty_.notify_all();
-    std::unique_lock<std::mutex> lock(taskQueMtx_);
-    notEmpty_.notify_all();
-    exitCond_.wait(lock,[&]()->bool{return threads_.size() == 0;});
+    idle_->notifyAll();
+    std::vector<std::unique_ptr<Thread>> exited;
+    {
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        exitCond_.wait(lock,[&]()->bool{return threads_.size() == 0;});
+        exited.swap(exitedThreads_);
+    }
+    //线程函数全部返回以后才能释放线程池的成员
+    for(auto& t : exited){
+        t->join();
+    }
 }
 
 //设置线程池的工作模式
@@ -43,6 +77,13 @@ void ThreadPool::setMode(PoolMode mode){
     poolMode_ = mode;
 }
 
+void ThreadPool::setQueueMode(QueueMode mode){
+    if(checkRunningState())
+        return;
+    queueMode_ = mode;
+    rebuildQueue();
+}
+
 //设置初始的线程数量
 //void ThreadPool::setInitThreadSize(int size){
 //    initThreadSize_ = size;
@@ -53,6 +94,7 @@ void ThreadPool::setTaskQueMaxThreshHold(int threshhold){
     if(checkRunningState())
         return;
     taskQueMaxThreshHold_ = threshhold;
+    rebuildQueue();
 }
 
 void ThreadPool::setThreadSizeThreshHold(int threshhold){
@@ -63,45 +105,260 @@ void ThreadPool::setThreadSizeThreshHold(int threshhold){
     }
 }
 
+void ThreadPool::setElasticConfig(const ElasticConfig& config){
+    if(checkRunningState())
+        return;
+    elasticConfig_ = config;
+}
+
+void ThreadPool::setPriorityAging(std::chrono::milliseconds aging){
+    if(checkRunningState())
+        return;
+    priorityQue_->setAging(aging);
+}
+
+void ThreadPool::setIdleSpin(int spinCount, int yieldCount){
+    if(checkRunningState())
+        return;
+    idle_->setSpin(spinCount, yieldCount);
+}
+
+void ThreadPool::setOverloadPolicy(OverloadPolicy policy, std::chrono::milliseconds blockTime){
+    if(checkRunningState())
+        return;
+    overload_.setPolicy(policy, blockTime);
+}
+
+void ThreadPool::setOverloadHandler(std::function<void(OverloadEvent)> handler){
+    if(checkRunningState())
+        return;
+    overload_.setHandler(std::move(handler));
+}
+
 //给线程池提交任务 用户调用该接口，传入任务对象，生产任务
 Result ThreadPool::submitTask(std::shared_ptr<Task> sp){
-    //获取锁
+    //任务队列满时按过载策略处理，被拒绝的任务已经完成为TaskRejectedError，Result仍然有效
+    bool isVaild = submitted(pushTask(sp, true), *sp);
+    //返回任务的Result对象
+//    return task->getResult();
+    return Result(sp, isVaild);
+}
+
+//按优先级提交任务
+Result ThreadPool::submitTask(std::shared_ptr<Task> sp, TaskPriority priority, std::chrono::steady_clock::time_point deadline){
+    bool isVaild = submitted(pushPriorityTask(sp, priority, deadline, true), *sp);
+    return Result(sp, isVaild);
+}
+
+//提交可以取消的任务
+Result ThreadPool::submitTask(std::shared_ptr<Task> sp, CancellationToken token, std::chrono::steady_clock::duration maxQueueTime){
+    setCancellation(*sp, std::move(token), maxQueueTime);
+    bool isVaild = submitted(pushTask(sp, true), *sp);
+    return Result(sp, isVaild);
+}
+
+void ThreadPool::setCancellation(TaskBase& task, CancellationToken token, std::chrono::steady_clock::duration maxQueueTime){
+    task.token_ = std::move(token);
+    auto now = std::chrono::steady_clock::now();
+    if(maxQueueTime < std::chrono::steady_clock::time_point::max() - now){
+        task.deadline_ = now + maxQueueTime;
+    }
+}
+
+//非阻塞地提交任务，任务队列满时立即返回无效的Result
+Result ThreadPool::trySubmit(std::shared_ptr<Task> sp){
+    bool isVaild = submitted(pushTask(sp, false), *sp);
+    return Result(sp, isVaild);
+}
+
+bool ThreadPool::pushTask(std::shared_ptr<TaskBase> sp, bool block){
+    stampTask(*sp);
+    if(tryPushTask(sp))
+        return true;
+    if(!block)
+        return false;
+    switch(overload_.policy()){
+    case OverloadPolicy::OVERLOAD_BLOCK:
+        if(waitPushTask(sp, overload_.blockTime()))
+            return true;
+        break;
+    case OverloadPolicy::OVERLOAD_CALLER_RUNS:
+        overload_.report(OverloadEvent::EVENT_CALLER_RUNS);
+        runTask(*sp);
+        return true;
+    case OverloadPolicy::OVERLOAD_DROP_OLDEST:
+        //其他提交线程可能抢先占用腾出的位置，丢弃成功就再试一次
+        while(dropOldestTask()){
+            if(tryPushTask(sp))
+                return true;
+        }
+        //队列里的任务刚好都被取走了
+        if(tryPushTask(sp))
+            return true;
+        break;
+    case OverloadPolicy::OVERLOAD_FAIL_FAST:
+        break;
+    }
+    rejectTask(*sp);
+    return false;
+}
+
+bool ThreadPool::tryPushTask(std::shared_ptr<TaskBase>& sp){
+    //容量检查由队列本身完成，不需要获取taskQueMtx_
+    if(!taskQue_->tryPush(std::move(sp)))
+        return false;
+    taskSize_++;
+    //因为新放了任务，任务队列肯定不空，需要的话唤醒一个空闲线程执行任务
+    wakeSleepingThread();
+    return true;
+}
+
+bool ThreadPool::waitPushTask(std::shared_ptr<TaskBase>& sp, std::chrono::milliseconds timeout){
     std::unique_lock<std::mutex> lock(taskQueMtx_);
-    //线程的通信 等待任务队列有空余
-    //用户提交任务，最长阻塞不能超过1s，否则判断提交任务失败返回
-//    while(taskQue_.size() == taskQueMaxThreshHold_){
-//        notFull_.wait(lock);
-//    }//和下面的lambda表达式同义，即阻塞
-    if(notFull_.wait_for(lock, std::chrono::seconds(1),[&]()->bool {return taskQue_.size() < (size_t)taskQueMaxThreshHold_;})==false){
-        // 表示notFull_等待1s后，条件依然没有满足
-        std::cerr << "task queue is full, submit task fail" << std::endl;
-//        return task->getResult();线程执行完task，task对象就被析构掉了
-        return Result(sp, false);
+    //线程的通信 等待任务队列有空余，消费者取走任务时看到有阻塞的提交线程才通知notFull_
+    blockedSubmitSize_++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool pushed = notFull_.wait_for(lock, timeout, [&]()->bool {return taskQue_->tryPush(std::move(sp));});
+    blockedSubmitSize_--;
+    if(!pushed)
+        return false;
+    taskSize_++;
+    lock.unlock();
+    wakeSleepingThread();
+    return true;
+}
+
+//在锁外让被丢弃的任务完成为TaskDroppedError
+bool ThreadPool::dropOldestTask(){
+    std::shared_ptr<TaskBase> victim;
+    if(!taskQue_->tryPop(victim))
+        return false;
+    taskSize_--;
+    victim->fail(std::make_exception_ptr(TaskDroppedError()));
+    overload_.report(OverloadEvent::EVENT_DROPPED);
+    return true;
+}
+
+void ThreadPool::rejectTask(TaskBase& task){
+    overload_.report(OverloadEvent::EVENT_REJECTED);
+    task.fail(std::make_exception_ptr(TaskRejectedError()));
+}
+
+bool ThreadPool::submitted(bool accepted, const TaskBase& task){
+    return accepted || task.failed();
+}
+
+bool ThreadPool::pushPriorityTask(std::shared_ptr<TaskBase> sp, TaskPriority priority, std::chrono::steady_clock::time_point deadline, bool block){
+    stampTask(*sp);
+    sp->deadline_ = deadline;
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    auto hasSpace = [&]()->bool {return priorityQue_->size() < (size_t)taskQueMaxThreshHold_;};
+    if(!hasSpace()){
+        if(!block)
+            return false;
+        if(overload_.policy() == OverloadPolicy::OVERLOAD_CALLER_RUNS){
+            lock.unlock();
+            overload_.report(OverloadEvent::EVENT_CALLER_RUNS);
+            runTask(*sp);
+            return true;
+        }
+        if(overload_.policy() != OverloadPolicy::OVERLOAD_BLOCK || !notFull_.wait_for(lock, overload_.blockTime(), hasSpace)){
+            lock.unlock();
+            rejectTask(*sp);
+            return false;
+        }
     }
-    //如果有空余，把任务放入任务队列中
-    taskQue_.emplace(sp);
+    auto enqueueTime = enqueueTimePoint(*sp);
+    priorityQue_->push(std::move(sp), (size_t)priority, deadline, enqueueTime);
     taskSize_++;
-    //因为新放了任务，任务队列肯定不空，在notEmpty_上通知分配线程执行任务
-    notEmpty_.notify_all();
-    
-    //cached 任务处理比较紧急 场景 小而快,需要根据任务数量和空闲线程数量判断是否需要创建新的线程出来
-    if(poolMode_ == PoolMode::MODE_CACHED && taskSize_ > idleThreadSize_ &&
-       curThreadSize_ < threadSizeThreshHold_){
-        std::cout << "create new thread" << std::endl;
-        
-        //创建新线程对象
-        auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc,this, std::placeholders::_1));
-        //创建thread线程对象的时候，把线程函数给到thread线程对象
-        int threadId = ptr->getId();
-        threads_.emplace(threadId, std::move(ptr));//unique_ptr不允许直接拷贝
-        threads_[threadId]->start();
+    priorityTaskSize_++;
+    lock.unlock();
+    wakeSleepingThread();
+    return true;
+}
+
+bool ThreadPool::popPriorityTask(std::shared_ptr<TaskBase>& task){
+    if(priorityQue_->empty())
+        return false;
+    priorityQue_->pop(task);
+    taskSize_--;
+    priorityTaskSize_--;
+    //取出一个任务应该通知
+    notFull_.notify_all();
+    return true;
+}
+
+//全局队列不能先看队头再决定取不取（无锁队列没有这个操作），所以普通任务先取出来再比较：优先级队列里有更紧急的任务
+//（高优先级任务、有截止时间的普通任务、老化以后的低优先级任务）时，普通任务按原来的入队时间放进优先级队列的NORMAL级别，
+//继续老化，不会被饿死；task换成更紧急的任务，两边的任务数量都不变
+void ThreadPool::yieldToPriority(std::shared_ptr<TaskBase>& task){
+    if(priorityTaskSize_ <= 0)
+        return;
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    auto enqueueTime = enqueueTimePoint(*task);
+    if(!priorityQue_->aheadOf((size_t)TaskPriority::PRIORITY_NORMAL, enqueueTime))
+        return;
+    std::shared_ptr<TaskBase> urgent;
+    priorityQue_->pop(urgent);
+    auto deadline = task->deadline_;
+    priorityQue_->push(std::move(task), (size_t)TaskPriority::PRIORITY_NORMAL, deadline, enqueueTime);
+    task = std::move(urgent);
+}
+
+//cached模式的控制线程：每个采样周期把排队任务数量、吞吐量和空闲线程数量交给ElasticController，按它的决定扩容或者缩容
+//和2.0用同一个控制器，提交任务的线程不再创建线程，空闲线程也不再自己计时退出
+void ThreadPool::monitorFunc(){
+    using Clock = ElasticController::Clock;
+    ElasticController controller(elasticConfig_, threadSizeThreshHold_, completedTaskSize_.load(std::memory_order_relaxed), Clock::now());
+    std::unique_lock<std::mutex> lock(monitorMtx_);
+    while(isPoolRunning_){
+        monitorCond_.wait_for(lock, controller.config().sampleInterval, [&]()->bool {return !isPoolRunning_;});
+        if(!isPoolRunning_)
+            break;
+        ElasticController::Sample sample;
+        sample.completed = completedTaskSize_.load(std::memory_order_relaxed);
+        int queued = taskSize_;
+        sample.queued = queued > 0 ? (size_t)queued : 0;
+        sample.threadSize = curThreadSize_;
+        sample.idleThreadSize = idleThreadSize_;
+        auto now = Clock::now();
+        auto decision = controller.sample(sample, now);
+        if(decision.grow > 0)
+            addThreads(decision.grow);
+        else if(decision.shrink && retireThread(controller.minThreadSize((int)initThreadSize_)))
+            controller.shrunk(now);
+    }
+}
+
+//只在持有锁的时候修改threads_，线程在锁外启动
+void ThreadPool::addThreads(int n){
+    std::vector<Thread*> newThreads;
+    {
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        for(int i = 0; i < n; i++){
+            //创建新线程对象
+            auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc,this, std::placeholders::_1));
+            newThreads.push_back(ptr.get());
+            int threadId = ptr->getId();
+            threads_.emplace(threadId, std::move(ptr));//unique_ptr不允许直接拷贝
+        }
         //修改线程个数相关的变量
-        curThreadSize_++;
-        idleThreadSize_++;
+        curThreadSize_ += n;
+        idleThreadSize_ += n;
+    }
+    for(Thread* t : newThreads){
+        t->start();
     }
-    //返回任务的Result对象
-//    return task->getResult();
-    return Result(sp);
+}
+
+bool ThreadPool::retireThread(int minSize){
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    if(curThreadSize_ - retireThreadSize_ <= minSize || idleThreadSize_ <= retireThreadSize_)
+        return false;
+    retireThreadSize_++;
+    lock.unlock();
+    idle_->notify();
+    return true;
 }
 
 //开启线程池
@@ -119,85 +376,193 @@ void ThreadPool::start(int initThreadSize){
         threads_.emplace(threadId, std::move(ptr));//unique_ptr不允许直接拷贝
     }
     //启动所有线程，std::vector<Thread*> threads_
-    for(int i = 0; i < initThreadSize; i++){
-        threads_[i]->start();
+    //线程id是全局递增的，同一个进程里的第二个线程池不是从0开始，所以按threads_里实际的id启动
+    for(auto& thread : threads_){
+        thread.second->start();
         idleThreadSize_++;//记录初始空闲线程的数量
     }
+    //cached模式由控制线程负责扩容和缩容
+    if(poolMode_ == PoolMode::MODE_CACHED){
+        monitor_ = std::thread(&ThreadPool::monitorFunc, this);
+    }
+}
+
+template<typename F>
+void ThreadPool::withQueuePolicy(F&& f) const{
+    if(queueMode_ == QueueMode::MODE_LOCKFREE)
+        f(LockFreeQueuePolicy());
+    else
+        f(MutexQueuePolicy());
+}
+
+std::unique_ptr<TaskQueue<std::shared_ptr<TaskBase>>> ThreadPool::makeTaskQueue() const{
+    std::unique_ptr<TaskQueue<std::shared_ptr<TaskBase>>> que;
+    withQueuePolicy([&](auto policy){
+        que = std::make_unique<PolicyTaskQueue<decltype(policy), std::shared_ptr<TaskBase>>>((size_t)std::max(taskQueMaxThreshHold_, 1), 1);
+    });
+    return que;
+}
+
+void ThreadPool::rebuildQueue(){
+    auto que = makeTaskQueue();
+    std::vector<std::shared_ptr<TaskBase>> rejected;
+    std::shared_ptr<TaskBase> sp;
+    while(taskQue_->tryPop(sp)){
+        if(!que->tryPush(std::move(sp))){
+            rejected.push_back(std::move(sp));
+            taskSize_--;
+        }
+    }
+    taskQue_ = std::move(que);
+    for(auto& sp : rejected){
+        rejectTask(*sp);
+    }
+}
+
+void ThreadPool::runTask(TaskBase& task){
+    if(task.cancelled()){
+        task.cancel();//已经被取消，不再执行
+    }
+    else if(task.expired()){
+        task.expire();//截止时间已过，不再执行
+    }
+    else{
+        task.exec();//执行任务，把任务的返回值给到Result
+    }
 }
 
 //定义线程函数 线程池的所有线程从任务队列里面消费任务
+//线程启动时按队列模式和线程池模式选定一次策略，工作线程循环里不再判断模式
 void ThreadPool::threadFunc(int threadid){
-    auto lastTime = std::chrono::high_resolution_clock().now();
+    withQueuePolicy([&](auto policy){
+        using QueuePolicy = decltype(policy);
+        //cached模式下线程数量由控制线程决定，空闲线程自己不计时
+        if(poolMode_ == PoolMode::MODE_CACHED)
+            runWorker<QueuePolicy>(threadid, ControlledGrowth());
+        else
+            runWorker<QueuePolicy>(threadid, FixedGrowth());
+    });
+}
+
+template<typename QueuePolicy, typename Growth>
+void ThreadPool::runWorker(int threadid, const Growth& growth){
+    WorkerStatsRef stats = stats_.acquire();//线程退出时在exitThread里归还
     //所有任务必须执行完成，线程池才可以回收所有线程资源
-    for(;;){ //在这个循环中，线程会一直等待并执行任务队列中的任务。
-        std::shared_ptr<Task> task;
-        {
-            //先获取锁
-            std::unique_lock<std::mutex> lock(taskQueMtx_);//锁默认出当前作用域才释放
-            
-            std::cout << "tid:" << std::this_thread::get_id() << "尝试获取任务..." << std::endl;
-            //锁+双重判断
-            while(taskQue_.size() == 0){
-                //线程池要结束，回收线程资源
-                if(!isPoolRunning_){
-                    threads_.erase(threadid);
-                    std::cout << "tid:" << std::this_thread::get_id() << "exit!" << std::endl;
-                    exitCond_.notify_all();
-                    return;
-                }
-                //在cached模式下，有可能已经创建了很多线程，空闲时间超过60s，应该把多余的线程回收掉
-                //结束回收掉（超过initThreadSize_数量的）
-                //当前时间 - 上一次线程执行的时间>60s
-                if(poolMode_ == PoolMode::MODE_CACHED){
-                    if(std::cv_status::timeout == notEmpty_.wait_for(lock, std::chrono::seconds(1))){
-                        auto now = std::chrono::high_resolution_clock().now();
-                        auto dur = std::chrono::duration_cast<std::chrono::seconds>(now - lastTime);
-                        if(dur.count() >= THREAD_MAX_IDLE_TIME && curThreadSize_ > initThreadSize_){
-                            //开始回收线程
-                            //记录线程数量的相关变量的值修改
-                            //把线程对象从线程列表容器中删除，没有办法threadFunc 《=》thread对象
-                            threads_.erase(threadid);
-                            curThreadSize_--;
-                            idleThreadSize_--;
-                            std::cout << "tid:" << std::this_thread::get_id() << "exit!" << std::endl;
-                            return;
-                        }
-                    }
-                }
-                else{
-                    notEmpty_.wait(lock);
-                }
-                //线程池要结束，回收线程资源
-//                if(isPoolRunning_ == false){
-//                    threads_.erase(threadid);
-//                    std::cout << "tid:" << std::this_thread::get_id() << "exit!" << std::endl;
-//                    exitCond_.notify_all();
-//                    return;
-//                }
+    //没有任务时先自旋、再让出CPU，还是没有任务才睡眠，被唤醒以后重新自旋
+    workerLoop<std::shared_ptr<TaskBase>>(*idle_,
+        [&](std::shared_ptr<TaskBase>& task){return takeTask<QueuePolicy>(task);},
+        [&](){return taskSize_ > 0;},
+        [&](EventCount::Key key)->bool {
+            //线程池要结束，或者控制线程要求回收线程
+            if(!isPoolRunning_ || retireThreadSize_ > 0){
+                idle_->cancelWait();
+                return !exitThread(threadid, stats);
             }
-            
-            idleThreadSize_--;
-            std::cout << "tid:" << std::this_thread::get_id() << "获取任务成功..." << std::endl;
-            
-            //不空就从任务队列中取一个任务
-            task = taskQue_.front();
-            taskQue_.pop();
-            taskSize_--;
-            //如果依然有剩余任务，继续通知其他的线程执行任务
-            if(taskQue_.size() > 0){
-                notEmpty_.notify_all();
+            stats.park();
+            SlabHeap::flush();
+            growth.park(*idle_, key, [](){return false;});
+            stats.wakeup();
+            return true;
+        },
+        [&](std::shared_ptr<TaskBase>& task){
+            //当前线程负责执行这个任务
+            uint64_t start = WorkerStatsRef::now();
+            if constexpr(Growth::ELASTIC){
+                idleThreadSize_--;
             }
-            //取出一个任务应该通知
-            notFull_.notify_all();
-        }//释放锁
-        //当前线程负责执行这个任务
-        if(task != nullptr){
-//            task->run();//执行任务
-            task->exec();//执行任务，把任务的返回值给到Result
-        }
-        idleThreadSize_++;
-        lastTime = std::chrono::high_resolution_clock().now();//更新线程执行完的时间
+            runTask(*task);
+            if constexpr(Growth::ELASTIC){
+                idleThreadSize_++;
+                completedTaskSize_.fetch_add(1, std::memory_order_relaxed);
+            }
+            stats.taskRun(enqueueTimeOf(*task), start, WorkerStatsRef::now());
+            return true;
+        });
+}
+
+//直接从全局队列取任务，优先级队列里有比它更紧急的任务时换成更紧急的任务
+template<typename QueuePolicy>
+bool ThreadPool::takeTask(std::shared_ptr<TaskBase>& task){
+    if(queueOf<QueuePolicy>(*taskQue_).tryPop(task)){
+        taskSize_--;
+        notifyBlockedSubmit();
+        yieldToPriority(task);
+        return true;
     }
+    //全局队列空了，再看优先级队列
+    if(priorityTaskSize_ <= 0)
+        return false;
+    std::unique_lock<std::mutex> lock(taskQueMtx_);//锁默认出当前作用域才释放
+    return popPriorityTask(task);
+}
+
+bool ThreadPool::exitThread(int threadid, WorkerStatsRef& stats){
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    if(isPoolRunning_){
+        //cached模式下控制线程决定回收多余的空闲线程
+        if(retireThreadSize_ <= 0)
+            return false;
+        //记录线程数量的相关变量的值修改
+        retireThreadSize_--;
+        curThreadSize_--;
+        idleThreadSize_--;
+    }
+    //把线程对象从线程列表容器中删除，没有办法threadFunc 《=》thread对象
+    stats_.release(stats);
+    auto exited = detachExitedThread(threadid);
+    exitCond_.notify_all();
+    lock.unlock();
+    for(auto& t : exited){
+        t->join();
+    }
+    return true;
+}
+
+//线程不能join自己：把自己的线程对象留给下一个退出的线程或者析构函数join，同时带走之前退出的线程
+std::vector<std::unique_ptr<Thread>> ThreadPool::detachExitedThread(int threadid){
+    std::vector<std::unique_ptr<Thread>> exited;
+    exited.swap(exitedThreads_);
+    exitedThreads_.push_back(std::move(threads_[threadid]));
+    threads_.erase(threadid);
+    return exited;
+}
+
+//正在自旋的线程会取到新任务，没有线程自旋才唤醒一个睡眠的线程
+void ThreadPool::wakeSleepingThread(){
+    idle_->wake();
+}
+
+void ThreadPool::notifyBlockedSubmit(){
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(blockedSubmitSize_ > 0){
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        notFull_.notify_all();
+    }
+}
+
+PoolStats ThreadPool::stats() const{
+    return stats_.snapshot();
+}
+
+SlabStats ThreadPool::allocatorStats(){
+    return SlabHeap::stats();
+}
+
+OverloadStats ThreadPool::overloadStats() const{
+    return overload_.stats();
+}
+
+void ThreadPool::stampTask(TaskBase& task){
+    task.enqueueTime_ = steadyNanos();
+}
+
+uint64_t ThreadPool::enqueueTimeOf(const TaskBase& task){
+    return task.enqueueTime_;
+}
+
+std::chrono::steady_clock::time_point ThreadPool::enqueueTimePoint(const TaskBase& task){
+    return std::chrono::steady_clock::time_point(
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(task.enqueueTime_)));
 }
 
 bool ThreadPool::checkRunningState() const{
@@ -209,16 +574,26 @@ int Thread::generateId_ = 0;
 //线程构造
 Thread::Thread(ThreadFunc func):func_(func),threadId_(generateId_++)
 {}
-//线程析构
+//线程析构，线程不能join自己，这时只能分离
 Thread::~Thread(){
-    
+    if(thread_.joinable()){
+        if(thread_.get_id() == std::this_thread::get_id())
+            thread_.detach();
+        else
+            thread_.join();
+    }
 }
 
 //启动线程
 void Thread::start(){
-    //创建一个线程来执行一个线程函数
-    std::thread t(func_, threadId_);//C++11来说 线程对象t 和 线程函数func_
-    t.detach();//设置分离线程，线程对象和线程函数不相关
+    //创建一个线程来执行一个线程函数，线程池析构或者回收线程时join，保证线程函数已经返回
+    thread_ = std::thread(func_, threadId_);
+}
+
+//等待线程函数返回
+void Thread::join(){
+    if(thread_.joinable())
+        thread_.join();
 }
 
 int Thread::getId() const{
@@ -226,35 +601,63 @@ int Thread::getId() const{
 }
 
 //Task方法实现
-Task::Task():result_(nullptr){
+Task::Task(){
     
 }
 
-void Task::exec(){
-    if(result_ != nullptr){
-        result_->setVal(run());//这里发生多态调用
-    }
-}
-
-void Task::setResult(Result* res){
-    result_ = res;
+//返回值直接存放在任务里，不再需要关联Result，参数不再使用；保留这个接口是为了以前调用它的用户代码还能编译
+void Task::setResult(Result* /*res*/){
+    
 }
 //Result方法的实现
 Result::Result(std::shared_ptr<Task> task, bool isVaild)
-:isVaild_(isVaild),task_(task){
-    task_->setResult(this);
+:task_(task),res_(task, isVaild){
+    
 }
 
 MyAny Result::get(){
-    if(!isVaild_){
+    if(!res_.isVaild()){
         return "";
     }
-    sem_.wait();//如果task任务没执行完，会阻塞用户线程
-    return std::move(any_);
+    return res_.get();//如果task任务没执行完，会阻塞用户线程
 }
 
 void Result::setVal(MyAny any){
     //存储task的返回值
-    this->any_ =  std::move(any);
-    sem_.post();//已经获得任务的返回值，增加信号量资源
+    task_->result_.setValue(std::move(any));
+}
+
+//futex等待/唤醒的实现
+#if defined(__linux__)
+void futexWait(std::atomic<uint32_t>* addr, uint32_t expected){
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+void futexWakeAll(std::atomic<uint32_t>* addr){
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+#else
+//没有futex的平台：按地址散列到固定数量的条件变量上，不需要每个Result都带一把锁
+namespace{
+struct ParkingBucket{
+    std::mutex mtx;
+    std::condition_variable cond;
+};
+ParkingBucket& parkingBucket(void* addr){
+    static ParkingBucket buckets[64];
+    return buckets[(reinterpret_cast<uintptr_t>(addr) >> 4) % 64];
+}
+}
+
+void futexWait(std::atomic<uint32_t>* addr, uint32_t expected){
+    ParkingBucket& bucket = parkingBucket(addr);
+    std::unique_lock<std::mutex> lock(bucket.mtx);
+    bucket.cond.wait(lock, [&]()->bool {return addr->load() != expected;});
+}
+
+void futexWakeAll(std::atomic<uint32_t>* addr){
+    ParkingBucket& bucket = parkingBucket(addr);
+    std::unique_lock<std::mutex> lock(bucket.mtx);
+    bucket.cond.notify_all();
 }
+#endif
@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <vector>
 #include <queue>
+#include <deque>
 #include <memory>//智能指针
 #include <atomic>//atomic_int
 #include <mutex>
@@ -18,6 +19,18 @@
 #include <functional>
 #include <thread>
 #include <unordered_map>
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+#include <new>
+#include <type_traits>
+#include "poolstats.hpp"
+#include "slaballoc.hpp"
+#include "cancellation.hpp"
+#include "overload.hpp"
+#include "elastic.hpp"
 
 //Any类型：可以接收任意数据的类型
 class MyAny{
@@ -46,10 +59,16 @@ public:
             return pd->data_;
     }
 private:
-    //基类类型
+    //基类类型，派生类对象从线程的slab缓存分配
     class MyBase{
     public:
         virtual ~MyBase() = default;
+        static void* operator new(size_t size){
+            return SlabHeap::allocate(size);
+        }
+        static void operator delete(void* p){
+            SlabHeap::free(p);
+        }
     };
     //派生类类型
     template<typename T>
@@ -64,38 +83,227 @@ private:
     std::unique_ptr<MyBase> base_;
 };
 
-class Semaphore{
+//类futex的等待/唤醒：Linux上直接用futex系统调用，其他平台用按地址散列的条件变量
+//等待方在*addr == expected时睡眠，唤醒方需要先修改*addr再调用futexWakeAll
+void futexWait(std::atomic<uint32_t>* addr, uint32_t expected);
+void futexWakeAll(std::atomic<uint32_t>* addr);
+
+//任务的返回值，直接存放在任务对象内部，不需要额外的堆分配和锁
+//state_低两位表示状态，RESULT_WAITING表示有线程在睡眠等待，设置结果时才需要唤醒
+template<typename T>
+class ResultState{
 public:
-    Semaphore(int limit = 0):resLimit(limit), isExit_(false){
-        
+    enum : uint32_t{
+        RESULT_EMPTY = 0,
+        RESULT_VALUE = 1,
+        RESULT_ERROR = 2,
+        RESULT_WAITING = 4,
+    };
+    ResultState():state_(RESULT_EMPTY){}
+    ~ResultState(){
+        if(ready() && !error_){
+            value()->~T();
+        }
+    }
+    ResultState(const ResultState&) = delete;
+    ResultState& operator=(const ResultState&) = delete;
+
+    template<typename... Args>
+    void setValue(Args&&... args){
+        new (storage_) T(std::forward<Args>(args)...);
+        publish(RESULT_VALUE);
+    }
+    void setError(std::exception_ptr error){
+        error_ = error;
+        publish(RESULT_ERROR);
+    }
+    bool ready() const{
+        return (state_.load(std::memory_order_acquire) & 3) != RESULT_EMPTY;
+    }
+    bool failed() const{
+        return (state_.load(std::memory_order_acquire) & 3) == RESULT_ERROR;
+    }
+    //先自旋一小会儿，任务还没完成再睡眠
+    void wait(){
+        uint32_t s = state_.load(std::memory_order_acquire);
+        for(int i = 0; (s & 3) == RESULT_EMPTY && i < 64; i++){
+            std::this_thread::yield();
+            s = state_.load(std::memory_order_acquire);
+        }
+        while((s & 3) == RESULT_EMPTY){
+            if((s & RESULT_WAITING) == 0){
+                if(!state_.compare_exchange_weak(s, s | RESULT_WAITING, std::memory_order_acquire))
+                    continue;
+                s |= RESULT_WAITING;
+            }
+            futexWait(&state_, s);
+            s = state_.load(std::memory_order_acquire);
+        }
+    }
+    //等待结果并把返回值移出来，任务抛出的异常在这里重新抛出
+    T take(){
+        wait();
+        if(error_){
+            std::rethrow_exception(error_);
+        }
+        return std::move(*value());
+    }
+private:
+    void publish(uint32_t s){
+        uint32_t old = state_.exchange(s, std::memory_order_acq_rel);
+        if(old & RESULT_WAITING){
+            futexWakeAll(&state_);
+        }
+    }
+    T* value(){
+        return std::launder(reinterpret_cast<T*>(storage_));
+    }
+private:
+    std::atomic<uint32_t> state_;
+    std::exception_ptr error_;
+    alignas(T) unsigned char storage_[sizeof(T)];//返回值的内联存储
+};
+
+//无返回值的任务只需要状态
+template<>
+class ResultState<void>{
+public:
+    void setValue(){
+        state_.setValue(true);
+    }
+    void setError(std::exception_ptr error){
+        state_.setError(error);
+    }
+    bool ready() const{
+        return state_.ready();
     }
-    ~Semaphore(){
-        isExit_ = true;
+    bool failed() const{
+        return state_.failed();
     }
-    //获取一个信号资源量
     void wait(){
-        if(isExit_) return;
-        std::unique_lock<std::mutex> lock(mtx_);
-        cond_.wait(lock,[&]()->bool {return resLimit > 0;});
-        resLimit--;
-    }
-    //增加一个信号资源量
-    void post(){
-        if(isExit_) return;
-        std::unique_lock<std::mutex> lock(mtx_);
-        resLimit++;
-        cond_.notify_all();
+        state_.wait();
+    }
+    void take(){
+        state_.take();
+    }
+private:
+    ResultState<bool> state_;
+};
+
+//设置了截止时间（或者最长排队时间）的任务在开始执行前已经超时，任务不再执行，get()抛出这个异常
+class TaskExpiredError : public TaskCancelledError{
+public:
+    TaskExpiredError():TaskCancelledError("task deadline expired"){}
+};
+
+//任务队列里保存的任务基类，Task和TypedTask<T>都从它派生
+class TaskBase{
+public:
+    virtual ~TaskBase() = default;
+    virtual void exec() = 0;
+    //截止时间已过，不执行任务，直接让返回值完成为TaskExpiredError
+    virtual void expire() = 0;
+    //开始执行前已经被取消，不执行任务，直接让返回值完成为TaskCancelledError
+    virtual void cancel() = 0;
+    //没有执行（任务队列满被拒绝、被丢弃），直接让返回值完成为异常error
+    virtual void fail(std::exception_ptr error) = 0;
+    //返回值已经完成为异常（被拒绝、被丢弃、被取消、超时或者任务抛出了异常）
+    virtual bool failed() const = 0;
+    //设置了截止时间并且已经超时
+    bool expired() const{
+        return deadline_ != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() > deadline_;
+    }
+    //提交时传入的token已经被取消，正在执行的任务可以在run里检查它提前结束
+    bool cancelled() const{
+        return token_.cancelled();
     }
 private:
-    std::atomic_bool isExit_;
-    int resLimit;
-    std::mutex mtx_;
-    std::condition_variable cond_;
+    friend class ThreadPool;
+    std::chrono::steady_clock::time_point deadline_ = std::chrono::steady_clock::time_point::max();//由线程池在提交时设置
+    CancellationToken token_;//由线程池在提交时设置
+    uint64_t enqueueTime_ = 0;//入队时间（steadyNanos()），普通任务和优先级任务比较先后（老化）、统计排队时间都用它
+};
+
+template<typename T>
+class TypedResult;
+
+//带返回值类型的任务基类：用户从TypedTask<T>继承，重写T run()
+//返回值直接放在任务对象里，不经过MyAny，不需要RTTI
+template<typename T>
+class TypedTask : public TaskBase{
+public:
+    using ResultType = T;
+    //用户可以自定义任务类型，重写run方法，实现自定义任务处理
+    virtual T run() = 0;
+    void exec() override{
+        try{
+            if constexpr(std::is_void<T>::value){
+                run();
+                result_.setValue();
+            }
+            else{
+                result_.setValue(run());//这里发生多态调用
+            }
+        }
+        catch(...){
+            result_.setError(std::current_exception());
+        }
+    }
+    void expire() override{
+        result_.setError(std::make_exception_ptr(TaskExpiredError()));
+    }
+    void cancel() override{
+        result_.setError(std::make_exception_ptr(TaskCancelledError()));
+    }
+    void fail(std::exception_ptr error) override{
+        result_.setError(error);
+    }
+    bool failed() const override{
+        return result_.failed();
+    }
+protected:
+    friend class TypedResult<T>;
+    ResultState<T> result_;
+};
+
+//TypedTask<T>对应的返回值，只持有任务的智能指针，可以移动
+template<typename T>
+class TypedResult{
+public:
+    TypedResult(std::shared_ptr<TypedTask<T>> task, bool isVaild = true)
+    :task_(std::move(task)),isVaild_(isVaild){}
+    TypedResult(TypedResult&&) = default;
+    TypedResult& operator=(TypedResult&&) = default;
+    //任务是否提交成功
+    bool isVaild() const{
+        return isVaild_;
+    }
+    //任务是否已经执行完
+    bool ready() const{
+        return isVaild_ && task_->result_.ready();
+    }
+    //阻塞等待任务执行完
+    void wait(){
+        if(isVaild_){
+            task_->result_.wait();
+        }
+    }
+    //获取任务的返回值，任务没执行完会阻塞用户线程，返回值只能获取一次
+    T get(){
+        if(!isVaild_){
+            throw "result is invaild!";
+        }
+        return task_->result_.take();
+    }
+private:
+    std::shared_ptr<TypedTask<T>> task_;//返回值存放在任务对象里
+    bool isVaild_;//返回值是否有效
 };
 
 class Task;
 
 //实现接收提交到线程池的task任务执行完成后的返回值类型Result
+//兼容原来的MyAny接口，内部就是TypedResult<MyAny>
 class Result{
 public:
     Result(std::shared_ptr<Task> task, bool isVaild = true);
@@ -105,29 +313,53 @@ public:
     //问题二：get方法，用户调用这个方法获取task的返回值
     MyAny get();
 private:
-    MyAny any_;//存储返回值
-    Semaphore sem_;//线程通信信号量
     std::shared_ptr<Task> task_;//指向对应获取返回值的对象
-    std::atomic_bool isVaild_;//返回值是否有效
+    TypedResult<MyAny> res_;
 };
 
 //任务抽象基类
-class Task{
+class Task : public TypedTask<MyAny>{
 public:
     Task();
     ~Task() = default;
-    void exec();
+    //原来由Task把返回值交给Result，现在返回值直接存放在任务里，保留这个接口只是为了兼容
     void setResult(Result* res);
     //用户可以自定义任务类型，从Task继承，重写run方法，实现自定义任务处理
     virtual MyAny run() = 0;//=0纯虚函数，目的是为了不能实例化对象
 private:
-    Result* result_;//不能都用智能指针，智能指针交叉引用会导致无法释放，内存泄漏
+    friend class Result;
 };
+//创建任务对象，代替std::make_shared：任务和引用计数在同一个块里，从线程的slab缓存分配
+//pool.submitTask(makeTask<MyTask>(1, 100))
+template<typename TaskT, typename... Args>
+std::shared_ptr<TaskT> makeTask(Args&&... args){
+    return makeSlabShared<TaskT>(std::forward<Args>(args)...);
+}
+
 //线程池支持的模式
 enum class PoolMode{
     MODE_FIXED, //固定数量的线程
     MODE_CACHED, //线程数量可动态增长
 };
+//任务队列的实现方式
+enum class QueueMode{
+    MODE_MUTEX, //std::deque + 互斥锁，默认方式
+    MODE_LOCKFREE, //有界无锁环形队列，容量为taskQueMaxThreshHold_
+};
+//任务的优先级
+enum class TaskPriority{
+    PRIORITY_HIGH, //交互式、对延迟敏感的任务
+    PRIORITY_NORMAL, //默认优先级，不指定优先级的submitTask都是这一级
+    PRIORITY_LOW, //批处理任务
+};
+//按队列策略创建的全局任务队列，实现在common/executor.hpp
+template<typename T>
+class TaskQueue;
+//空闲线程的睡眠/唤醒，实现在common/eventcount.hpp
+class SpinParkIdle;
+//带优先级和截止时间的任务队列，实现在common/priorityqueue.hpp
+template<typename T>
+class PriorityTaskQueue;
 //线程类型
 class Thread{
 public:
@@ -135,15 +367,18 @@ public:
     using ThreadFunc = std::function<void(int)>;
     //线程构造
     Thread(ThreadFunc func);
-    //线程析构
+    //线程析构，线程还没有被join时在这里join
     ~Thread();
     //启动线程
     void start();
+    //等待线程函数返回
+    void join();
     int getId() const;
 private:
     ThreadFunc func_;
     static int generateId_;
     int threadId_; //保存线程id
+    std::thread thread_;
 };
 
 /*
@@ -169,15 +404,94 @@ public:
     //设置初始的线程数量
     //void setInitThreadSize(int size);
     
-    //设置task任务队列上限阈值
+    //设置任务队列的实现方式，立即按新的模式重新创建任务队列，已经提交的任务搬到新队列里
+    void setQueueMode(QueueMode mode);
+    
+    //设置task任务队列上限阈值，已经提交的任务超过新的上限时，放不下的任务完成为TaskRejectedError
     void setTaskQueMaxThreshHold(int threshhold);
     
     //设置线程池cached模式下线程阈值
     void setThreadSizeThreshHold(int threshhold);
     
+    //设置cached模式弹性伸缩的参数，和2.0使用同一个控制器
+    void setElasticConfig(const ElasticConfig& config);
+    
+    //设置优先级老化的时间：低一级的任务多等待aging相当于提升一级
+    void setPriorityAging(std::chrono::milliseconds aging);
+    
+    //设置空闲线程睡眠前的自旋策略：先自旋spinCount次，再让出CPU yieldCount次，都没有等到任务才睡眠
+    //都设置为0表示没有任务立即睡眠
+    void setIdleSpin(int spinCount, int yieldCount);
+    
+    //设置任务队列满时的过载策略，blockTime是BLOCK策略下提交线程最多等待的时间
+    //只影响submitTask，trySubmit总是立即返回
+    void setOverloadPolicy(OverloadPolicy policy, std::chrono::milliseconds blockTime = std::chrono::seconds(1));
+    
+    //设置过载回调：每个被拒绝、被丢弃、在提交线程执行的任务调用一次，在发生过载的线程上调用，不持有线程池的锁
+    void setOverloadHandler(std::function<void(OverloadEvent)> handler);
+    
     //给线程池提交任务
+    //任务队列满时按过载策略处理，默认最多阻塞1s；被拒绝的任务返回的Result在get()时抛出TaskRejectedError
     Result submitTask(std::shared_ptr<Task> sp);
     
+    //提交带返回值类型的任务，pool.submitTask(std::make_shared<MyTypedTask>())
+    template<typename TaskT, typename T = typename TaskT::ResultType,
+             typename = typename std::enable_if<!std::is_base_of<Task, TaskT>::value>::type>
+    TypedResult<T> submitTask(std::shared_ptr<TaskT> sp){
+        bool isVaild = submitted(pushTask(sp, true), *sp);
+        return TypedResult<T>(std::move(sp), isVaild);
+    }
+    
+    //按优先级提交任务：高优先级的任务先执行，同一优先级内截止时间早的任务先执行
+    //到deadline还没有开始执行的任务会被丢弃，get()抛出TaskExpiredError
+    //优先级任务放在单独的队列里，容量也是taskQueMaxThreshHold_，不会被普通任务占满
+    Result submitTask(std::shared_ptr<Task> sp, TaskPriority priority,
+                      std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+    
+    template<typename TaskT, typename T = typename TaskT::ResultType,
+             typename = typename std::enable_if<!std::is_base_of<Task, TaskT>::value>::type>
+    TypedResult<T> submitTask(std::shared_ptr<TaskT> sp, TaskPriority priority,
+                              std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()){
+        bool isVaild = submitted(pushPriorityTask(sp, priority, deadline, true), *sp);
+        return TypedResult<T>(std::move(sp), isVaild);
+    }
+    
+    //可以取消的任务：token被取消，或者在队列里等待超过maxQueueTime的任务，取出时直接丢弃不执行，
+    //get()抛出TaskCancelledError（排队超时是它的子类TaskExpiredError）
+    //取消一组任务只需要对同一个CancellationSource调用一次cancel()，正在执行的任务可以在run里检查cancelled()
+    Result submitTask(std::shared_ptr<Task> sp, CancellationToken token,
+                      std::chrono::steady_clock::duration maxQueueTime = std::chrono::steady_clock::duration::max());
+    
+    template<typename TaskT, typename T = typename TaskT::ResultType,
+             typename = typename std::enable_if<!std::is_base_of<Task, TaskT>::value>::type>
+    TypedResult<T> submitTask(std::shared_ptr<TaskT> sp, CancellationToken token,
+                              std::chrono::steady_clock::duration maxQueueTime = std::chrono::steady_clock::duration::max()){
+        setCancellation(*sp, std::move(token), maxQueueTime);
+        bool isVaild = submitted(pushTask(sp, true), *sp);
+        return TypedResult<T>(std::move(sp), isVaild);
+    }
+    
+    //非阻塞地提交任务，任务队列满时立即返回无效的Result
+    Result trySubmit(std::shared_ptr<Task> sp);
+    
+    template<typename TaskT, typename T = typename TaskT::ResultType,
+             typename = typename std::enable_if<!std::is_base_of<Task, TaskT>::value>::type>
+    TypedResult<T> trySubmit(std::shared_ptr<TaskT> sp){
+        bool isVaild = submitted(pushTask(sp, false), *sp);
+        return TypedResult<T>(std::move(sp), isVaild);
+    }
+    
+    //运行统计的快照：每个线程执行的任务数量、睡眠/唤醒次数，排队时间和执行时间的直方图
+    //需要编译时定义THREADPOOL_STATS=1，否则返回enabled为false的空快照
+    PoolStats stats() const;
+    
+    //任务对象和返回值的分配器计数（命中/未命中本线程的空闲链表、跨线程释放），进程内所有线程池共用
+    //编译时定义THREADPOOL_SLAB=0关闭分配器时返回enabled为false的空快照
+    static SlabStats allocatorStats();
+    
+    //过载计数：被拒绝、被丢弃、在提交线程执行的任务数量，不受THREADPOOL_STATS影响
+    OverloadStats overloadStats() const;
+    
     //开启线程池
     void start(int initThreadSize = std::thread::hardware_concurrency());//hardware_concurrency本机cpu核数量
     
@@ -185,30 +499,129 @@ public:
     ThreadPool& operator=(const ThreadPool&) = delete;//禁止重载赋值
     
 private:
-    //定义线程函数
+    //定义线程函数，按队列模式选定队列策略，按线程池模式选定线程增长策略
     void threadFunc(int threadid);
     
+    //按队列模式调用f(QueuePolicy())，创建队列和工作线程启动时各选一次
+    template<typename F>
+    void withQueuePolicy(F&& f) const;
+    
+    //工作线程循环，按队列策略直接访问全局队列；fixed模式为FixedGrowth，cached模式由控制线程回收线程，为ControlledGrowth
+    template<typename QueuePolicy, typename Growth>
+    void runWorker(int threadid, const Growth& growth);
+    
+    //把任务放入任务队列，放入失败返回false
+    //队列满时block为false立即返回false；block为true时按过载策略处理，被拒绝的任务直接完成为TaskRejectedError
+    bool pushTask(std::shared_ptr<TaskBase> sp, bool block);
+    
+    //不等待地放入任务队列，队列满返回false
+    bool tryPushTask(std::shared_ptr<TaskBase>& sp);
+    
+    //等待任务队列有空余再放入，最多等待timeout，超时返回false
+    bool waitPushTask(std::shared_ptr<TaskBase>& sp, std::chrono::milliseconds timeout);
+    
+    //DROP_OLDEST：丢弃任务队列里等待最久的一个任务，返回是否丢弃了任务
+    bool dropOldestTask();
+    
+    //被拒绝的任务：报告EVENT_REJECTED，返回值完成为TaskRejectedError
+    void rejectTask(TaskBase& task);
+    
+    //提交返回的结果是否有效：当且仅当任务被接受（放入了队列，或者CALLER_RUNS在提交线程执行了），
+    //或者没有被接受但已经完成为异常（阻塞提交被拒绝时是TaskRejectedError，get()抛出它）
+    //trySubmit队列满时任务没有被接受也没有完成，返回无效的结果，不会出现一个看起来有效却永远不完成的结果
+    static bool submitted(bool accepted, const TaskBase& task);
+    
+    //把任务放入优先级队列，放入失败返回false；block为true时按过载策略处理，DROP_OLDEST和FAIL_FAST一样直接拒绝
+    bool pushPriorityTask(std::shared_ptr<TaskBase> sp, TaskPriority priority, std::chrono::steady_clock::time_point deadline, bool block);
+    
+    //按queueMode_选定的队列策略创建全局任务队列，容量是taskQueMaxThreshHold_
+    std::unique_ptr<TaskQueue<std::shared_ptr<TaskBase>>> makeTaskQueue() const;
+    
+    //线程池没有运行时按当前的设置重新创建全局任务队列，已经提交的任务搬到新队列里，否则线程只从新队列取任务，它们永远不会执行
+    //提交以后又调小了setTaskQueMaxThreshHold，新队列放不下的任务完成为TaskRejectedError
+    void rebuildQueue();
+    
+    //执行一个任务：已经被取消或者超过截止时间的任务不执行
+    static void runTask(TaskBase& task);
+    
+    //从优先级队列取任务，调用方需要持有taskQueMtx_
+    bool popPriorityTask(std::shared_ptr<TaskBase>& task);
+    
+    //刚从全局队列取出的普通任务和优先级队列比较，优先级队列里有更紧急的任务时交换
+    void yieldToPriority(std::shared_ptr<TaskBase>& task);
+    
+    //cached模式的控制线程：按ElasticController的决定扩容或者缩容，提交任务的线程不再创建线程
+    void monitorFunc();
+    
+    //创建并启动n个新线程
+    void addThreads(int n);
+    
+    //通知一个空闲线程退出，线程数量不能低于minSize
+    bool retireThread(int minSize);
+    
+    //不睡眠地取一个任务，没有任务返回false，全局队列按线程启动时选定的队列策略直接访问
+    template<typename QueuePolicy>
+    bool takeTask(std::shared_ptr<TaskBase>& task);
+    
+    //工作线程退出：线程池结束，或者控制线程要求回收线程时退出，返回false表示不需要退出
+    bool exitThread(int threadid, WorkerStatsRef& stats);
+    
+    //保存任务的取消标志，最长排队时间换算成截止时间
+    static void setCancellation(TaskBase& task, CancellationToken token, std::chrono::steady_clock::duration maxQueueTime);
+    
+    //记录/读取任务的入队时间
+    static void stampTask(TaskBase& task);
+    static uint64_t enqueueTimeOf(const TaskBase& task);
+    static std::chrono::steady_clock::time_point enqueueTimePoint(const TaskBase& task);
+    
+    //线程退出时把线程对象从threads_移到exitedThreads_，返回之前退出的线程，由调用方在锁外join
+    //调用方需要持有taskQueMtx_
+    std::vector<std::unique_ptr<Thread>> detachExitedThread(int threadid);
+    
+    //放入新任务后，没有线程在自旋的话唤醒一个睡眠的线程
+    void wakeSleepingThread();
+    
+    //全局队列取走任务后，通知阻塞在notFull_上的提交线程
+    void notifyBlockedSubmit();
+    
     bool checkRunningState() const;
 private:
 //    std::vector<std::unique_ptr<Thread>> threads_; //线程列表
     std::unordered_map<int, std::unique_ptr<Thread>> threads_;
+    std::vector<std::unique_ptr<Thread>> exitedThreads_;//已经退出还没有join的线程，由taskQueMtx_保护
     size_t initThreadSize_; //初始的线程数量
     int threadSizeThreshHold_; //线程数量上限阈值
     std::atomic_int curThreadSize_;//记录当前线程池里面的线程总数量
     std::atomic_int idleThreadSize_;//记录空闲线程的数量
     
-    std::queue<std::shared_ptr<Task>> taskQue_;//任务队列，Task*不能保证用户传进来的任务周期足够长，智能指针可以确保在完成任务后自动释放内存
+    std::unique_ptr<TaskQueue<std::shared_ptr<TaskBase>>> taskQue_;//任务队列，按queueMode_选定的队列策略创建，构造时创建，start之前也可以提交；Task*不能保证用户传进来的任务周期足够长，智能指针可以确保在完成任务后自动释放内存
     std::atomic_int taskSize_;//任务数量，保证原子操作，保证线程安全
     int taskQueMaxThreshHold_; //任务队列数量上限阈值
     
     std::mutex taskQueMtx_; //保证任务队列的线程安全
     std::condition_variable notFull_; //表示任务队列不满
-    std::condition_variable notEmpty_; //表示任务队列不空
     std::condition_variable exitCond_;//等待线程资源全部回收
     
     PoolMode poolMode_;//当前线程池的工作模式
     
     std::atomic_bool isPoolRunning_;//表示当前线程池的启动状态
+    
+    QueueMode queueMode_;//任务队列的实现方式
+    std::unique_ptr<SpinParkIdle> idle_;//空闲线程的自旋和睡眠，和2.0、BasicExecutor共用
+    std::atomic_int blockedSubmitSize_;//全局队列满时阻塞在notFull_上的提交线程数量
+    
+    std::unique_ptr<PriorityTaskQueue<std::shared_ptr<TaskBase>>> priorityQue_;//指定了优先级的任务，由taskQueMtx_保护，构造时创建，start之前也可以提交
+    std::atomic_int priorityTaskSize_;//优先级队列里的任务数量，为0时取任务不需要加锁检查优先级队列
+    
+    ElasticConfig elasticConfig_;//cached模式弹性伸缩的参数
+    std::thread monitor_;//cached模式的控制线程
+    std::mutex monitorMtx_;
+    std::condition_variable monitorCond_;
+    std::atomic<uint64_t> completedTaskSize_;//cached模式下已经执行完的任务数量，用来计算吞吐量
+    std::atomic_int retireThreadSize_;//等待退出的空闲线程数量，只在持有taskQueMtx_时修改
+    
+    StatsRegistry stats_;//每个线程的计数器和直方图，THREADPOOL_STATS为0时是空对象
+    OverloadControl overload_;//任务队列满时的过载策略、回调和计数器
 };
 
 #endif /* threadpool_hpp */
@@ -0,0 +1,284 @@
+//
+//  coroutine.hpp
+//  ThreadPool2.0
+//
+//  C++20协程支持：co_await pool.schedule()切换到线程池的线程，CoTask<T>惰性启动的协程任务，
+//  syncWait在普通函数里等待协程结果。需要用-std=c++20编译，C++17下这个头文件是空的
+//
+
+#ifndef coroutine_hpp
+#define coroutine_hpp
+
+#include "threadpool.hpp"
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+inline namespace v2{
+
+//放入任务队列的协程句柄：执行时恢复协程
+//没有执行就被丢弃（线程池ABORT关闭）时，把异常交给挂起的awaiter再恢复协程，co_await抛出这个异常，
+//协程可以捕获它或者带着异常结束，不会永远挂起、泄漏协程帧
+//只有16字节，放在TaskFunc的内部缓冲区里，不需要堆分配
+struct CoResume{
+    std::coroutine_handle<> handle;
+    std::exception_ptr* error;//挂起的awaiter里的异常，协程挂起期间一直有效
+
+    void operator()(){
+        handle.resume();
+    }
+    void abandon(std::exception_ptr e){
+        *error = std::move(e);
+        handle.resume();
+    }
+};
+
+//co_await pool.schedule()：协程挂起，协程句柄直接作为任务放入线程池的任务队列，由线程池的线程恢复执行
+//线程池ABORT关闭丢弃了这个任务时co_await抛出PoolShutdownError，没能放入任务队列时抛出提交失败的原因
+class ScheduleAwaiter{
+public:
+    explicit ScheduleAwaiter(ThreadPool& pool):pool_(pool){}
+    bool await_ready() const noexcept{
+        return false;
+    }
+    //任务队列满时按过载策略处理（BLOCK等待队列有空余，CALLER_RUNS在当前线程恢复），
+    //被拒绝或者线程池已经关闭时在当前线程恢复，co_await抛出TaskRejectedError或者PoolShutdownError
+    void await_suspend(std::coroutine_handle<> handle){
+        TaskFunc task(CoResume{handle, &error_});
+        if(!pool_.pushTask(std::move(task), true)){
+            task.abandon(pool_.submitError());
+        }
+    }
+    void await_resume() const{
+        if(error_){
+            std::rethrow_exception(error_);
+        }
+    }
+private:
+    ThreadPool& pool_;
+    std::exception_ptr error_;
+};
+
+inline ScheduleAwaiter ThreadPool::schedule(){
+    return ScheduleAwaiter(*this);
+}
+
+//CoTask的promise公共部分：惰性启动，结束时对称转移到等待它的协程，不占用线程栈
+struct CoTaskPromiseBase{
+    struct FinalAwaiter{
+        bool await_ready() const noexcept{
+            return false;
+        }
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept{
+            std::coroutine_handle<> continuation = handle.promise().continuation_;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+        void await_resume() const noexcept{}
+    };
+
+    std::suspend_always initial_suspend() const noexcept{
+        return {};
+    }
+    FinalAwaiter final_suspend() const noexcept{
+        return {};
+    }
+    void unhandled_exception() noexcept{
+        error_ = std::current_exception();
+    }
+
+    std::coroutine_handle<> continuation_;//co_await这个任务的协程
+    std::exception_ptr error_;
+};
+
+template<typename T>
+struct CoTaskPromise : CoTaskPromiseBase{
+    CoTask<T> get_return_object() noexcept;
+    template<typename U>
+    void return_value(U&& value){
+        value_.emplace(std::forward<U>(value));
+    }
+    T result(){
+        if(error_)
+            std::rethrow_exception(error_);
+        return std::move(*value_);
+    }
+    std::optional<T> value_;
+};
+
+template<>
+struct CoTaskPromise<void> : CoTaskPromiseBase{
+    CoTask<void> get_return_object() noexcept;
+    void return_void() noexcept{}
+    void result(){
+        if(error_)
+            std::rethrow_exception(error_);
+    }
+};
+
+//惰性启动的协程任务：创建时不执行，第一次被co_await时才开始，co_await挂起等待结果而不是阻塞线程
+//在哪个线程执行由协程自己决定，比如先co_await pool.schedule()
+//只能移动，结果只能取一次
+template<typename T>
+class CoTask{
+public:
+    using promise_type = CoTaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    CoTask() = default;
+    explicit CoTask(Handle handle):handle_(handle){}
+    CoTask(CoTask&& other) noexcept:handle_(std::exchange(other.handle_, nullptr)){}
+    CoTask& operator=(CoTask&& other) noexcept{
+        if(this != &other){
+            if(handle_)
+                handle_.destroy();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    CoTask(const CoTask&) = delete;
+    CoTask& operator=(const CoTask&) = delete;
+    ~CoTask(){
+        if(handle_)
+            handle_.destroy();
+    }
+
+    bool valid() const{
+        return (bool)handle_;
+    }
+
+    //co_await task：启动任务并挂起，任务结束时直接恢复等待方，返回任务的结果，异常在这里重新抛出
+    auto operator co_await() noexcept{
+        struct Awaiter : CompletionAwaiter{
+            T await_resume(){
+                return this->handle.promise().result();
+            }
+        };
+        return Awaiter{{handle_}};
+    }
+
+private:
+    //等待任务结束但不取结果，syncWait和spawn用它把结果交给别的地方
+    struct CompletionAwaiter{
+        Handle handle;
+        bool await_ready() const noexcept{
+            return !handle || handle.done();
+        }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept{
+            handle.promise().continuation_ = continuation;
+            return handle;
+        }
+        void await_resume() const noexcept{}
+    };
+    CompletionAwaiter completion() noexcept{
+        return CompletionAwaiter{handle_};
+    }
+    T result(){
+        return handle_.promise().result();
+    }
+
+    template<typename U>
+    friend U syncWait(CoTask<U> task);
+    friend class ThreadPool;
+
+    Handle handle_;
+};
+
+template<typename T>
+CoTask<T> CoTaskPromise<T>::get_return_object() noexcept{
+    return CoTask<T>(CoTask<T>::Handle::from_promise(*this));
+}
+
+inline CoTask<void> CoTaskPromise<void>::get_return_object() noexcept{
+    return CoTask<void>(CoTask<void>::Handle::from_promise(*this));
+}
+
+//立即开始、结束时自己销毁的协程，syncWait和spawn用它驱动CoTask
+struct DetachedCoroutine{
+    struct promise_type{
+        DetachedCoroutine get_return_object() const noexcept{
+            return {};
+        }
+        std::suspend_never initial_suspend() const noexcept{
+            return {};
+        }
+        std::suspend_never final_suspend() const noexcept{
+            return {};
+        }
+        void return_void() const noexcept{}
+        void unhandled_exception() const noexcept{
+            std::terminate();
+        }
+    };
+};
+
+//在不能co_await的地方（比如main）阻塞等待协程任务完成，返回结果，异常在这里重新抛出
+template<typename T>
+T syncWait(CoTask<T> task){
+    std::mutex mtx;
+    std::condition_variable cond;
+    bool done = false;
+    using Completion = decltype(task.completion());
+    [](Completion completion, std::mutex& mtx, std::condition_variable& cond, bool& done) -> DetachedCoroutine {
+        co_await completion;
+        std::unique_lock<std::mutex> lock(mtx);
+        done = true;
+        cond.notify_all();
+    }(task.completion(), mtx, cond, done);
+    std::unique_lock<std::mutex> lock(mtx);
+    cond.wait(lock, [&]()->bool {return done;});
+    return task.result();
+}
+
+//在线程池上启动协程任务，不等待它完成，返回可以get、then、whenAll或者co_await的PoolFuture
+template<typename T>
+PoolFuture<T> ThreadPool::spawn(CoTask<T> task){
+    auto state = makeSlabShared<FutureState<T>>(anchor_);
+    [](ThreadPool& pool, CoTask<T> task, std::shared_ptr<FutureState<T>> state) -> DetachedCoroutine {
+        //线程池ABORT关闭时协程还没有开始，返回的PoolFuture完成为PoolShutdownError
+        try{
+            co_await pool.schedule();
+        }
+        catch(...){
+            state->setError(std::current_exception());
+            co_return;
+        }
+        co_await task.completion();
+        state->run([&]()->T {return task.result();});
+    }(*this, std::move(task), state);
+    return PoolFuture<T>(std::move(state));
+}
+
+//co_await future：结果就绪时在线程池上恢复协程，不阻塞线程
+//恢复协程的任务被线程池ABORT关闭丢弃时co_await抛出PoolShutdownError
+template<typename T>
+auto operator co_await(PoolFuture<T> future){
+    struct Awaiter{
+        std::shared_ptr<FutureState<T>> state;
+        std::exception_ptr error;
+        bool await_ready() const noexcept{
+            return state->ready();
+        }
+        void await_suspend(std::coroutine_handle<> handle){
+            state->onReady(TaskFunc(CoResume{handle, &error}), true);
+        }
+        T await_resume(){
+            if(error){
+                std::rethrow_exception(error);
+            }
+            return state->take();
+        }
+    };
+    return Awaiter{future.state(), nullptr};
+}
+
+} //namespace v2
+
+#endif
+
+#endif /* coroutine_hpp */
@@ -0,0 +1,225 @@
+//
+//  groupscheduler.hpp
+//  ThreadPool2.0
+//
+//  多租户任务组的加权公平调度：每个组一个FIFO队列，组之间按权重做deficit round-robin，
+//  可以限制每个组同时执行的任务数量，每个组单独统计队列长度、排队时间和执行时间
+//
+
+#ifndef groupscheduler_hpp
+#define groupscheduler_hpp
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "poolstats.hpp"
+
+//一个任务组的统计快照
+struct GroupStats{
+    std::string name;
+    int weight = 1;
+    int maxConcurrency = 0;//0表示不限制
+    size_t queued = 0;//还在组队列里等待的任务数量
+    int running = 0;//正在执行的任务数量
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    uint64_t rejected = 0;//没有执行就被拒绝或者丢弃的任务数量
+    HistogramSnapshot queueWait;//从提交到开始执行的时间
+    HistogramSnapshot execTime;//执行时间
+};
+
+//线程池往自己的任务队列里放“执行令牌”，令牌被线程取出时才由调度器决定执行哪个组的任务，
+//所以组之间的公平性不受线程池队列FIFO顺序的影响
+//令牌数量始终等于现在就可以执行的组任务数量（组队列里、没有超过并发上限的部分），
+//达到并发上限的组不占用令牌，不会让线程空转
+//所有操作都在调度器自己的锁里完成，和线程池的taskQueMtx_无关
+template<typename Task>
+class GroupScheduler{
+public:
+    struct Group{
+        std::string name;
+        int weight;//每一轮最多连续执行的任务数量
+        int maxConcurrency;
+        std::deque<std::pair<Task, uint64_t>> que;//任务和入队时间（纳秒）
+        int running = 0;
+        int deficit = 0;
+        GroupStats stats;
+
+        //没有超过并发上限、现在就可以执行的任务数量
+        size_t runnable() const{
+            if(maxConcurrency <= 0)
+                return que.size();
+            return std::min(que.size(), (size_t)std::max(maxConcurrency - running, 0));
+        }
+    };
+
+    GroupScheduler():cur_(0),runnable_(0),tokens_(0){}
+    GroupScheduler(const GroupScheduler&) = delete;
+    GroupScheduler& operator=(const GroupScheduler&) = delete;
+
+    //组创建以后一直存在，返回的指针在调度器析构之前有效；名字重复或者权重不大于0时抛出std::invalid_argument
+    Group* addGroup(std::string name, int weight, int maxConcurrency){
+        if(weight <= 0)
+            throw std::invalid_argument("task group weight must be positive");
+        std::lock_guard<std::mutex> lock(mtx_);
+        for(auto& g : groups_){
+            if(g->name == name)
+                throw std::invalid_argument("task group already exists: " + name);
+        }
+        auto group = std::make_unique<Group>();
+        group->name = std::move(name);
+        group->weight = weight;
+        group->maxConcurrency = std::max(maxConcurrency, 0);
+        groups_.push_back(std::move(group));
+        return groups_.back().get();
+    }
+
+    //放入一个任务，返回需要新放入线程池的令牌数量
+    size_t push(Group* g, Task&& task){
+        std::lock_guard<std::mutex> lock(mtx_);
+        size_t before = g->runnable();
+        g->que.emplace_back(std::move(task), now());
+        g->stats.submitted++;
+        runnable_ += g->runnable() - before;
+        return issueTokens();
+    }
+
+    //执行一个令牌：按DRR选一个组，取出它最早的任务，这个组的running加一
+    //已经没有可以执行的任务（ABORT关闭时被clear）返回nullptr
+    Group* pop(Task& task){
+        std::lock_guard<std::mutex> lock(mtx_);
+        tokens_--;
+        Group* g = pickGroup();
+        if(g == nullptr)
+            return nullptr;
+        size_t before = g->runnable();
+        task = std::move(g->que.front().first);
+        g->stats.queueWait.record(now() - g->que.front().second);
+        g->que.pop_front();
+        g->running++;
+        runnable_ -= before - g->runnable();
+        return g;
+    }
+
+    //任务执行完，返回需要新放入线程池的令牌数量（达到并发上限的组又可以执行了）
+    size_t finish(Group* g, uint64_t execNs){
+        std::lock_guard<std::mutex> lock(mtx_);
+        size_t before = g->runnable();
+        g->running--;
+        g->stats.completed++;
+        g->stats.execTime.record(execNs);
+        runnable_ += g->runnable() - before;
+        return issueTokens();
+    }
+
+    //令牌没有执行就被丢弃（过载时被丢弃、ABORT关闭）：按DRR取出一个任务，不执行
+    bool drop(Task& task){
+        std::lock_guard<std::mutex> lock(mtx_);
+        tokens_--;
+        Group* g = pickGroup();
+        if(g == nullptr)
+            return false;
+        size_t before = g->runnable();
+        task = std::move(g->que.front().first);
+        g->que.pop_front();
+        g->stats.rejected++;
+        runnable_ -= before - g->runnable();
+        return true;
+    }
+
+    //count个令牌没能放入线程池：从g的队列尾部（最新提交的任务）取出任务放进rejected，直到剩下的任务都有令牌
+    void reject(Group* g, size_t count, std::vector<Task>& rejected){
+        std::lock_guard<std::mutex> lock(mtx_);
+        tokens_ -= count;
+        while(tokens_ < runnable_ && !g->que.empty()){
+            size_t before = g->runnable();
+            rejected.push_back(std::move(g->que.back().first));
+            g->que.pop_back();
+            g->stats.rejected++;
+            runnable_ -= before - g->runnable();
+        }
+    }
+
+    //取出所有组里还没有执行的任务
+    void clear(std::vector<Task>& out){
+        std::lock_guard<std::mutex> lock(mtx_);
+        for(auto& g : groups_){
+            for(auto& item : g->que){
+                out.push_back(std::move(item.first));
+            }
+            g->stats.rejected += g->que.size();
+            g->que.clear();
+        }
+        runnable_ = 0;
+    }
+
+    GroupStats stats(const Group* g) const{
+        std::lock_guard<std::mutex> lock(mtx_);
+        return snapshot(*g);
+    }
+    std::vector<GroupStats> stats() const{
+        std::lock_guard<std::mutex> lock(mtx_);
+        std::vector<GroupStats> out;
+        for(auto& g : groups_){
+            out.push_back(snapshot(*g));
+        }
+        return out;
+    }
+
+private:
+    static uint64_t now(){
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static GroupStats snapshot(const Group& g){
+        GroupStats s = g.stats;
+        s.name = g.name;
+        s.weight = g.weight;
+        s.maxConcurrency = g.maxConcurrency;
+        s.queued = g.que.size();
+        s.running = g.running;
+        return s;
+    }
+
+    //补齐令牌，返回新增的数量
+    size_t issueTokens(){
+        if(tokens_ >= runnable_)
+            return 0;
+        size_t n = runnable_ - tokens_;
+        tokens_ = runnable_;
+        return n;
+    }
+
+    //deficit round-robin：每个组轮到时deficit加上weight，每执行一个任务减一，
+    //用完或者没有可以执行的任务就轮到下一个组；没有可以执行的任务的组清空deficit，不能攒着以后突发
+    Group* pickGroup(){
+        if(runnable_ == 0)
+            return nullptr;
+        for(;;){
+            Group* g = groups_[cur_].get();
+            if(g->deficit > 0 && g->runnable() > 0){
+                g->deficit--;
+                return g;
+            }
+            cur_ = (cur_ + 1) % groups_.size();
+            Group* next = groups_[cur_].get();
+            next->deficit = next->runnable() > 0 ? next->deficit + next->weight : 0;
+        }
+    }
+
+    mutable std::mutex mtx_;
+    std::vector<std::unique_ptr<Group>> groups_;
+    size_t cur_;//DRR当前轮到的组
+    size_t runnable_;//所有组现在就可以执行的任务数量
+    size_t tokens_;//已经发出、还没有执行的令牌数量
+};
+
+#endif /* groupscheduler_hpp */
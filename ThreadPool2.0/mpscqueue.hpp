@@ -0,0 +1,69 @@
+//
+//  mpscqueue.hpp
+//  ThreadPool2.0
+//
+//  无界无锁多生产者单消费者队列
+//  参考：Dmitry Vyukov, Non-intrusive MPSC node-based queue
+//
+
+#ifndef mpscqueue_hpp
+#define mpscqueue_hpp
+
+#include <atomic>
+#include <utility>
+#include "slaballoc.hpp"
+
+//生产者只做一次exchange和一次store，消费者不需要任何CAS；节点从线程的slab缓存分配
+//生产者exchange之后、链接next之前，消费者会暂时看不到这个节点和它后面的节点，tryPop返回false
+//T需要可以默认构造，消费者当前持有的节点是哨兵
+template<typename T>
+class MpscQueue{
+public:
+    MpscQueue()
+    :head_(&stub_)
+    ,tail_(&stub_)
+    {}
+    ~MpscQueue(){
+        T item;
+        while(tryPop(item)){}
+        if(tail_ != &stub_)
+            slabDelete(tail_);
+    }
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    //任意线程调用
+    void push(T&& item){
+        Node* node = slabNew<Node>(std::move(item));
+        Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    //只能由一个消费者调用，队列空（或者生产者还没有链接完）时返回false
+    bool tryPop(T& item){
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if(next == nullptr)
+            return false;
+        item = std::move(next->value);
+        //next成为新的哨兵，旧的哨兵可以释放
+        tail_ = next;
+        if(tail != &stub_)
+            slabDelete(tail);
+        return true;
+    }
+
+private:
+    struct Node{
+        Node() = default;
+        explicit Node(T&& v):value(std::move(v)){}
+        std::atomic<Node*> next{nullptr};
+        T value;
+    };
+
+    Node stub_;
+    alignas(64) std::atomic<Node*> head_;//生产者端
+    alignas(64) Node* tail_;//消费者端
+};
+
+#endif /* mpscqueue_hpp */
@@ -0,0 +1,322 @@
+//
+//  parallel.hpp
+//  ThreadPool2.0
+//
+//  基于线程池的并行算法：parallelReduce、parallelTransform、parallelScan、parallelSort
+//  区间按二分递归切分，切分出来的一半放入当前线程的任务队列，另一半当前线程继续处理，
+//  等待时用helpUntil执行其他任务；只有其他线程需要任务时才继续切分，不是每一块一个future
+//
+
+#ifndef parallel_hpp
+#define parallel_hpp
+
+#include "threadpool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <vector>
+
+inline namespace v2{
+
+//fork-join的基本操作，算法都建立在它上面
+class ForkJoin{
+public:
+    //在线程池的线程里执行f：当前线程就是这个线程池的线程时直接执行，否则提交一个任务并等待它完成
+    //算法的调用方不在线程池里时只占用一次提交，之后的切分和等待都在线程池内部
+    template<typename F>
+    static void enter(ThreadPool& pool, F&& f){
+        if(ThreadPool::currentWorker().pool == &pool){
+            f();
+            return;
+        }
+        pool.submitAsync([&f](){f();}).get();
+    }
+
+    //right放入当前线程的任务队列，当前线程执行left，再帮助式等待right完成，两边的异常都会重新抛出
+    //fork为false时在当前线程依次执行，不产生任务
+    template<typename L, typename R>
+    static void invoke(ThreadPool& pool, bool fork, L&& left, R&& right){
+        if(!fork){
+            left();
+            right();
+            return;
+        }
+        using RFn = typename std::remove_reference<R>::type;
+        ForkState state;
+        pool.postContinuation(ForkTask<RFn>{&right, &state});
+        std::exception_ptr leftError;
+        try{
+            left();
+        }
+        catch(...){
+            leftError = std::current_exception();
+        }
+        auto done = [&]()->bool {return state.done.load(std::memory_order_acquire);};
+        if(!pool.helpUntil(done)){
+            while(!done()){
+                std::this_thread::yield();
+            }
+        }
+        if(leftError)
+            std::rethrow_exception(leftError);
+        if(state.error)
+            std::rethrow_exception(state.error);
+    }
+
+    //要不要再切分出一个任务：有空闲线程，并且之前切分出去的任务已经被取走
+    //工作窃取模式下看当前线程的本地队列是不是空了（被窃取了），其他模式看全局队列
+    static bool shouldSplit(ThreadPool& pool){
+        if(pool.idleThreadSize_ <= 0)
+            return false;
+        int index = ThreadPool::currentWorker().index;
+        if(index >= 0)
+            return pool.workerQues_[index]->empty();
+        return pool.taskSize_ <= 0;
+    }
+
+    static size_t threadCount(ThreadPool& pool){
+        return (size_t)std::max(1, (int)pool.curThreadSize_);
+    }
+
+    //不管线程忙不忙都切分的层数：每个线程至少分到两块
+    static int eagerDepth(ThreadPool& pool){
+        int depth = 1;
+        for(size_t n = threadCount(pool); n > 1; n = (n + 1) / 2){
+            depth++;
+        }
+        return depth;
+    }
+
+    //没有指定grain时的最小块大小：每个线程大约64块，切分是否真的发生由shouldSplit决定
+    static size_t defaultGrain(ThreadPool& pool, size_t n){
+        return std::max<size_t>(1, n / (threadCount(pool) * 64));
+    }
+
+private:
+    struct ForkState{
+        std::atomic_bool done{false};
+        std::exception_ptr error;
+    };
+
+    //只保存两个指针，可以放在TaskFunc的内部缓冲区里
+    template<typename R>
+    struct ForkTask{
+        R* fn;
+        ForkState* state;
+        void operator()(){
+            try{
+                (*fn)();
+            }
+            catch(...){
+                state->error = std::current_exception();
+            }
+            state->done.store(true, std::memory_order_release);
+        }
+        void abandon(std::exception_ptr error){
+            state->error = error;
+            state->done.store(true, std::memory_order_release);
+        }
+    };
+};
+
+namespace parallel_detail{
+
+//[begin, end)按二分递归切分，叶子区间调用body(begin, end)
+template<typename Body>
+void forRange(ThreadPool& pool, size_t begin, size_t end, size_t grain, int depth, Body& body){
+    if(end - begin > grain && (depth > 0 || ForkJoin::shouldSplit(pool))){
+        size_t mid = begin + (end - begin) / 2;
+        ForkJoin::invoke(pool, true,
+            [&](){forRange(pool, begin, mid, grain, depth - 1, body);},
+            [&](){forRange(pool, mid, end, grain, depth - 1, body);});
+        return;
+    }
+    body(begin, end);
+}
+
+template<typename It, typename T, typename Op>
+T reduceRange(ThreadPool& pool, It first, size_t begin, size_t end, size_t grain, int depth, Op& op){
+    if(end - begin > grain && (depth > 0 || ForkJoin::shouldSplit(pool))){
+        size_t mid = begin + (end - begin) / 2;
+        std::optional<T> left, right;
+        ForkJoin::invoke(pool, true,
+            [&](){left.emplace(reduceRange<It, T>(pool, first, begin, mid, grain, depth - 1, op));},
+            [&](){right.emplace(reduceRange<It, T>(pool, first, mid, end, grain, depth - 1, op));});
+        return op(std::move(*left), std::move(*right));
+    }
+    It it = first + begin;
+    T acc = *it;
+    for(++it; it != first + end; ++it){
+        acc = op(std::move(acc), *it);
+    }
+    return acc;
+}
+
+//把两个有序区间合并到out，较长的区间取中点，在另一个区间里二分查找切分点，两半并行合并
+template<typename It, typename Out, typename Comp>
+void mergeRange(ThreadPool& pool, It a, It aEnd, It b, It bEnd, Out out, size_t grain, Comp& comp){
+    size_t na = aEnd - a;
+    size_t nb = bEnd - b;
+    if(na < nb){
+        std::swap(a, b);
+        std::swap(aEnd, bEnd);
+        std::swap(na, nb);
+    }
+    if(na + nb <= grain || na == 0 || !ForkJoin::shouldSplit(pool)){
+        std::merge(std::make_move_iterator(a), std::make_move_iterator(aEnd),
+                   std::make_move_iterator(b), std::make_move_iterator(bEnd), out, comp);
+        return;
+    }
+    It aMid = a + na / 2;
+    It bMid = std::lower_bound(b, bEnd, *aMid, comp);
+    Out outMid = out + (aMid - a) + (bMid - b);
+    *outMid = std::move(*aMid);
+    ForkJoin::invoke(pool, true,
+        [&](){mergeRange(pool, a, aMid, b, bMid, out, grain, comp);},
+        [&](){mergeRange(pool, aMid + 1, aEnd, bMid, bEnd, outMid + 1, grain, comp);});
+}
+
+//归并排序src[0, n)，buf是同样大小的临时空间，toBuf为true时结果放在buf里，否则留在src里
+//两层之间交替使用src和buf，每一层只移动一次元素
+template<typename It, typename Buf, typename Comp>
+void sortRange(ThreadPool& pool, It src, Buf buf, size_t n, bool toBuf, size_t grain, int depth, Comp& comp){
+    if(n <= grain || (depth <= 0 && !ForkJoin::shouldSplit(pool))){
+        std::sort(src, src + n, comp);
+        if(toBuf)
+            std::move(src, src + n, buf);
+        return;
+    }
+    size_t mid = n / 2;
+    ForkJoin::invoke(pool, true,
+        [&](){sortRange(pool, src, buf, mid, !toBuf, grain, depth - 1, comp);},
+        [&](){sortRange(pool, src + mid, buf + mid, n - mid, !toBuf, grain, depth - 1, comp);});
+    if(toBuf)
+        mergeRange(pool, src, src + mid, src + mid, src + n, buf, grain, comp);
+    else
+        mergeRange(pool, buf, buf + mid, buf + mid, buf + n, src, grain, comp);
+}
+
+} //namespace parallel_detail
+
+//并行规约：op需要满足结合律（不需要交换律），结果按元素顺序组合，init只参与一次
+//grain为0时按线程数量选择最小块大小，迭代器需要是随机访问迭代器
+template<typename It, typename T, typename Op>
+T parallelReduce(ThreadPool& pool, It first, It last, T init, Op op, size_t grain = 0){
+    size_t n = last - first;
+    if(n == 0)
+        return init;
+    if(grain == 0)
+        grain = ForkJoin::defaultGrain(pool, n);
+    std::optional<T> result;
+    ForkJoin::enter(pool, [&](){
+        result.emplace(parallel_detail::reduceRange<It, T>(pool, first, 0, n, grain, ForkJoin::eagerDepth(pool), op));
+    });
+    return op(std::move(init), std::move(*result));
+}
+
+template<typename It, typename T>
+T parallelReduce(ThreadPool& pool, It first, It last, T init){
+    return parallelReduce(pool, first, last, std::move(init), std::plus<>());
+}
+
+//并行变换：out[i] = op(first[i])，返回输出的结束位置
+template<typename InIt, typename OutIt, typename Op>
+OutIt parallelTransform(ThreadPool& pool, InIt first, InIt last, OutIt out, Op op, size_t grain = 0){
+    size_t n = last - first;
+    if(n == 0)
+        return out;
+    if(grain == 0)
+        grain = ForkJoin::defaultGrain(pool, n);
+    auto body = [&](size_t b, size_t e){
+        std::transform(first + b, first + e, out + b, op);
+    };
+    ForkJoin::enter(pool, [&](){
+        parallel_detail::forRange(pool, 0, n, grain, ForkJoin::eagerDepth(pool), body);
+    });
+    return out + n;
+}
+
+//并行包含扫描（inclusive scan）：out[i] = first[0] op first[1] op ... op first[i]，op需要满足结合律
+//分成若干块，第一遍并行求每块的和，顺序求出每块的前缀，第二遍并行写出每块的扫描结果，out可以等于first
+template<typename InIt, typename OutIt, typename Op = std::plus<>>
+OutIt parallelScan(ThreadPool& pool, InIt first, InIt last, OutIt out, Op op = Op(), size_t grain = 0){
+    using T = typename std::iterator_traits<InIt>::value_type;
+    size_t n = last - first;
+    if(n == 0)
+        return out;
+    if(grain == 0)
+        grain = ForkJoin::defaultGrain(pool, n);
+    //两遍扫描的块数是固定的，每个线程几块，块太小时少分几块
+    size_t pieces = std::min<size_t>(ForkJoin::threadCount(pool) * 4, (n + grain - 1) / grain);
+    if(pieces <= 1){
+        std::partial_sum(first, last, out, op);
+        return out + n;
+    }
+    size_t pieceSize = (n + pieces - 1) / pieces;
+    pieces = (n + pieceSize - 1) / pieceSize;
+    std::vector<std::optional<T>> sums(pieces);
+    auto reducePiece = [&](size_t pb, size_t pe){
+        for(size_t k = pb; k < pe; k++){
+            InIt it = first + k * pieceSize;
+            InIt end = first + std::min(n, (k + 1) * pieceSize);
+            T acc = *it;
+            for(++it; it != end; ++it){
+                acc = op(std::move(acc), *it);
+            }
+            sums[k].emplace(std::move(acc));
+        }
+    };
+    auto scanPiece = [&](size_t pb, size_t pe){
+        for(size_t k = pb; k < pe; k++){
+            size_t b = k * pieceSize;
+            size_t e = std::min(n, b + pieceSize);
+            if(k == 0){
+                std::partial_sum(first, first + e, out, op);
+                continue;
+            }
+            T acc = *sums[k - 1];
+            for(size_t i = b; i < e; i++){
+                acc = op(std::move(acc), first[i]);
+                out[i] = acc;
+            }
+        }
+    };
+    ForkJoin::enter(pool, [&](){
+        //最后一块的和用不到
+        parallel_detail::forRange(pool, 0, pieces - 1, 1, ForkJoin::eagerDepth(pool), reducePiece);
+        for(size_t k = 1; k + 1 < pieces; k++){
+            sums[k].emplace(op(*sums[k - 1], std::move(*sums[k])));
+        }
+        parallel_detail::forRange(pool, 0, pieces, 1, ForkJoin::eagerDepth(pool), scanPiece);
+    });
+    return out + n;
+}
+
+//并行排序：并行归并排序，叶子用std::sort，合并也是并行的，不保证相等元素的顺序（和std::sort一样）
+//需要和区间同样大小的临时空间，元素类型需要可以默认构造和移动赋值
+template<typename It, typename Comp = std::less<>>
+void parallelSort(ThreadPool& pool, It first, It last, Comp comp = Comp(), size_t grain = 0){
+    using T = typename std::iterator_traits<It>::value_type;
+    size_t n = last - first;
+    if(n < 2)
+        return;
+    if(grain == 0)
+        grain = std::max<size_t>(ForkJoin::defaultGrain(pool, n), 4096);
+    if(n <= grain){
+        std::sort(first, last, comp);
+        return;
+    }
+    std::unique_ptr<T[]> buf(new T[n]);
+    ForkJoin::enter(pool, [&](){
+        parallel_detail::sortRange(pool, first, buf.get(), n, false, grain, ForkJoin::eagerDepth(pool), comp);
+    });
+}
+
+} //namespace v2
+
+#endif /* parallel_hpp */
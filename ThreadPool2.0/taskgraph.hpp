@@ -0,0 +1,241 @@
+//
+//  taskgraph.hpp
+//  ThreadPool2.0
+//
+//  任务图（DAG）：节点和依赖只声明一次，之后可以反复在线程池上运行
+//  节点的所有前驱完成时，节点直接放入当前线程的任务队列，不需要有线程阻塞在future上等待上一阶段
+//
+
+#ifndef taskgraph_hpp
+#define taskgraph_hpp
+
+#include "threadpool.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+inline namespace v2{
+
+//用法：
+//  TaskGraph graph;
+//  auto a = graph.addNode(load);
+//  auto b = graph.addNode(parse);
+//  graph.addEdge(a, b);//b在a完成以后执行
+//  graph.run(pool);
+//  graph.wait();
+//第一次运行时把图整理成紧凑的数组并检查有没有环，之后每次运行只重置计数器，不分配内存
+//同一个图同一时间只能运行一次，运行中不能修改
+class TaskGraph{
+public:
+    using NodeId = size_t;
+
+    TaskGraph():pool_(nullptr),remaining_(0),running_(false),hasError_(false),done_(true),dirty_(true){}
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+    //析构前需要等待运行结束
+    ~TaskGraph(){
+        if(running_)
+            wait(std::nothrow);
+    }
+
+    //添加一个节点，返回节点编号，func每次运行图时执行一次
+    NodeId addNode(std::function<void()> func){
+        checkIdle();
+        nodes_.push_back(Node{std::move(func), {}});
+        dirty_ = true;
+        return nodes_.size() - 1;
+    }
+
+    //to依赖from：from完成以后to才能开始
+    void addEdge(NodeId from, NodeId to){
+        checkIdle();
+        if(from >= nodes_.size() || to >= nodes_.size())
+            throw std::out_of_range("task graph node does not exist");
+        nodes_[from].successors.push_back(to);
+        dirty_ = true;
+    }
+
+    size_t size() const{
+        return nodes_.size();
+    }
+
+    //在线程池上运行整个图，不阻塞，用wait等待结束
+    //没有前驱的节点放入线程池，其他节点在最后一个前驱完成时放入完成它的线程的任务队列
+    //图里有环时抛出std::invalid_argument
+    void run(ThreadPool& pool){
+        checkIdle();
+        prepare();
+        pool_ = &pool;
+        error_ = nullptr;
+        hasError_.store(false, std::memory_order_relaxed);
+        for(size_t i = 0; i < nodes_.size(); i++){
+            counters_[i].store(predecessors_[i], std::memory_order_relaxed);
+        }
+        if(nodes_.empty()){
+            return;
+        }
+        done_ = false;
+        running_ = true;
+        remaining_.store(nodes_.size(), std::memory_order_release);
+        for(NodeId root : roots_){
+            pool.postContinuation(GraphTask{this, root});
+        }
+    }
+
+    //等待这次运行结束，有节点抛出异常时重新抛出第一个异常
+    //一个节点抛出异常以后，还没有开始的节点不再执行
+    void wait(){
+        wait(std::nothrow);
+        if(error_)
+            std::rethrow_exception(error_);
+    }
+
+    void runAndWait(ThreadPool& pool){
+        run(pool);
+        wait();
+    }
+
+private:
+    struct Node{
+        std::function<void()> func;
+        std::vector<NodeId> successors;
+    };
+
+    //线程池里的一个任务只保存图和节点编号，可以放在TaskFunc的内部缓冲区里
+    struct GraphTask{
+        TaskGraph* graph;
+        NodeId node;
+        void operator()(){
+            graph->execute(node);
+        }
+        //线程池ABORT关闭或者过载时被丢弃，这个节点和依赖它的节点都不再执行
+        void abandon(std::exception_ptr error){
+            graph->setError(error);
+            graph->execute(node);
+        }
+    };
+
+    //在线程池的线程里等待时执行其他任务，不睡眠
+    void wait(std::nothrow_t){
+        if(pool_ != nullptr)
+            pool_->helpUntil([this]()->bool {return remaining_.load(std::memory_order_acquire) == 0;});
+        std::unique_lock<std::mutex> lock(mtx_);
+        cond_.wait(lock, [&]()->bool {return done_;});
+        running_ = false;
+    }
+
+    void checkIdle() const{
+        if(running_)
+            throw std::logic_error("task graph is running");
+    }
+
+    //把邻接表整理成连续数组，统计前驱数量，用Kahn算法检查环
+    void prepare(){
+        if(!dirty_)
+            return;
+        size_t n = nodes_.size();
+        predecessors_.assign(n, 0);
+        successorBegin_.assign(n + 1, 0);
+        successors_.clear();
+        roots_.clear();
+        for(size_t i = 0; i < n; i++){
+            successorBegin_[i] = successors_.size();
+            for(NodeId to : nodes_[i].successors){
+                successors_.push_back(to);
+                predecessors_[to]++;
+            }
+        }
+        successorBegin_[n] = successors_.size();
+        std::vector<int> indegree = predecessors_;
+        std::vector<NodeId> order;
+        for(size_t i = 0; i < n; i++){
+            if(indegree[i] == 0){
+                roots_.push_back(i);
+                order.push_back(i);
+            }
+        }
+        for(size_t k = 0; k < order.size(); k++){
+            for(size_t j = successorBegin_[order[k]]; j < successorBegin_[order[k] + 1]; j++){
+                if(--indegree[successors_[j]] == 0)
+                    order.push_back(successors_[j]);
+            }
+        }
+        if(order.size() != n)
+            throw std::invalid_argument("task graph has a cycle");
+        counters_ = std::vector<std::atomic_int>(n);
+        dirty_ = false;
+    }
+
+    //执行一个节点，然后把计数器减到0的后继节点放入线程池
+    //最后一个就绪的后继节点不入队，直接在当前线程继续执行，链式的依赖不经过任务队列
+    void execute(NodeId node){
+        const NodeId none = nodes_.size();
+        for(;;){
+            if(!hasError_.load(std::memory_order_acquire)){
+                try{
+                    nodes_[node].func();
+                }
+                catch(...){
+                    setError(std::current_exception());
+                }
+            }
+            NodeId next = none;
+            for(size_t j = successorBegin_[node]; j < successorBegin_[node + 1]; j++){
+                NodeId succ = successors_[j];
+                if(counters_[succ].fetch_sub(1, std::memory_order_acq_rel) != 1)
+                    continue;
+                if(next != none)
+                    pool_->postContinuation(GraphTask{this, next});
+                next = succ;
+            }
+            //最后一个节点完成以后不能再访问图的成员，等待方可能已经返回并销毁了它
+            if(finish() || next == none)
+                return;
+            node = next;
+        }
+    }
+
+    //一个节点完成，返回true表示整个图都完成了
+    bool finish(){
+        if(remaining_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return false;
+        std::unique_lock<std::mutex> lock(mtx_);
+        done_ = true;
+        cond_.notify_all();
+        return true;
+    }
+
+    //只保留第一个异常
+    void setError(std::exception_ptr error){
+        if(!hasError_.exchange(true, std::memory_order_acq_rel))
+            error_ = error;
+    }
+
+private:
+    std::vector<Node> nodes_;
+    //prepare整理出来的只读结构，运行时只读
+    std::vector<int> predecessors_;//每个节点的前驱数量
+    std::vector<size_t> successorBegin_;//节点i的后继是successors_[successorBegin_[i], successorBegin_[i + 1])
+    std::vector<NodeId> successors_;
+    std::vector<NodeId> roots_;//没有前驱的节点
+    std::vector<std::atomic_int> counters_;//每个节点还没有完成的前驱数量，每次运行重置
+
+    ThreadPool* pool_;//正在运行的线程池
+    std::atomic<size_t> remaining_;//这次运行还没有完成的节点数量
+    bool running_;//run以后还没有wait，只由调用run/wait的线程访问
+    std::atomic_bool hasError_;
+    std::exception_ptr error_;
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    bool done_;//由mtx_保护
+    bool dirty_;//添加了节点或者边，下次运行前需要重新整理
+};
+
+} //namespace v2
+
+#endif /* taskgraph_hpp */
@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <vector>
 #include <queue>
+#include <deque>
 #include <memory>//智能指针
 #include <atomic>//atomic_int
 #include <mutex>
@@ -18,11 +19,45 @@
 #include <functional>
 #include <thread>
 #include <unordered_map>
+#include <iostream>
 #include <future>
+#include <random>
+#include <tuple>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+#include <optional>
+#include "wsdeque.hpp"
+#include "mpmcqueue.hpp"
+#include "shardedqueue.hpp"
+#include "taskfunc.hpp"
+#include "eventcount.hpp"
+#include "priorityqueue.hpp"
+#include "poolstats.hpp"
+#include "topology.hpp"
+#include "slaballoc.hpp"
+#include "cancellation.hpp"
+#include "timerwheel.hpp"
+#include "overload.hpp"
+#include "executor.hpp"
+#include "mpscqueue.hpp"
+#include "groupscheduler.hpp"
+#include "elastic.hpp"
+
+//2.0的所有类型放在内联命名空间v2里：用户代码不需要改，
+//和v1的同名类型（ThreadPool、Thread、PoolMode...）链接进同一个程序时不会冲突
+inline namespace v2{
 
 const int TASK_MAX_THRESHHOLD = 2;
 const int THREAD_MAX_THRESHHOLD = 10;
 const int THREAD_MAX_IDLE_TIME = 10;//单位：秒
+const int THREAD_SPIN_COUNT = 128;//空闲线程睡眠前自旋检查任务的次数
+const int THREAD_YIELD_COUNT = 8;//自旋之后让出CPU再检查任务的次数
+const int PRIORITY_AGING_TIME = 20;//低一级的任务多等待这么久相当于提升一级，单位：毫秒
+const int TIMER_TICK_TIME = 1;//定时任务时间轮的精度，单位：毫秒
+const int STRAND_BATCH_SIZE = 16;//strand的执行任务一次最多连续执行的任务数量，之后重新排队
+const int KEYED_STRAND_SIZE = 256;//submitKeyed的key哈希到的strand数量
+const int HELP_WAIT_TIME = 10;//helpUntil一次最多睡眠的时间，兜底在线程池之外完成的等待条件，单位：毫秒
 
 //线程池支持的模式
 enum class PoolMode{
@@ -30,6 +65,45 @@ enum class PoolMode{
     MODE_CACHED, //线程数量可动态增长
 };
 
+//任务的优先级
+enum class TaskPriority{
+    PRIORITY_HIGH, //交互式、对延迟敏感的任务
+    PRIORITY_NORMAL, //默认优先级，不指定优先级的submitTask都是这一级
+    PRIORITY_LOW, //批处理任务
+};
+
+//线程绑定cpu的参数：线程按L3缓存/物理核的拓扑顺序绑定，同一个缓存域的cpu先用满
+struct AffinityConfig{
+    std::vector<int> cpus;//允许使用的cpu编号，为空表示所有在线的cpu
+    bool useSmt = true;//是否使用超线程，false时每个物理核只放一个线程
+    std::string sysfsRoot = CpuTopology::SYSFS_ROOT;//读取拓扑的目录
+};
+
+//任务队列的实现方式
+enum class QueueMode{
+    MODE_MUTEX, //std::deque + 互斥锁，默认方式
+    MODE_LOCKFREE, //有界无锁环形队列，容量为taskQueMaxThreshHold_
+    MODE_SHARDED, //多个各自加锁的子队列，总容量为taskQueMaxThreshHold_，适合很多线程同时提交任务
+};
+
+//设置了截止时间（或者最长排队时间）的任务在开始执行前已经超时，任务不再执行，future.get()抛出这个异常
+class TaskExpiredError : public TaskCancelledError{
+public:
+    TaskExpiredError():TaskCancelledError("task deadline expired"){}
+};
+
+//线程池ABORT方式关闭时，还没有开始执行的任务被丢弃，future.get()抛出这个异常
+class PoolShutdownError : public std::runtime_error{
+public:
+    PoolShutdownError():std::runtime_error("thread pool shut down, task discarded"){}
+};
+
+//线程池关闭的方式
+enum class ShutdownMode{
+    SHUTDOWN_DRAIN, //执行完已经提交的任务再退出
+    SHUTDOWN_ABORT, //丢弃还没有开始执行的任务，正在执行的任务执行完就退出
+};
+
 //线程类型
 class Thread{
 public:
@@ -38,46 +112,434 @@ public:
     //线程构造
     Thread(ThreadFunc func):func_(func),threadId_(generateId_++)
     {}
-    //线程析构
-    ~Thread() = default;
+    //线程析构，线程还没有被join时在这里join，线程不能join自己，这时只能分离
+    ~Thread(){
+        if(thread_.joinable()){
+            if(thread_.get_id() == std::this_thread::get_id())
+                thread_.detach();
+            else
+                thread_.join();
+        }
+    }
     //启动线程
     void start(){
-        //创建一个线程来执行一个线程函数
-        std::thread t(func_, threadId_);//C++11来说 线程对象t 和 线程函数func_
-        t.detach();//设置分离线程，线程对象和线程函数不相关
+        //创建一个线程来执行一个线程函数，线程池退出或者回收线程时join，保证线程函数已经返回
+        thread_ = std::thread(func_, threadId_);
+    }
+    //等待线程函数返回
+    void join(){
+        if(thread_.joinable())
+            thread_.join();
     }
     int getId() const{
         return threadId_;
     }
 private:
     ThreadFunc func_;
-    static int generateId_;
+    static inline int generateId_ = 0;//头文件可能被多个源文件包含，用inline变量避免重复定义
     int threadId_; //保存线程id
+    std::thread thread_;
+};
+
+//提交到线程池的任务：执行任务函数，把返回值或者异常交给promise
+//代替原来的shared_ptr<packaged_task> + std::bind，整个对象可以放进TaskFunc的内部缓冲区
+template<typename RType, typename Func, typename ArgsTuple>
+struct PromiseTask{
+    std::promise<RType> promise;
+    Func func;
+    ArgsTuple args;
+    void operator()(){
+        try{
+            if constexpr(std::is_void<RType>::value){
+                std::apply(func, args);
+                promise.set_value();
+            }
+            else{
+                promise.set_value(std::apply(func, args));
+            }
+        }
+        catch(...){
+            promise.set_exception(std::current_exception());
+        }
+    }
+    //没有执行，直接让future完成为异常
+    void fail(std::exception_ptr error){
+        promise.set_exception(error);
+    }
+    //没有执行就被丢弃
+    void abandon(std::exception_ptr error){
+        fail(error);
+    }
+};
+
+//带截止时间或者取消标志的任务：开始执行时已经被取消或者超过截止时间就不执行，
+//直接让future完成为TaskCancelledError或者TaskExpiredError
+template<typename PTask>
+struct DeadlineTask{
+    PTask task;
+    std::chrono::steady_clock::time_point deadline;
+    CancellationToken token;
+    void operator()(){
+        if(token.cancelled()){
+            task.fail(std::make_exception_ptr(TaskCancelledError()));
+            return;
+        }
+        if(deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() > deadline){
+            task.fail(std::make_exception_ptr(TaskExpiredError()));
+            return;
+        }
+        task();
+    }
+    void abandon(std::exception_ptr error){
+        task.abandon(error);
+    }
+};
+
+//一批任务共享的完成状态，只在最后一个任务完成时加锁通知等待方
+class BulkState{
+public:
+    explicit BulkState(size_t count):remaining_(count),hasError_(false),done_(count == 0){}
+    virtual ~BulkState() = default;
+
+    //n个任务执行完（或者提交失败）
+    void finish(size_t n){
+        if(n == 0)
+            return;
+        if(remaining_.fetch_sub(n, std::memory_order_acq_rel) == n){
+            //最后一个任务负责释放线程池这一侧持有的引用，释放之后不能再访问成员
+            std::shared_ptr<BulkState> self = std::move(self_);
+            std::unique_lock<std::mutex> lock(mtx_);
+            done_ = true;
+            cond_.notify_all();
+        }
+    }
+    //只保留第一个异常
+    void setError(std::exception_ptr error){
+        if(!hasError_.exchange(true)){
+            error_ = error;
+        }
+    }
+    void wait(){
+        std::unique_lock<std::mutex> lock(mtx_);
+        cond_.wait(lock, [&]()->bool {return done_;});
+    }
+    template<typename Rep, typename Period>
+    bool waitFor(const std::chrono::duration<Rep, Period>& timeout){
+        std::unique_lock<std::mutex> lock(mtx_);
+        return cond_.wait_for(lock, timeout, [&]()->bool {return done_;});
+    }
+    bool ready() const{
+        return remaining_.load(std::memory_order_acquire) == 0;
+    }
+    std::exception_ptr error() const{
+        return error_;
+    }
+    void keepAlive(std::shared_ptr<BulkState> self){
+        self_ = std::move(self);
+    }
+private:
+    std::atomic<size_t> remaining_;
+    std::atomic_bool hasError_;
+    std::exception_ptr error_;
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    bool done_;
+    std::shared_ptr<BulkState> self_;//任务全部完成前保证状态不被释放
+};
+
+//批量任务的用户函数和状态放在一起，每个任务只需要保存一个指针和下标
+template<typename Func>
+class BulkStateWithFunc : public BulkState{
+public:
+    BulkStateWithFunc(size_t count, Func&& func):BulkState(count),func_(std::move(func)){}
+    template<typename... Args>
+    void run(Args... args){
+        try{
+            func_(args...);
+        }
+        catch(...){
+            setError(std::current_exception());
+        }
+        finish(1);
+    }
+private:
+    Func func_;
+};
+
+//批量任务里的一个任务：执行state->run(args...)，没有执行就被丢弃时也要计入完成数量
+template<typename State, typename... Args>
+struct BulkTask{
+    State* state;
+    std::tuple<Args...> args;
+    void operator()(){
+        std::apply([this](Args... a){state->run(a...);}, args);
+    }
+    void abandon(std::exception_ptr error){
+        state->setError(error);
+        state->finish(1);
+    }
+};
+
+class ThreadPool;
+
+//线程池的存活标志，PoolFuture、BulkFuture可能比线程池活得久，通过它访问线程池
+//线程池析构时detach：之后acquire返回nullptr，后续任务直接在设置结果的线程里执行；
+//detach会等待已经acquire的线程release，所以acquire和release之间线程池不会被析构
+class PoolAnchor{
+public:
+    explicit PoolAnchor(ThreadPool* pool):pool_(pool),users_(0),helpWaiters_(0){}
+    PoolAnchor(const PoolAnchor&) = delete;
+    PoolAnchor& operator=(const PoolAnchor&) = delete;
+
+    //线程池还在返回它的指针，用完必须release；线程池已经析构返回nullptr，不需要release
+    ThreadPool* acquire(){
+        users_.fetch_add(1, std::memory_order_seq_cst);
+        ThreadPool* pool = pool_.load(std::memory_order_seq_cst);
+        if(pool == nullptr)
+            users_.fetch_sub(1, std::memory_order_release);
+        return pool;
+    }
+    void release(){
+        users_.fetch_sub(1, std::memory_order_release);
+    }
+    //线程池还在时调用它的helpUntil，当前线程不是这个线程池的线程或者线程池已经析构返回false
+    template<typename Pred>
+    bool helpUntil(Pred done);
+    //helpUntil里睡眠的线程数量，有这样的线程时任务执行完、PoolFuture完成才需要唤醒
+    std::atomic_int& helpWaiters(){
+        return helpWaiters_;
+    }
+    //在线程池之外完成的PoolFuture（例如取消定时任务）唤醒helpUntil里睡眠的线程
+    void wakeHelpers();
+    //线程池析构时调用，之后不再有线程访问这个线程池
+    void detach(){
+        pool_.store(nullptr, std::memory_order_seq_cst);
+        while(users_.load(std::memory_order_seq_cst) > 0){
+            std::this_thread::yield();
+        }
+    }
+private:
+    std::atomic<ThreadPool*> pool_;
+    std::atomic_int users_;//正在使用pool_的线程数量
+    std::atomic_int helpWaiters_;
+};
+
+//submitBulk/parallelFor返回的聚合完成句柄，代替N个future
+class BulkFuture{
+public:
+    BulkFuture() = default;
+    BulkFuture(std::shared_ptr<BulkState> state, std::shared_ptr<PoolAnchor> anchor):state_(std::move(state)),anchor_(std::move(anchor)){}
+    bool valid() const{
+        return state_ != nullptr;
+    }
+    //所有任务是否都已经执行完
+    bool ready() const{
+        return state_->ready();
+    }
+    //等待所有任务执行完，在线程池的线程里调用时不睡眠，先执行其他任务
+    void wait() const;
+    template<typename Rep, typename Period>
+    bool waitFor(const std::chrono::duration<Rep, Period>& timeout) const{
+        return state_->waitFor(timeout);
+    }
+    //等待所有任务执行完，有任务抛出异常（或者提交失败）时重新抛出第一个异常
+    void get() const{
+        wait();
+        if(state_->error()){
+            std::rethrow_exception(state_->error());
+        }
+    }
+private:
+    std::shared_ptr<BulkState> state_;
+    std::shared_ptr<PoolAnchor> anchor_;
+};
+
+template<typename T>
+class FutureState;
+template<typename T>
+class PoolFuture;
+template<typename T>
+class ScheduledFuture;
+
+//时间轮上的一个定时任务，除了原子变量都由线程池的timerMtx_保护
+struct TimerEntry : TimerWheelNode{
+    TaskFunc task;//一次性的任务，到期时放入任务队列
+    std::function<void()> periodic;//周期任务，每次到期执行一次
+    uint64_t period = 0;//周期，单位tick，0表示一次性的任务
+    std::atomic_bool running{false};//周期任务上一次还没有执行完，到期时跳过这一次
+    std::atomic<ThreadPool*> pool{nullptr};//在时间轮上时指向线程池，取消时使用
+    std::shared_ptr<TimerEntry> self;//在时间轮上时保证不被释放
+};
+
+//周期任务每次到期放入任务队列的任务
+struct PeriodicTask{
+    std::shared_ptr<TimerEntry> entry;
+    void operator()(){
+        try{
+            entry->periodic();
+        }
+        catch(...){
+            //周期任务没有future，异常只能丢弃，下一个周期照常执行
+        }
+        entry->running.store(false, std::memory_order_release);
+    }
+    void abandon(std::exception_ptr){
+        entry->running.store(false, std::memory_order_release);
+    }
+};
+
+//submitAfter/submitAt/submitEvery返回的定时任务句柄，可以拷贝
+class TimerHandle{
+public:
+    TimerHandle() = default;
+    explicit TimerHandle(std::shared_ptr<TimerEntry> entry):entry_(std::move(entry)){}
+    bool valid() const{
+        return entry_ != nullptr;
+    }
+    //还在时间轮上等待（没有到期、没有取消、线程池没有关闭）
+    bool pending() const{
+        return entry_ != nullptr && entry_->pool.load(std::memory_order_acquire) != nullptr;
+    }
+    //把还没有到期的任务从时间轮上摘下，O(1)，成功返回true；周期任务以后都不再执行，
+    //已经放入任务队列的那一次仍然会执行。已经到期、已经取消或者线程池已经关闭时返回false
+    bool cancel() const;
+private:
+    std::shared_ptr<TimerEntry> entry_;
 };
-int Thread::generateId_ = 0;
+//strand（串行执行器）的状态：任务放在无锁的多生产者单消费者队列里，pending是还没有执行完的任务数量
+//提交任务时pending从0变成1的线程负责把一个StrandRunner放入线程池，pending回到0之前同一时刻只有这一个StrandRunner
+//空闲的strand不占用线程池的任何资源
+struct StrandState{
+    MpscQueue<TaskFunc> tasks;
+    std::atomic<size_t> pending{0};
+
+    //pending大于0时任务一定已经或者马上就会放入队列，生产者还没链接完时稍等
+    void pop(TaskFunc& task){
+        while(!tasks.tryPop(task)){
+            cpuRelax();
+        }
+    }
+};
+
+//线程池里代表一个strand的任务：按FIFO依次执行最多STRAND_BATCH_SIZE个任务，还有任务就重新排队
+struct StrandRunner{
+    std::shared_ptr<StrandState> state;
+    ThreadPool* pool;
+    void operator()();
+    //没有执行就被丢弃时，strand里排队的任务也都不会执行，让它们的future完成为异常error
+    void abandon(std::exception_ptr error){
+        TaskFunc task;
+        do{
+            state->pop(task);
+            task.abandon(error);
+            task.reset();
+        }while(state->pending.fetch_sub(1, std::memory_order_acq_rel) != 1);
+    }
+};
+
+//pool.strand()返回的串行执行器，可以拷贝，拷贝指向同一个strand
+//提交到同一个strand的任务按提交顺序一个一个执行，可以在任意线程上执行，但是不会同时执行，任务里不需要再加锁
+//在strand的任务里等待同一个strand后面的任务会死锁
+class Strand{
+public:
+    Strand() = default;
+    bool valid() const{
+        return state_ != nullptr;
+    }
+    //提交到这个strand，返回值和异常和ThreadPool::submitTask相同
+    template<typename Func, typename... Args>
+    auto submitTask(Func&& func, Args&&... args) -> std::future<decltype(func(args...))>;
+    //还没有执行完的任务数量（包括正在执行的任务）
+    size_t pendingTaskSize() const{
+        return state_ != nullptr ? state_->pending.load(std::memory_order_acquire) : 0;
+    }
+private:
+    friend class ThreadPool;
+    Strand(ThreadPool* pool, std::shared_ptr<StrandState> state):pool_(pool),state_(std::move(state)){}
+
+    ThreadPool* pool_ = nullptr;
+    std::shared_ptr<StrandState> state_;
+};
+
+//任务组的执行令牌：线程取到令牌时才由GroupScheduler按权重选出要执行的组任务
+struct GroupToken{
+    ThreadPool* pool;
+    void operator()();
+    void abandon(std::exception_ptr error);
+};
+
+//pool.createGroup()返回的任务组句柄，可以拷贝；组和线程池同生命周期
+//组之间按权重公平地分享线程池的线程，一个组提交再多任务也不会让其他组饿死
+class TaskGroup{
+public:
+    TaskGroup() = default;
+    bool valid() const{
+        return group_ != nullptr;
+    }
+    //提交到这个组，返回值和异常和ThreadPool::submitTask相同
+    //线程池队列满时按过载策略处理，被拒绝的是这个组最新提交的任务
+    template<typename Func, typename... Args>
+    auto submitTask(Func&& func, Args&&... args) -> std::future<decltype(func(args...))>;
+    //这个组的队列长度、正在执行的任务数量、排队时间和执行时间
+    GroupStats stats() const;
+private:
+    friend class ThreadPool;
+    TaskGroup(ThreadPool* pool, GroupScheduler<TaskFunc>::Group* group):pool_(pool),group_(group){}
+
+    ThreadPool* pool_ = nullptr;
+    GroupScheduler<TaskFunc>::Group* group_ = nullptr;
+};
+
+//协程支持，定义在coroutine.hpp
+class ScheduleAwaiter;
+template<typename T>
+class CoTask;
+//任务图，定义在taskgraph.hpp
+class TaskGraph;
+//并行算法的fork-join，定义在parallel.hpp
+class ForkJoin;
 
 //线程池类型
 class ThreadPool{
+    //Task任务=》只能移动的函数对象，小对象不需要堆分配
+    using Task = TaskFunc;
 public:
     //线程池构造
     ThreadPool()
     :initThreadSize_(4)
-    ,taskSize_(0)
-    ,idleThreadSize_(0)
+    ,threadSizeThreshHold_(THREAD_MAX_THRESHHOLD)
     ,curThreadSize_(0)
+    ,idleThreadSize_(0)
+    ,taskSize_(0)
     ,taskQueMaxThreshHold_(TASK_MAX_THRESHHOLD)
-    ,threadSizeThreshHold_(THREAD_MAX_THRESHHOLD)
     ,poolMode_(PoolMode::MODE_FIXED)
     ,isPoolRunning_(false)
-    {}
+    ,isShutdown_(false)
+    ,isAborting_(false)
+    ,workStealing_(false)
+    ,idle_(THREAD_SPIN_COUNT, THREAD_YIELD_COUNT)
+    ,queueMode_(QueueMode::MODE_MUTEX)
+    ,queueShards_(0)
+    ,blockedSubmitSize_(0)
+    ,priorityQue_(std::make_unique<PriorityTaskQueue<Task>>(3, std::chrono::milliseconds(PRIORITY_AGING_TIME)))
+    ,priorityTaskSize_(0)
+    ,completedTaskSize_(0)
+    ,retireThreadSize_(0)
+    ,pinThreads_(false)
+    ,timerWakeTick_(0)
+    ,timerStop_(false)
+    ,keyedStrandSize_(KEYED_STRAND_SIZE)
+    ,keyedStrandsReady_(false)
+    ,anchor_(std::make_shared<PoolAnchor>(this))
+    {
+        taskQue_ = makeTaskQueue((int)initThreadSize_);
+    }
     
     ~ThreadPool(){
-        isPoolRunning_ = false;
-        //等待线程池里面所有线程返回  有两种状态 阻塞&正在执行任务中
-        //    notEmpty_.notify_all();
-        std::unique_lock<std::mutex> lock(taskQueMtx_);
-        notEmpty_.notify_all();
-        exitCond_.wait(lock,[&]()->bool{return threads_.size() == 0;});
+        //执行完已经提交的任务，等待线程池里面所有线程返回并join  有两种状态 阻塞&正在执行任务中
+        shutdown(ShutdownMode::SHUTDOWN_DRAIN);
+        //还没有完成的PoolFuture不再把后续任务交给这个线程池
+        anchor_->detach();
     }
 
     //设置线程池的工作模式
@@ -90,20 +552,103 @@ public:
     //设置初始的线程数量
     //void setInitThreadSize(int size);
 
-    //设置task任务队列上限阈值
+    //开启工作窃取模式：每个线程拥有自己的本地双端队列，
+    //线程内部提交的任务放入本地队列，空闲线程从其他线程的队列中窃取任务，
+    //全局任务队列只处理外部线程提交的任务
+    void setWorkStealing(bool enable){
+        if(checkRunningState())
+            return;
+        workStealing_ = enable;
+    }
+
+    //设置任务队列的实现方式，立即按新的模式重新创建任务队列，已经提交的任务搬到新队列里
+    void setQueueMode(QueueMode mode){
+        if(checkRunningState())
+            return;
+        queueMode_ = mode;
+        rebuildQueue((int)initThreadSize_);
+    }
+
+    //设置分片队列模式的分片数量，向上取整到2的幂；0表示按线程数量，start时按初始线程数量重新分片
+    void setQueueShards(int shards){
+        if(checkRunningState())
+            return;
+        queueShards_ = shards;
+        rebuildQueue((int)initThreadSize_);
+    }
+
+    //设置task任务队列上限阈值，已经提交的任务超过新的上限时，放不下的任务完成为TaskRejectedError
     void setTaskQueMaxThreshHold(int threshhold){
         if(checkRunningState())
             return;
         taskQueMaxThreshHold_ = threshhold;
+        rebuildQueue((int)initThreadSize_);
+    }
+
+    //设置任务队列满时的过载策略，blockTime是BLOCK策略下提交线程最多等待的时间
+    //只影响阻塞的提交接口（submitTask/submitAsync/submitBulk/parallelFor和定时任务到期入队），trySubmit总是立即返回
+    void setOverloadPolicy(OverloadPolicy policy, std::chrono::milliseconds blockTime = std::chrono::seconds(1)){
+        if(checkRunningState())
+            return;
+        overload_.setPolicy(policy, blockTime);
+    }
+
+    //设置过载回调：每个被拒绝、被丢弃、在提交线程执行的任务调用一次，在发生过载的线程上调用，不持有线程池的锁
+    void setOverloadHandler(std::function<void(OverloadEvent)> handler){
+        if(checkRunningState())
+            return;
+        overload_.setHandler(std::move(handler));
+    }
+
+    //设置空闲线程睡眠前的自旋策略：先自旋spinCount次，再让出CPU yieldCount次，都没有等到任务才睡眠
+    //自旋越久，新任务的响应延迟越低，空闲时占用的CPU越多；都设置为0表示没有任务立即睡眠
+    void setIdleSpin(int spinCount, int yieldCount){
+        if(checkRunningState())
+            return;
+        idle_.setSpin(spinCount, yieldCount);
+    }
+
+    //设置submitKeyed使用的strand数量：不同的key哈希到同一个strand时也会串行执行，数量越多误串行越少
+    //没有任务的strand不占用线程，只有一个队列头的内存；第一次submitKeyed时才创建，不用submitKeyed的线程池没有这部分内存
+    void setKeyedStrandSize(int size){
+        if(checkRunningState())
+            return;
+        std::lock_guard<std::mutex> lock(keyedStrandMtx_);
+        keyedStrandSize_ = std::max(size, 1);
+        keyedStrands_.clear();
+        keyedStrandsReady_.store(false, std::memory_order_relaxed);
+    }
+
+    //设置优先级老化的时间：低一级的任务多等待aging相当于提升一级
+    void setPriorityAging(std::chrono::milliseconds aging){
+        if(checkRunningState())
+            return;
+        priorityQue_->setAging(aging);
+    }
+
+    //设置cached模式弹性伸缩的参数
+    void setElasticConfig(const ElasticConfig& config){
+        if(checkRunningState())
+            return;
+        elasticConfig_ = config;
+    }
+
+    //开启线程绑定cpu，工作窃取模式下优先窃取共享L3缓存的线程的任务
+    //拓扑读取失败（或者不是Linux）时线程不绑定cpu
+    void setAffinity(const AffinityConfig& config){
+        if(checkRunningState())
+            return;
+        affinity_ = config;
+        pinThreads_ = true;
     }
 
-    //设置线程池cached模式下线程阈值
+    //设置线程数量上限阈值：cached模式下是弹性伸缩和resize的上限
+    //工作窃取模式下（fixed模式也一样）本地队列在start时按max(初始线程数量, 这个阈值, cpu核数)创建，
+    //窃取时要遍历所有队列，运行中不能扩充，所以它同时限制resize能达到的线程数量
     void setThreadSizeThreshHold(int threshhold){
         if(checkRunningState())
             return;
-        if(poolMode_ == PoolMode::MODE_CACHED){
-            threadSizeThreshHold_ = threshhold;
-        }
+        threadSizeThreshHold_ = threshhold;
     }
 
     //给线程池提交任务
@@ -114,164 +659,1827 @@ public:
         //打包任务，放入任务队列里
 //        using RType = decltype(func(args)...));
         using RType = decltype(func(std::forward<Args>(args)...));
-        auto task = std::make_shared<std::packaged_task<RType()>>(std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
-        std::future<RType> result = task->get_future();
-        //获取锁
-        std::unique_lock<std::mutex> lock(taskQueMtx_);
-        //用户提交任务，最长阻塞不能超过1s，否则判断提交任务失败返回
-        if(notFull_.wait_for(lock, std::chrono::seconds(1),[&]()->bool {return taskQue_.size() < (size_t)taskQueMaxThreshHold_;})==false){
-            // 表示notFull_等待1s后，条件依然没有满足
-            std::cerr << "task queue is full, submit task fail" << std::endl;
-            auto task = std::make_shared<std::packaged_task<RType()>>([]()->RType{return RType();});
-            (*task)();
-            return task->get_future();
-        }
-        //如果有空余，把任务放入任务队列中
-//        using Task = std::function<void()>;
-        taskQue_.emplace([task](){(*task)();});//执行下面的任务，(*task)解引用后就是个packaged_task
-        taskSize_++;
-        //因为新放了任务，任务队列肯定不空，在notEmpty_上通知分配线程执行任务
-        notEmpty_.notify_all();
-        
-        //cached 任务处理比较紧急 场景 小而快,需要根据任务数量和空闲线程数量判断是否需要创建新的线程出来
-        if(poolMode_ == PoolMode::MODE_CACHED && taskSize_ > idleThreadSize_ &&
-           curThreadSize_ < threadSizeThreshHold_){
-            std::cout << "create new thread" << std::endl;
-            
-            //创建新线程对象
-            auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc,this, std::placeholders::_1));
-            //创建thread线程对象的时候，把线程函数给到thread线程对象
-            int threadId = ptr->getId();
-            threads_.emplace(threadId, std::move(ptr));//unique_ptr不允许直接拷贝
-            threads_[threadId]->start();
-            //修改线程个数相关的变量
-            curThreadSize_++;
-            idleThreadSize_++;
+        auto task = makePromiseTask<RType>(std::forward<Func>(func), std::forward<Args>(args)...);
+        std::future<RType> result = task.promise.get_future();
+        //队列满时按过载策略处理，默认最长阻塞1s，提交失败时返回的future抛出TaskRejectedError
+        if(!pushTask(std::move(task), true)){
+            return failedFuture<RType>();
         }
         //返回任务的Result对象
     //    return task->getResult();
         return result;
     }
-    
-    //开启线程池
-    void start(int initThreadSize = std::thread::hardware_concurrency()){//hardware_concurrency本机cpu核数量
-        //设置线程池的运行状态
-        isPoolRunning_ = true;
-        //记录初始线程个数
-        initThreadSize_ = initThreadSize;
-        curThreadSize_ = initThreadSize;
-        //创建线程对象
-        for(int i = 0; i < initThreadSize; i++){
-            //创建thread线程对象的时候，把线程函数给到thread线程对象
-            auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc,this, std::placeholders::_1));
-            int threadId = ptr->getId();
-            threads_.emplace(threadId, std::move(ptr));//unique_ptr不允许直接拷贝
+
+    //按优先级提交任务：高优先级的任务先执行，同一优先级内截止时间早的任务先执行
+    //到deadline还没有开始执行的任务会被丢弃，返回的future抛出TaskExpiredError
+    //优先级任务放在单独的队列里，容量也是taskQueMaxThreshHold_，不会被普通任务占满
+    template<typename Func, typename... Args>
+    auto submitTask(TaskPriority priority, std::chrono::steady_clock::time_point deadline, Func&& func, Args&&... args)
+        -> std::future<decltype(func(args...))>{
+        using RType = decltype(func(std::forward<Args>(args)...));
+        auto task = makePromiseTask<RType>(std::forward<Func>(func), std::forward<Args>(args)...);
+        std::future<RType> result = task.promise.get_future();
+        bool pushed;
+        if(deadline == std::chrono::steady_clock::time_point::max()){
+            pushed = pushPriorityTask(std::move(task), priority, deadline, true);
         }
-        //启动所有线程，std::vector<Thread*> threads_
-        for(int i = 0; i < initThreadSize; i++){
-            threads_[i]->start();
-            idleThreadSize_++;//记录初始空闲线程的数量
+        else{
+            pushed = pushPriorityTask(DeadlineTask<decltype(task)>{std::move(task), deadline, CancellationToken()}, priority, deadline, true);
+        }
+        if(!pushed){
+            return failedFuture<RType>();
         }
+        return result;
     }
 
-    ThreadPool(const ThreadPool&) = delete;//=delete表示这个成员函数不能被再调用，const ThreadPool&为拷贝构造函数，即禁止拷贝线程池
-    ThreadPool& operator=(const ThreadPool&) = delete;//禁止重载赋值
+    //可以取消的任务：token被取消，或者在队列里等待超过maxQueueTime的任务，取出时直接丢弃不执行，
+    //返回的future抛出TaskCancelledError（排队超时是它的子类TaskExpiredError）
+    //取消一组任务只需要对同一个CancellationSource调用一次cancel()，正在执行的任务可以自己检查token
+    template<typename Func, typename... Args>
+    auto submitTask(CancellationToken token, std::chrono::steady_clock::duration maxQueueTime, Func&& func, Args&&... args)
+        -> std::future<decltype(func(args...))>{
+        using RType = decltype(func(std::forward<Args>(args)...));
+        auto task = makePromiseTask<RType>(std::forward<Func>(func), std::forward<Args>(args)...);
+        std::future<RType> result = task.promise.get_future();
+        if(!pushTask(DeadlineTask<decltype(task)>{std::move(task), deadlineAfter(maxQueueTime), std::move(token)}, true)){
+            return failedFuture<RType>();
+        }
+        return result;
+    }
 
-private:
-    //定义线程函数
-    void threadFunc(int threadid){
-        auto lastTime = std::chrono::high_resolution_clock().now();
-        //所有任务必须执行完成，线程池才可以回收所有线程资源
-        for(;;){ //在这个循环中，线程会一直等待并执行任务队列中的任务。
-            Task task;
-            {
-                //先获取锁
-                std::unique_lock<std::mutex> lock(taskQueMtx_);//锁默认出当前作用域才释放
-
-                std::cout << "tid:" << std::this_thread::get_id() << "尝试获取任务..." << std::endl;
-                //锁+双重判断
-                while(taskQue_.size() == 0){
-                    //线程池要结束，回收线程资源
-                    if(!isPoolRunning_){
-                        threads_.erase(threadid);
-                        std::cout << "tid:" << std::this_thread::get_id() << "exit!" << std::endl;
-                        exitCond_.notify_all();
-                        return;
-                    }
-                    //在cached模式下，有可能已经创建了很多线程，空闲时间超过60s，应该把多余的线程回收掉
-                    //结束回收掉（超过initThreadSize_数量的）
-                    //当前时间 - 上一次线程执行的时间>60s
-                    if(poolMode_ == PoolMode::MODE_CACHED){
-                        if(std::cv_status::timeout == notEmpty_.wait_for(lock, std::chrono::seconds(1))){
-                            auto now = std::chrono::high_resolution_clock().now();
-                            auto dur = std::chrono::duration_cast<std::chrono::seconds>(now - lastTime);
-                            if(dur.count() >= THREAD_MAX_IDLE_TIME && curThreadSize_ > initThreadSize_){
-                                //开始回收线程
-                                //记录线程数量的相关变量的值修改
-                                //把线程对象从线程列表容器中删除，没有办法threadFunc 《=》thread对象
-                                threads_.erase(threadid);
-                                curThreadSize_--;
-                                idleThreadSize_--;
-                                std::cout << "tid:" << std::this_thread::get_id() << "exit!" << std::endl;
-                                return;
-                            }
-                        }
-                    }
-                    else{
-                        notEmpty_.wait(lock);
-                    }
-                }
+    //可以取消、不限制排队时间的任务
+    template<typename Func, typename... Args>
+    auto submitTask(CancellationToken token, Func&& func, Args&&... args) -> std::future<decltype(func(args...))>{
+        return submitTask(std::move(token), std::chrono::steady_clock::duration::max(), std::forward<Func>(func), std::forward<Args>(args)...);
+    }
 
-                idleThreadSize_--;
-                std::cout << "tid:" << std::this_thread::get_id() << "获取任务成功..." << std::endl;
+    //按优先级提交没有截止时间的任务
+    template<typename Func, typename... Args>
+    auto submitTask(TaskPriority priority, Func&& func, Args&&... args) -> std::future<decltype(func(args...))>{
+        return submitTask(priority, std::chrono::steady_clock::time_point::max(), std::forward<Func>(func), std::forward<Args>(args)...);
+    }
 
-                //不空就从任务队列中取一个任务
-                task = taskQue_.front();
-                taskQue_.pop();
-                taskSize_--;
-                //如果依然有剩余任务，继续通知其他的线程执行任务
-                if(taskQue_.size() > 0){
-                    notEmpty_.notify_all();
-                }
-                //取出一个任务应该通知
-                notFull_.notify_all();
-            }//释放锁
-            //当前线程负责执行这个任务
-            if(task != nullptr){
-                //            task->run();//执行任务
-                task();//执行任务，把任务的返回值给到Result
-            }
-            idleThreadSize_++;
-            lastTime = std::chrono::high_resolution_clock().now();//更新线程执行完的时间
+    //非阻塞地提交任务，任务队列满时立即返回，返回的future.valid()为false
+    template<typename Func, typename... Args>
+    auto trySubmit(Func&& func, Args&&... args) -> std::future<decltype(func(args...))>{
+        using RType = decltype(func(std::forward<Args>(args)...));
+        auto task = makePromiseTask<RType>(std::forward<Func>(func), std::forward<Args>(args)...);
+        std::future<RType> result = task.promise.get_future();
+        if(!pushTask(std::move(task), false)){
+            return std::future<RType>();
+        }
+        return result;
+    }
+    
+    //提交任务，返回线程池感知的PoolFuture：可以用then挂后续任务，用whenAll/whenAny组合
+    //提交失败时返回的PoolFuture直接完成为异常
+    template<typename Func, typename... Args>
+    auto submitAsync(Func&& func, Args&&... args) -> PoolFuture<decltype(func(args...))>{
+        using RType = decltype(func(std::forward<Args>(args)...));
+        auto state = makeSlabShared<FutureState<RType>>(anchor_);
+        auto task = makeStateTask(state, std::forward<Func>(func), std::forward<Args>(args)...);
+        if(!pushTask(std::move(task), true)){
+            state->setError(submitError());
         }
+        return PoolFuture<RType>(std::move(state));
     }
 
-    bool checkRunningState() const{
-        return isPoolRunning_;
+    //可以取消的submitAsync，规则和可以取消的submitTask一样
+    template<typename Func, typename... Args>
+    auto submitAsync(CancellationToken token, std::chrono::steady_clock::duration maxQueueTime, Func&& func, Args&&... args)
+        -> PoolFuture<decltype(func(args...))>{
+        using RType = decltype(func(std::forward<Args>(args)...));
+        auto state = makeSlabShared<FutureState<RType>>(anchor_);
+        auto task = makeStateTask(state, std::forward<Func>(func), std::forward<Args>(args)...);
+        if(!pushTask(DeadlineTask<decltype(task)>{std::move(task), deadlineAfter(maxQueueTime), std::move(token)}, true)){
+            state->setError(submitError());
+        }
+        return PoolFuture<RType>(std::move(state));
     }
 
-private:
-    //    std::vector<std::unique_ptr<Thread>> threads_; //线程列表
-    std::unordered_map<int, std::unique_ptr<Thread>> threads_;
-    size_t initThreadSize_; //初始的线程数量
-    int threadSizeThreshHold_; //线程数量上限阈值
-    std::atomic_int curThreadSize_;//记录当前线程池里面的线程总数量
-    std::atomic_int idleThreadSize_;//记录空闲线程的数量
+    template<typename Func, typename... Args>
+    auto submitAsync(CancellationToken token, Func&& func, Args&&... args) -> PoolFuture<decltype(func(args...))>{
+        return submitAsync(std::move(token), std::chrono::steady_clock::duration::max(), std::forward<Func>(func), std::forward<Args>(args)...);
+    }
 
-    //Task任务=》函数对象
-    using Task = std::function<void()>;
-    std::queue<Task> taskQue_;//任务队列
-    std::atomic_int taskSize_;//任务数量，保证原子操作，保证线程安全
-    int taskQueMaxThreshHold_; //任务队列数量上限阈值
+    //定时任务：到when时放入任务队列，等待期间不占用线程池的线程，精度TIMER_TICK_TIME毫秒
+    //返回的ScheduledFuture和PoolFuture一样可以get/then，到期前可以cancel()，取消后get()抛出TaskCancelledError
+    //线程池关闭时还没有到期的任务不再执行，get()抛出PoolShutdownError
+    template<typename Func, typename... Args>
+    auto submitAt(std::chrono::steady_clock::time_point when, Func&& func, Args&&... args)
+        -> ScheduledFuture<decltype(func(args...))>{
+        using RType = decltype(func(std::forward<Args>(args)...));
+        auto state = makeSlabShared<FutureState<RType>>(anchor_);
+        auto entry = makeSlabShared<TimerEntry>();
+        entry->task = makeStateTask(state, std::forward<Func>(func), std::forward<Args>(args)...);
+        if(!scheduleTimer(entry, when)){
+            state->setError(submitError());
+        }
+        return ScheduledFuture<RType>(std::move(state), TimerHandle(std::move(entry)));
+    }
 
-    std::mutex taskQueMtx_; //保证任务队列的线程安全
+    //delay以后放入任务队列，代替在线程里sleep_for
+    template<typename Func, typename... Args>
+    auto submitAfter(std::chrono::steady_clock::duration delay, Func&& func, Args&&... args)
+        -> ScheduledFuture<decltype(func(args...))>{
+        return submitAt(deadlineAfter(delay), std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    //周期任务：每隔period执行一次func()，第一次在period以后；按固定频率对齐，不会累积误差
+    //上一次还没有执行完时跳过这一次，同一个周期任务不会同时在两个线程上执行；func抛出的异常被忽略
+    //用返回的TimerHandle取消，线程池关闭时自动停止；线程池已经关闭时返回的TimerHandle无效（valid()为false）
+    template<typename Func>
+    TimerHandle submitEvery(std::chrono::steady_clock::duration period, Func&& func){
+        auto entry = makeSlabShared<TimerEntry>();
+        entry->periodic = std::forward<Func>(func);
+        entry->period = std::max<uint64_t>(1, timerTicks(period));
+        if(!scheduleTimer(entry, deadlineAfter(period)))
+            return TimerHandle();
+        return TimerHandle(std::move(entry));
+    }
+
+    //创建一个strand：提交到它的任务按FIFO一个一个执行，不需要为共享状态加锁
+    Strand strand(){
+        return Strand(this, makeSlabShared<StrandState>());
+    }
+
+    //按key串行执行：同一个key的任务按提交顺序一个一个执行，不同key的任务可以在不同线程上并行
+    //key用std::hash哈希到setKeyedStrandSize个strand中的一个
+    template<typename Key, typename Func, typename... Args>
+    auto submitKeyed(const Key& key, Func&& func, Args&&... args) -> std::future<decltype(func(args...))>{
+        uint64_t h = (uint64_t)std::hash<Key>{}(key) * 0x9E3779B97F4A7C15ull;//整数的std::hash一般是它本身，打散一下
+        return submitStrandTask(keyedStrand((size_t)(h >> 32)), std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    //创建任务组：weight是组之间分享线程的权重，都有任务排队时每一轮每个组执行weight个任务（deficit round-robin）
+    //maxConcurrency限制这个组同时执行的任务数量，0表示不限制；不需要按组固定分配线程
+    //名字重复或者weight不大于0时抛出std::invalid_argument
+    TaskGroup createGroup(std::string name, int weight = 1, int maxConcurrency = 0){
+        return TaskGroup(this, groups_.addGroup(std::move(name), weight, maxConcurrency));
+    }
+
+    //所有任务组的统计，按创建顺序
+    std::vector<GroupStats> groupStats() const{
+        return groups_.stats();
+    }
+
+    //批量提交：对[begin, end)中的每个i执行func(i)，每个i是一个任务
+    //所有任务在一次加锁（无锁队列模式下一次原子预留）中入队，只唤醒需要的线程数量
+    template<typename Index, typename Func>
+    BulkFuture submitBulk(Index begin, Index end, Func&& func){
+        using State = BulkStateWithFunc<typename std::decay<Func>::type>;
+        size_t count = end > begin ? (size_t)(end - begin) : 0;
+        auto state = makeSlabShared<State>(count, typename std::decay<Func>::type(std::forward<Func>(func)));
+        State* ps = state.get();
+        submitBulkTasks(state, count, [ps, begin](size_t k)->Task{
+            Index i = begin + (Index)k;
+            return BulkTask<State, Index>{ps, std::make_tuple(i)};
+        });
+        return BulkFuture(std::move(state), anchor_);
+    }
+
+    //把[begin, end)按grain切成块，每块是一个任务，执行func(blockBegin, blockEnd)
+    //grain为0时按线程数量自动选择，每个线程大约分到4块
+    template<typename Index, typename Func>
+    BulkFuture parallelFor(Index begin, Index end, size_t grain, Func&& func){
+        using State = BulkStateWithFunc<typename std::decay<Func>::type>;
+        size_t total = end > begin ? (size_t)(end - begin) : 0;
+        if(grain == 0){
+            size_t parts = (size_t)std::max(1, (int)curThreadSize_) * 4;
+            grain = std::max<size_t>(1, (total + parts - 1) / parts);
+        }
+        size_t count = (total + grain - 1) / grain;
+        auto state = makeSlabShared<State>(count, typename std::decay<Func>::type(std::forward<Func>(func)));
+        State* ps = state.get();
+        submitBulkTasks(state, count, [ps, begin, end, grain](size_t k)->Task{
+            Index b = begin + (Index)(k * grain);
+            Index e = (size_t)(end - b) > grain ? b + (Index)grain : end;
+            return BulkTask<State, Index, Index>{ps, std::make_tuple(b, e)};
+        });
+        return BulkFuture(std::move(state), anchor_);
+    }
+
+    //帮助式等待：在这个线程池的线程里调用时，done()返回true之前执行本地队列、全局队列里的任务或者从其他线程窃取任务，
+    //没有任务可以执行时先自旋再让出CPU，最后在idle_上睡眠，线程池里的任务执行完或者PoolFuture完成时被唤醒重新检查done()
+    //在线程池之外变为true的done()（例如其他来源的std::future）最多晚HELP_WAIT_TIME被发现
+    //fixed模式下嵌套的fork-join不会因为所有线程都在等待子任务而死锁
+    //当前线程不是这个线程池的线程时直接返回false，调用方自己阻塞等待
+    //PoolFuture、BulkFuture和TaskGraph的等待已经使用它，std::future可以用join
+    template<typename Pred>
+    bool helpUntil(Pred done){
+        if(currentWorker().pool != this)
+            return false;
+        int queIndex = currentWorker().index;
+        int idle = 0;
+        auto take = currentWorker().take;
+        while(!done()){
+            Task task;
+            if((this->*take)(queIndex, task)){
+                runTask(task, true, poolMode_ == PoolMode::MODE_CACHED);
+                idle = 0;
+            }
+            else if(idle < idle_.spinCount() + idle_.yieldCount()){
+                if(idle < idle_.spinCount())
+                    cpuRelax();
+                else
+                    std::this_thread::yield();
+                idle++;
+            }
+            else{
+                //先登记再检查一遍done()和任务，和wakeHelpers配合，避免丢失唤醒
+                anchor_->helpWaiters().fetch_add(1, std::memory_order_seq_cst);
+                EventCount::Key key = idle_.prepareWait();
+                if(done() || (this->*take)(queIndex, task)){
+                    idle_.cancelWait();
+                }
+                else{
+                    idle_.sleep(key, std::chrono::milliseconds(HELP_WAIT_TIME));
+                }
+                anchor_->helpWaiters().fetch_sub(1, std::memory_order_relaxed);
+                if(task)
+                    runTask(task, true, poolMode_ == PoolMode::MODE_CACHED);
+                idle = 0;
+            }
+        }
+        return true;
+    }
+
+    //等待submitTask返回的future并取出结果，在线程池的线程里调用时执行其他任务而不是阻塞
+    template<typename T>
+    T join(std::future<T>& future){
+        helpUntil([&]()->bool {return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;});
+        return future.get();
+    }
+
+    //协程：co_await pool.schedule()把当前协程挂起，放到线程池的线程上恢复执行
+    //需要C++20并且包含coroutine.hpp
+    ScheduleAwaiter schedule();
+
+    //在线程池上启动协程任务，返回它结果的PoolFuture，需要C++20并且包含coroutine.hpp
+    template<typename T>
+    PoolFuture<T> spawn(CoTask<T> task);
+
+    //运行统计的快照：每个线程执行的任务数量、窃取/睡眠/唤醒次数，排队时间和执行时间的直方图
+    //需要编译时定义THREADPOOL_STATS=1，否则返回enabled为false的空快照，统计代码不会编译进线程池
+    PoolStats stats() const{
+        return stats_.snapshot();
+    }
+
+    //任务节点和返回值状态的分配器计数：命中/未命中本线程的空闲链表、跨线程释放、申请的slab数量
+    //分配器是进程内所有线程池共用的，编译时定义THREADPOOL_SLAB=0关闭时返回enabled为false的空快照
+    static SlabStats allocatorStats(){
+        return SlabHeap::stats();
+    }
+
+    //过载计数：被拒绝、被丢弃、在提交线程执行的任务数量，不受THREADPOOL_STATS影响
+    OverloadStats overloadStats() const{
+        return overload_.stats();
+    }
+
+    //关闭线程池：不再接收外部线程提交的任务，唤醒所有睡眠的线程，最多等待timeout让所有线程退出
+    //DRAIN执行完已经提交的任务（包括这些任务在线程池内部继续提交的任务）再退出
+    //ABORT丢弃还没有开始执行的任务，它们的future抛出PoolShutdownError；正在执行的任务不能被打断，执行完就退出
+    //睡眠的线程立即被唤醒，自旋的线程最多自旋spinCount+yieldCount次，所以ABORT的延迟只取决于正在执行的任务
+    //所有线程都已经退出并join时返回true；超时返回false，剩下的线程执行完手上的任务以后自己退出，析构函数会等待它们
+    //不能在线程池的线程里调用
+    bool shutdown(ShutdownMode mode, std::chrono::milliseconds timeout = std::chrono::milliseconds::max()){
+        if(mode == ShutdownMode::SHUTDOWN_ABORT)
+            isAborting_ = true;
+        bool first = !isShutdown_.exchange(true);
+        isPoolRunning_ = false;
+        //先停止控制线程，保证关闭过程中不会再创建新线程
+        if(first && monitor_.joinable()){
+            {
+                std::unique_lock<std::mutex> lock(monitorMtx_);
+                monitorCond_.notify_all();
+            }
+            monitor_.join();
+        }
+        //还没有到期的定时任务不会再放入任务队列
+        if(first)
+            stopTimers();
+        if(mode == ShutdownMode::SHUTDOWN_ABORT)
+            discardTasks();
+        idle_.notifyAll();
+        {
+            std::unique_lock<std::mutex> lock(taskQueMtx_);
+            //阻塞在队列满上的提交线程不用再等
+            notFull_.notify_all();
+            auto allExited = [&]()->bool{return threads_.size() == 0;};
+            if(timeout == std::chrono::milliseconds::max()){
+                exitCond_.wait(lock, allExited);
+            }
+            else if(!exitCond_.wait_for(lock, timeout, allExited)){
+                return false;
+            }
+        }
+        joinExitedThreads();
+        return true;
+    }
+
+    //运行中调整线程数量，不需要stop/start：增加时立即创建并启动新线程，
+    //减少时多出来的线程执行完手上的任务（工作窃取模式下还有本地队列里的任务）就退出，空闲的线程立即退出
+    //cached模式下threadSize同时是弹性伸缩的下限，不能超过线程数量上限
+    //工作窃取模式下不能超过start时创建的本地队列数量，即max(初始线程数量, 线程数量上限, cpu核数)
+    //返回调整以后的目标线程数量，线程池没有运行时返回-1
+    int resize(int threadSize){
+        if(!isPoolRunning_)
+            return -1;
+        threadSize = std::max(threadSize, 1);
+        if(workStealing_)
+            threadSize = std::min(threadSize, (int)workerQues_.size());
+        if(poolMode_ == PoolMode::MODE_CACHED)
+            threadSize = std::min(threadSize, threadSizeThreshHold_);
+        std::vector<Thread*> newThreads;
+        {
+            std::unique_lock<std::mutex> lock(taskQueMtx_);
+            //已经在等待退出的线程不算在内
+            int target = curThreadSize_ - retireThreadSize_;
+            if(threadSize < target){
+                retireThreadSize_ += target - threadSize;
+            }
+            else if(threadSize > target){
+                //先取消还没有执行的回收，再创建不够的线程
+                int cancel = std::min((int)retireThreadSize_, threadSize - target);
+                retireThreadSize_ -= cancel;
+                newThreads = createThreads(threadSize - target - cancel);
+            }
+            initThreadSize_ = threadSize;
+        }
+        for(Thread* t : newThreads){
+            t->start();
+        }
+        //唤醒睡眠的线程，让需要退出的线程退出
+        if(retireThreadSize_ > 0)
+            idle_.notifyAll();
+        joinExitedThreads();
+        return threadSize;
+    }
+
+    //开启线程池
+    void start(int initThreadSize = std::thread::hardware_concurrency()){//hardware_concurrency本机cpu核数量
+        //设置线程池的运行状态
+        isPoolRunning_ = true;
+        //记录初始线程个数
+        initThreadSize_ = initThreadSize;
+        curThreadSize_ = initThreadSize;
+        //分片数量按线程数量时，知道了初始线程数量再重新分片，start之前提交的任务搬到新队列里
+        if(queueMode_ == QueueMode::MODE_SHARDED && queueShards_ <= 0)
+            rebuildQueue(initThreadSize);
+        //工作窃取模式，按线程数量上限创建本地队列，线程退出后队列留给新线程复用
+        //窃取时要遍历所有队列，不能在运行中扩充，所以fixed模式也按上限创建，至少给resize留到cpu核数
+        if(workStealing_){
+            int queSize = std::max({initThreadSize, threadSizeThreshHold_, (int)std::thread::hardware_concurrency()});
+            for(int i = queSize - 1; i >= 0; i--){
+                workerQues_.emplace_back(std::make_unique<WorkStealingDeque<Task*>>());
+                freeQueIndex_.push_back(i);
+            }
+            queDomain_ = std::vector<std::atomic_int>(queSize);
+            for(auto& domain : queDomain_){
+                domain = -1;
+            }
+        }
+        //按拓扑排好线程绑定cpu的顺序
+        if(pinThreads_){
+            cpuOrder_ = CpuTopology::load(affinity_.sysfsRoot).placement(affinity_.cpus, affinity_.useSmt);
+            cpuLoad_.assign(cpuOrder_.size(), 0);
+        }
+        //创建线程对象
+        for(int i = 0; i < initThreadSize; i++){
+            //创建thread线程对象的时候，把线程函数给到thread线程对象
+            auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc,this, std::placeholders::_1));
+            int threadId = ptr->getId();
+            threads_.emplace(threadId, std::move(ptr));//unique_ptr不允许直接拷贝
+        }
+        //启动所有线程，std::vector<Thread*> threads_
+        //线程id是全局递增的，同一个进程里的第二个线程池不是从0开始，所以按threads_里实际的id启动
+        for(auto& thread : threads_){
+            thread.second->start();
+            idleThreadSize_++;//记录初始空闲线程的数量
+        }
+        //cached模式由控制线程负责扩容和缩容，提交任务的线程不再创建线程
+        if(poolMode_ == PoolMode::MODE_CACHED){
+            monitor_ = std::thread(&ThreadPool::monitorFunc, this);
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;//=delete表示这个成员函数不能被再调用，const ThreadPool&为拷贝构造函数，即禁止拷贝线程池
+    ThreadPool& operator=(const ThreadPool&) = delete;//禁止重载赋值
+
+private:
+    //打包任务：参数按值保存（和std::bind一样，std::ref传入的参数保存引用）
+    template<typename RType, typename Func, typename... Args>
+    static PromiseTask<RType, typename std::decay<Func>::type, decltype(std::make_tuple(std::declval<Args>()...))>
+    makePromiseTask(Func&& func, Args&&... args){
+        //promise的共享状态也从线程的缓存分配
+        return {std::promise<RType>(std::allocator_arg, SlabAllocator<char>()), std::forward<Func>(func), std::make_tuple(std::forward<Args>(args)...)};
+    }
+
+    template<typename RType, typename Func, typename... Args>
+    static auto makeStateTask(std::shared_ptr<FutureState<RType>> state, Func&& func, Args&&... args);
+
+    //从现在开始的一段时间换算成时间点（最长排队时间、定时任务的延迟），duration::max()表示不限制
+    static std::chrono::steady_clock::time_point deadlineAfter(std::chrono::steady_clock::duration duration){
+        auto now = std::chrono::steady_clock::now();
+        if(duration >= std::chrono::steady_clock::time_point::max() - now)
+            return std::chrono::steady_clock::time_point::max();
+        return now + duration;
+    }
+
+    //时间段换算成tick，向上取整
+    static uint64_t timerTicks(std::chrono::steady_clock::duration d){
+        const std::chrono::steady_clock::duration tick = std::chrono::milliseconds(TIMER_TICK_TIME);
+        if(d <= std::chrono::steady_clock::duration::zero())
+            return 0;
+        if(d >= std::chrono::steady_clock::duration::max() - tick)
+            return TimerWheel::NEVER - 1;
+        return (uint64_t)((d + tick - std::chrono::steady_clock::duration(1)) / tick);
+    }
+
+    //把定时任务放到时间轮上，第一次使用时启动定时线程；线程池已经关闭时返回false
+    //只获取timerMtx_，不获取taskQueMtx_；到期时间比定时线程睡眠的目标早时才唤醒它
+    bool scheduleTimer(const std::shared_ptr<TimerEntry>& entry, std::chrono::steady_clock::time_point when){
+        std::unique_lock<std::mutex> lock(timerMtx_);
+        if(timerStop_ || !acceptingTasks())
+            return false;
+        if(!timerThread_.joinable()){
+            timerStart_ = std::chrono::steady_clock::now();
+            timerThread_ = std::thread(&ThreadPool::timerFunc, this);
+        }
+        //已经过去的时间点在下一个tick到期
+        entry->expiry = std::max(timerTicks(when - timerStart_), timerWheel_.now() + 1);
+        timerWheel_.insert(entry.get());
+        entry->pool.store(this, std::memory_order_release);
+        entry->self = entry;
+        if(entry->expiry < timerWakeTick_)
+            timerCond_.notify_one();
+        return true;
+    }
+
+    //submitKeyed的hash对应的strand，第一次调用时创建setKeyedStrandSize个strand，之后不再加锁
+    const std::shared_ptr<StrandState>& keyedStrand(size_t hash){
+        if(!keyedStrandsReady_.load(std::memory_order_acquire)){
+            std::lock_guard<std::mutex> lock(keyedStrandMtx_);
+            if(keyedStrands_.empty()){
+                for(int i = 0; i < keyedStrandSize_; i++){
+                    keyedStrands_.push_back(makeSlabShared<StrandState>());
+                }
+            }
+            keyedStrandsReady_.store(true, std::memory_order_release);
+        }
+        return keyedStrands_[hash % keyedStrands_.size()];
+    }
+
+    //放入strand的队列，strand空闲时把它的执行任务放入线程池
+    template<typename Func, typename... Args>
+    auto submitStrandTask(const std::shared_ptr<StrandState>& state, Func&& func, Args&&... args)
+        -> std::future<decltype(func(args...))>{
+        using RType = decltype(func(std::forward<Args>(args)...));
+        if(!acceptingTasks())
+            return failedFuture<RType>();
+        auto task = makePromiseTask<RType>(std::forward<Func>(func), std::forward<Args>(args)...);
+        std::future<RType> result = task.promise.get_future();
+        state->tasks.push(Task(std::move(task)));
+        if(state->pending.fetch_add(1, std::memory_order_acq_rel) == 0){
+            //队列满按过载策略处理，被拒绝时strand里的任务都完成为提交失败的原因
+            Task runner = StrandRunner{state, this};
+            if(!pushTask(std::move(runner), true))
+                runner.abandon(submitError());
+        }
+        return result;
+    }
+
+    //放入组队列，按需要放入执行令牌
+    template<typename Func, typename... Args>
+    auto submitGroupTask(GroupScheduler<Task>::Group* group, Func&& func, Args&&... args)
+        -> std::future<decltype(func(args...))>{
+        using RType = decltype(func(std::forward<Args>(args)...));
+        if(!acceptingTasks())
+            return failedFuture<RType>();
+        auto task = makePromiseTask<RType>(std::forward<Func>(func), std::forward<Args>(args)...);
+        std::future<RType> result = task.promise.get_future();
+        size_t tokens = groups_.push(group, Task(std::move(task)));
+        //令牌按过载策略放入线程池，放不进去时拒绝这个组最新提交的任务，保证剩下的任务都有令牌
+        size_t failed = 0;
+        for(size_t i = 0; i < tokens; i++){
+            Task token = GroupToken{this};
+            if(!pushTask(std::move(token), true))
+                failed++;
+        }
+        if(failed > 0){
+            std::vector<Task> rejected;
+            groups_.reject(group, failed, rejected);
+            for(auto& t : rejected){
+                t.abandon(submitError());
+            }
+        }
+        return result;
+    }
+
+    //GroupToken：执行调度器选出的组任务，执行完按需要放入新的令牌（组的并发数降到上限以下）
+    //新令牌放不回线程池时由这个线程接着执行
+    void runGroupToken(){
+        size_t owned = 1;
+        Task task;
+        while(owned > 0){
+            owned--;
+            auto group = groups_.pop(task);
+            if(group == nullptr)
+                continue;
+            auto start = std::chrono::steady_clock::now();
+            task();
+            task.reset();
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+            size_t tokens = groups_.finish(group, (uint64_t)elapsed.count());
+            for(size_t i = 0; i < tokens; i++){
+                Task token = GroupToken{this};
+                if(!pushTask(std::move(token), false))
+                    owned++;
+            }
+            if(owned > 0 && isAborting_){
+                auto error = std::make_exception_ptr(PoolShutdownError());
+                for(; owned > 0; owned--){
+                    abandonGroupToken(error);
+                }
+            }
+        }
+    }
+
+    //令牌没有执行就被丢弃，调度器取出一个组任务让它的future完成为异常
+    void abandonGroupToken(std::exception_ptr error){
+        Task task;
+        if(groups_.drop(task))
+            task.abandon(error);
+    }
+
+    //StrandRunner：在线程池的线程上依次执行strand的任务，pending减到0时strand回到空闲
+    //执行了一批还有任务时重新排队，一个很忙的strand不会一直占着这个线程；放不回线程池时继续在这里执行
+    void runStrand(const std::shared_ptr<StrandState>& state){
+        Task task;
+        for(;;){
+            for(int i = 0; i < STRAND_BATCH_SIZE; i++){
+                state->pop(task);
+                task();
+                task.reset();
+                if(state->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    return;
+            }
+            Task runner = StrandRunner{state, this};
+            if(pushTask(std::move(runner), false))
+                return;
+            if(isAborting_){
+                runner.abandon(std::make_exception_ptr(PoolShutdownError()));
+                return;
+            }
+        }
+    }
+
+    //TimerHandle::cancel：还在时间轮上时摘下来
+    bool cancelTimer(TimerEntry& entry){
+        std::shared_ptr<TimerEntry> self;//在锁外释放
+        std::unique_lock<std::mutex> lock(timerMtx_);
+        if(!entry.linked)
+            return false;
+        timerWheel_.remove(&entry);
+        entry.pool.store(nullptr, std::memory_order_release);
+        self = std::move(entry.self);
+        return true;
+    }
+
+    //定时线程：推进时间轮，一个tick里到期的任务一次批量放入任务队列，没有定时任务时一直睡眠
+    void timerFunc(){
+        const std::chrono::steady_clock::duration tick = std::chrono::milliseconds(TIMER_TICK_TIME);
+        std::vector<Task> due;
+        std::vector<TimerEntry*> rearm;
+        std::vector<std::shared_ptr<TimerEntry>> fired;
+        std::unique_lock<std::mutex> lock(timerMtx_);
+        while(!timerStop_){
+            uint64_t now = (uint64_t)((std::chrono::steady_clock::now() - timerStart_) / tick);
+            timerWheel_.advance(now, [&](TimerWheelNode* node){
+                TimerEntry* entry = static_cast<TimerEntry*>(node);
+                if(entry->period == 0){
+                    due.push_back(std::move(entry->task));
+                    entry->pool.store(nullptr, std::memory_order_release);
+                    fired.push_back(std::move(entry->self));
+                    return;
+                }
+                if(!entry->running.exchange(true, std::memory_order_acq_rel))
+                    due.push_back(PeriodicTask{entry->self});
+                rearm.push_back(entry);
+            });
+            //周期任务按原来的节奏排下一次，错过的周期直接跳过
+            for(TimerEntry* entry : rearm){
+                entry->expiry += entry->period;
+                if(entry->expiry <= now)
+                    entry->expiry = now + entry->period - (now - entry->expiry) % entry->period;
+                timerWheel_.insert(entry);
+            }
+            rearm.clear();
+            if(!due.empty()){
+                lock.unlock();
+                size_t pushed = pushBulk(due.size(), [&](size_t k)->Task {return std::move(due[k]);});
+                //线程池正在关闭，或者任务队列满
+                for(size_t k = pushed; k < due.size(); k++){
+                    rejectTask(due[k]);
+                }
+                due.clear();
+                fired.clear();
+                lock.lock();
+                continue;
+            }
+            uint64_t next = timerWheel_.nextEvent();
+            timerWakeTick_ = next;
+            if(next == TimerWheel::NEVER)
+                timerCond_.wait(lock);
+            else
+                timerCond_.wait_until(lock, timerStart_ + tick * next);
+            //醒着的时候不需要唤醒，处理完以后会重新计算睡眠的目标
+            timerWakeTick_ = 0;
+        }
+    }
+
+    //停止定时线程，还在时间轮上的一次性任务完成为PoolShutdownError，周期任务不再执行
+    void stopTimers(){
+        {
+            std::unique_lock<std::mutex> lock(timerMtx_);
+            timerStop_ = true;
+            timerCond_.notify_all();
+        }
+        if(timerThread_.joinable())
+            timerThread_.join();
+        std::vector<std::shared_ptr<TimerEntry>> dropped;
+        {
+            std::unique_lock<std::mutex> lock(timerMtx_);
+            timerWheel_.clear([&](TimerWheelNode* node){
+                TimerEntry* entry = static_cast<TimerEntry*>(node);
+                entry->pool.store(nullptr, std::memory_order_release);
+                dropped.push_back(std::move(entry->self));
+            });
+        }
+        auto error = std::make_exception_ptr(PoolShutdownError());
+        for(auto& entry : dropped){
+            entry->task.abandon(error);
+        }
+    }
+
+    //提交失败的原因：线程池已经关闭，或者任务队列满
+    std::exception_ptr submitError() const{
+        if(isShutdown_)
+            return std::make_exception_ptr(PoolShutdownError());
+        return std::make_exception_ptr(TaskRejectedError());
+    }
+
+    //线程池关闭以后，只有DRAIN过程中线程池内部的任务还可以提交任务
+    bool acceptingTasks() const{
+        return !isShutdown_ || (!isAborting_ && currentWorker().pool == this);
+    }
+
+    //PoolFuture的后续任务放入线程池，放入失败或者线程池已经停止时直接在当前线程执行，保证后续任务一定会执行
+    void postContinuation(Task task){
+        if(!tryPostContinuation(task)){
+            task();
+            wakeHelpers();
+        }
+    }
+    //放入失败或者线程池已经停止时返回false，task保持不变，由调用方执行
+    bool tryPostContinuation(Task& task){
+        return isPoolRunning_ && pushTask(std::move(task), false);
+    }
+
+    //把任务放入任务队列，放入失败返回false，task保持不变
+    //队列满时block为false立即返回false；block为true时按过载策略处理：BLOCK最多等待设置的时间，
+    //DROP_OLDEST丢弃队列里最早的任务腾出位置，CALLER_RUNS在当前线程执行任务（返回true），被拒绝时报告EVENT_REJECTED
+    bool pushTask(Task&& task, bool block){
+        if(!acceptingTasks())
+            return false;
+        task.setEnqueueTime(steadyNanos());
+        //工作窃取模式下，线程池内部线程提交的任务直接放入自己的本地队列，不需要获取全局锁
+        //本地队列不受taskQueMaxThreshHold_限制，否则线程阻塞在自己的队列上会导致死锁
+        if(currentWorker().pool == this && currentWorker().index >= 0){
+            workerQues_[currentWorker().index]->push(slabNew<Task>(std::move(task)));
+            wakeSleepingThread();
+            return true;
+        }
+        if(tryPushTask(task))
+            return true;
+        if(!block)
+            return false;
+        switch(overload_.policy()){
+        case OverloadPolicy::OVERLOAD_BLOCK:
+            if(waitPushTask(task, overload_.blockTime()))
+                return true;
+            break;
+        case OverloadPolicy::OVERLOAD_CALLER_RUNS:
+            overload_.report(OverloadEvent::EVENT_CALLER_RUNS);
+            task();
+            return true;
+        case OverloadPolicy::OVERLOAD_DROP_OLDEST:
+            //其他提交线程可能抢先占用腾出的位置，丢弃成功就再试一次
+            while(dropOldestTasks(1) > 0){
+                if(tryPushTask(task))
+                    return true;
+            }
+            //队列里的任务刚好都被取走了
+            if(tryPushTask(task))
+                return true;
+            break;
+        case OverloadPolicy::OVERLOAD_FAIL_FAST:
+            break;
+        }
+        overload_.report(OverloadEvent::EVENT_REJECTED);
+        return false;
+    }
+
+    //不等待地把任务放入全局任务队列，队列满返回false，task保持不变
+    //容量检查由队列本身完成，不获取taskQueMtx_
+    bool tryPushTask(Task& task){
+        if(!taskQue_->tryPush(std::move(task)))
+            return false;
+        taskSize_++;
+        //因为新放了任务，任务队列肯定不空，需要的话唤醒一个空闲线程执行任务
+        wakeSleepingThread();
+        return true;
+    }
+
+    //等待任务队列有空余再放入，最多等待timeout，超时返回false，task保持不变
+    //消费者取走任务时看到有阻塞的提交线程才通知notFull_
+    bool waitPushTask(Task& task, std::chrono::milliseconds timeout){
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        blockedSubmitSize_++;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool pushed = notFull_.wait_for(lock, timeout, [&]()->bool {return taskQue_->tryPush(std::move(task));});
+        blockedSubmitSize_--;
+        if(!pushed)
+            return false;
+        lock.unlock();
+        taskSize_++;
+        wakeSleepingThread();
+        return true;
+    }
+
+    //DROP_OLDEST：从全局任务队列取出最多n个等待最久的任务丢弃（分片队列模式下是近似最久），
+    //在锁外让它们的future完成为TaskDroppedError并报告EVENT_DROPPED，返回丢弃的数量
+    size_t dropOldestTasks(size_t n){
+        std::vector<Task> dropped;
+        Task task;
+        while(dropped.size() < n && taskQue_->tryPop(task)){
+            taskSize_--;
+            dropped.push_back(std::move(task));
+        }
+        auto error = std::make_exception_ptr(TaskDroppedError());
+        for(auto& t : dropped){
+            t.abandon(error);
+        }
+        wakeHelpers();
+        overload_.report(OverloadEvent::EVENT_DROPPED, dropped.size());
+        return dropped.size();
+    }
+
+    //没能放入队列的任务：CALLER_RUNS策略下在当前线程执行，否则让它的future完成为提交失败的原因
+    void rejectTask(Task& task){
+        if(!acceptingTasks()){
+            task.abandon(submitError());
+        }
+        else if(overload_.policy() == OverloadPolicy::OVERLOAD_CALLER_RUNS){
+            overload_.report(OverloadEvent::EVENT_CALLER_RUNS);
+            task();
+        }
+        else{
+            overload_.report(OverloadEvent::EVENT_REJECTED);
+            task.abandon(submitError());
+        }
+        wakeHelpers();
+    }
+
+    //提交失败时返回的future，get()抛出提交失败的原因
+    template<typename RType>
+    std::future<RType> failedFuture() const{
+        std::promise<RType> promise(std::allocator_arg, SlabAllocator<char>());
+        promise.set_exception(submitError());
+        return promise.get_future();
+    }
+
+    //把任务放入优先级队列，放入失败返回false；block为true时按过载策略处理，
+    //优先级队列不按入队时间排序，DROP_OLDEST策略下和FAIL_FAST一样直接拒绝
+    bool pushPriorityTask(Task task, TaskPriority priority, std::chrono::steady_clock::time_point deadline, bool block){
+        if(!acceptingTasks())
+            return false;
+        task.setEnqueueTime(steadyNanos());
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        auto hasSpace = [&]()->bool {return priorityQue_->size() < (size_t)taskQueMaxThreshHold_;};
+        if(!hasSpace()){
+            if(!block)
+                return false;
+            if(overload_.policy() == OverloadPolicy::OVERLOAD_CALLER_RUNS){
+                lock.unlock();
+                overload_.report(OverloadEvent::EVENT_CALLER_RUNS);
+                task();
+                wakeHelpers();
+                return true;
+            }
+            if(overload_.policy() != OverloadPolicy::OVERLOAD_BLOCK || !notFull_.wait_for(lock, overload_.blockTime(), hasSpace)){
+                lock.unlock();
+                overload_.report(OverloadEvent::EVENT_REJECTED);
+                return false;
+            }
+        }
+        auto enqueueTime = enqueueTimePoint(task);
+        priorityQue_->push(std::move(task), (size_t)priority, deadline, enqueueTime);
+        taskSize_++;
+        priorityTaskSize_++;
+        lock.unlock();
+        wakeSleepingThread();
+        return true;
+    }
+
+    //按queueMode_选定的队列策略创建全局任务队列，容量是taskQueMaxThreshHold_
+    std::unique_ptr<TaskQueue<Task>> makeTaskQueue(int threadSize) const{
+        std::unique_ptr<TaskQueue<Task>> que;
+        withQueuePolicy([&](auto policy){
+            //分片队列模式下taskQueMaxThreshHold_仍然是所有分片加起来的上限
+            int shards = queueShards_ > 0 ? queueShards_ : threadSize;
+            que = std::make_unique<PolicyTaskQueue<decltype(policy), Task>>((size_t)std::max(taskQueMaxThreshHold_, 1), shards);
+        });
+        return que;
+    }
+
+    //按队列模式调用f(QueuePolicy())，创建队列和工作线程启动时各选一次
+    template<typename F>
+    void withQueuePolicy(F&& f) const{
+        switch(queueMode_){
+        case QueueMode::MODE_LOCKFREE:
+            f(LockFreeQueuePolicy());
+            break;
+        case QueueMode::MODE_SHARDED:
+            f(ShardedQueuePolicy());
+            break;
+        default:
+            f(MutexQueuePolicy());
+            break;
+        }
+    }
+
+    //线程池没有运行时按当前的设置重新创建全局任务队列，已经提交的任务搬到新队列里，
+    //否则线程只从新队列取任务，它们永远不会执行，线程池析构时也不会完成
+    //提交以后又调小了setTaskQueMaxThreshHold，新队列放不下的任务完成为TaskRejectedError
+    void rebuildQueue(int threadSize){
+        auto que = makeTaskQueue(threadSize);
+        std::vector<Task> rejected;
+        Task task;
+        while(taskQue_->tryPop(task)){
+            if(!que->tryPush(std::move(task))){
+                rejected.push_back(std::move(task));
+                taskSize_--;
+            }
+        }
+        taskQue_ = std::move(que);
+        auto error = std::make_exception_ptr(TaskRejectedError());
+        for(auto& t : rejected){
+            t.abandon(error);
+        }
+        overload_.report(OverloadEvent::EVENT_REJECTED, rejected.size());
+    }
+
+    //批量任务入队，没能入队的任务按过载策略在当前线程执行或者算作失败
+    template<typename Gen>
+    void submitBulkTasks(const std::shared_ptr<BulkState>& state, size_t count, Gen&& gen){
+        if(count == 0)
+            return;
+        state->keepAlive(state);
+        size_t pushed = pushBulk(count, gen);
+        for(size_t k = pushed; k < count; k++){
+            Task task = gen(k);
+            rejectTask(task);
+        }
+    }
+
+    //批量入队，gen(k)生成第k个任务，返回实际入队的数量，剩下的任务由调用方处理
+    //队列满时按过载策略：BLOCK等待消费者取走任务，等待超过设置的时间放弃剩下的任务；
+    //DROP_OLDEST丢弃队列里最早的任务腾出位置；FAIL_FAST和CALLER_RUNS立即返回
+    template<typename Gen>
+    size_t pushBulk(size_t count, Gen&& makeTask){
+        if(!acceptingTasks())
+            return 0;
+        //同一批任务使用同一个入队时间
+        uint64_t enqueueTime = steadyNanos();
+        auto gen = [&](size_t k)->Task {
+            Task task = makeTask(k);
+            task.setEnqueueTime(enqueueTime);
+            return task;
+        };
+        //工作窃取模式下线程池内部线程提交的任务全部放入自己的本地队列
+        if(currentWorker().pool == this && currentWorker().index >= 0){
+            auto& que = *workerQues_[currentWorker().index];
+            for(size_t k = 0; k < count; k++){
+                que.push(slabNew<Task>(gen(k)));
+            }
+            wakeSleepingThread(count);
+            return count;
+        }
+        const OverloadPolicy policy = overload_.policy();
+        size_t pushed = 0;
+        //互斥锁队列一次加锁放入剩余容量允许的所有任务；无锁队列一次CAS预留一段连续的槽位；
+        //分片队列一次预留容量，分几段放入不同的分片
+        while(pushed < count){
+            auto next = [&](size_t k)->Task {return gen(pushed + k);};
+            size_t n = taskQue_->tryPushBulk(count - pushed, next);
+            if(n > 0){
+                pushed += n;
+                taskSize_ += (int)n;
+                //只唤醒需要的线程数量
+                wakeSleepingThread(n);
+                continue;
+            }
+            if(policy == OverloadPolicy::OVERLOAD_DROP_OLDEST && dropOldestTasks(count - pushed) > 0)
+                continue;
+            if(policy != OverloadPolicy::OVERLOAD_BLOCK)
+                break;
+            std::unique_lock<std::mutex> lock(taskQueMtx_);
+            blockedSubmitSize_++;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool hasSpace = notFull_.wait_for(lock, overload_.blockTime(), [&]()->bool {return !taskQue_->full();});
+            blockedSubmitSize_--;
+            if(!hasSpace)
+                break;
+        }
+        return pushed;
+    }
+
+    //cached模式的控制线程：每个采样周期把排队任务数量、吞吐量和空闲线程数量交给ElasticController，按它的决定扩容或者缩容
+    void monitorFunc(){
+        using Clock = ElasticController::Clock;
+        ElasticController controller(elasticConfig_, threadSizeThreshHold_, completedTaskSize_.load(std::memory_order_relaxed), Clock::now());
+        std::unique_lock<std::mutex> lock(monitorMtx_);
+        while(isPoolRunning_){
+            monitorCond_.wait_for(lock, controller.config().sampleInterval, [&]()->bool {return !isPoolRunning_;});
+            if(!isPoolRunning_)
+                break;
+            ElasticController::Sample sample;
+            sample.completed = completedTaskSize_.load(std::memory_order_relaxed);
+            sample.queued = pendingTaskSize();
+            sample.threadSize = curThreadSize_;
+            sample.idleThreadSize = idleThreadSize_;
+            auto now = Clock::now();
+            auto decision = controller.sample(sample, now);
+            if(decision.grow > 0)
+                addThreads(decision.grow);
+            else if(decision.shrink && retireThread(controller.minThreadSize((int)initThreadSize_)))
+                controller.shrunk(now);
+        }
+    }
+
+    //创建n个新线程，只在持有锁的时候修改threads_，线程在锁外启动
+    void addThreads(int n){
+        std::vector<Thread*> newThreads;
+        {
+            std::unique_lock<std::mutex> lock(taskQueMtx_);
+            newThreads = createThreads(n);
+        }
+        for(Thread* t : newThreads){
+            t->start();
+        }
+    }
+
+    //创建n个线程对象，返回需要在锁外启动的线程，调用方需要持有taskQueMtx_
+    std::vector<Thread*> createThreads(int n){
+        std::vector<Thread*> newThreads;
+        for(int i = 0; i < n; i++){
+            //创建新线程对象
+            auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc,this, std::placeholders::_1));
+            newThreads.push_back(ptr.get());
+            int threadId = ptr->getId();
+            threads_.emplace(threadId, std::move(ptr));//unique_ptr不允许直接拷贝
+        }
+        //修改线程个数相关的变量
+        curThreadSize_ += n;
+        idleThreadSize_ += n;
+        return newThreads;
+    }
+
+    //ABORT关闭：取出所有还没有开始执行的任务，在锁外调用abandon让它们的future完成为PoolShutdownError
+    void discardTasks(){
+        std::vector<Task> dropped;
+        {
+            std::unique_lock<std::mutex> lock(taskQueMtx_);
+            Task task;
+            while(priorityQue_->pop(task)){
+                dropped.push_back(std::move(task));
+                taskSize_--;
+                priorityTaskSize_--;
+            }
+        }
+        Task task;
+        while(taskQue_->tryPop(task)){
+            dropped.push_back(std::move(task));
+            taskSize_--;
+        }
+        //本地队列只有拥有它的线程可以pop，其他线程只能窃取
+        for(auto& que : workerQues_){
+            Task* ptask = nullptr;
+            while(!que->empty()){
+                if(que->steal(ptask)){
+                    dropped.push_back(std::move(*ptask));
+                    slabDelete(ptask);
+                }
+            }
+        }
+        auto error = std::make_exception_ptr(PoolShutdownError());
+        for(auto& t : dropped){
+            t.abandon(error);
+        }
+        //丢弃的令牌已经各自带走一个组任务，剩下的是达到并发上限、还没有令牌的组任务
+        dropped.clear();
+        groups_.clear(dropped);
+        for(auto& t : dropped){
+            t.abandon(error);
+        }
+    }
+
+    //join已经退出的线程，不能在持有taskQueMtx_时调用
+    void joinExitedThreads(){
+        std::vector<std::unique_ptr<Thread>> exited;
+        {
+            std::unique_lock<std::mutex> lock(taskQueMtx_);
+            exited.swap(exitedThreads_);
+        }
+        for(auto& t : exited){
+            t->join();
+        }
+    }
+
+    //通知一个空闲线程退出，线程数量不能低于minSize
+    bool retireThread(int minSize){
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        if(curThreadSize_ - retireThreadSize_ <= minSize || idleThreadSize_ <= retireThreadSize_)
+            return false;
+        retireThreadSize_++;
+        lock.unlock();
+        idle_.notify();
+        return true;
+    }
+
+    //还没开始执行的任务数量：全局队列加上所有本地队列
+    size_t pendingTaskSize() const{
+        int size = taskSize_;
+        size_t pending = size > 0 ? (size_t)size : 0;
+        for(auto& que : workerQues_){
+            pending += que->size();
+        }
+        return pending;
+    }
+
+    //执行一个任务，维护空闲线程数量、吞吐量统计和运行统计
+    //nested为true表示在helpUntil里执行，外层的任务已经把线程算作忙碌
+    //countCompleted为true时累计完成的任务数量，cached模式的控制线程按它调整线程数量
+    void runTask(Task& task, bool nested, bool countCompleted){
+        uint64_t start = WorkerStatsRef::now();
+        if(!nested)
+            idleThreadSize_--;
+        task();
+        if(!nested)
+            idleThreadSize_++;
+        currentWorker().stats.taskRun(task.enqueueTime(), start, WorkerStatsRef::now());
+        if(countCompleted){
+            completedTaskSize_.fetch_add(1, std::memory_order_relaxed);
+        }
+        wakeHelpers();
+    }
+
+    //任务可能让某个helpUntil的done()变为true，有线程在helpUntil里睡眠时全部唤醒重新检查
+    void wakeHelpers(){
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(anchor_->helpWaiters().load(std::memory_order_relaxed) > 0)
+            idle_.notifyAll();
+    }
+
+    //定义线程函数，线程启动时按队列模式、工作窃取和线程池模式选定一次策略，工作线程循环里不再判断模式
+    void threadFunc(int threadid){
+        //工作窃取模式下，线程先领取一个空闲的本地队列
+        int queIndex = -1;
+        {
+            std::unique_lock<std::mutex> lock(taskQueMtx_);
+            if(workStealing_){
+                queIndex = freeQueIndex_.back();
+                freeQueIndex_.pop_back();
+            }
+            currentWorker().pool = this;
+            currentWorker().index = queIndex;
+            currentWorker().stats = stats_.acquire();
+            currentWorker().cpuSlot = pinCurrentWorker(queIndex);
+        }
+        withQueuePolicy([&](auto policy){
+            withFlag(queIndex >= 0, [&](auto stealing){
+                using QueuePolicy = decltype(policy);
+                constexpr bool STEALING = decltype(stealing)::value;
+                //cached模式下线程数量由控制线程决定，空闲线程自己不计时
+                if(poolMode_ == PoolMode::MODE_CACHED)
+                    runWorker<QueuePolicy, STEALING>(threadid, queIndex, ControlledGrowth());
+                else
+                    runWorker<QueuePolicy, STEALING>(threadid, queIndex, FixedGrowth());
+            });
+        });
+    }
+
+    //工作线程循环：没有任务时先自旋、再让出CPU，还是没有任务才睡眠，被唤醒以后重新自旋
+    //线程池结束或者控制线程/resize回收这个线程时退出
+    template<typename QueuePolicy, bool STEALING, typename Growth>
+    void runWorker(int threadid, int queIndex, const Growth& growth){
+        //helpUntil用同一个实例取任务
+        currentWorker().take = &ThreadPool::takeTask<QueuePolicy, STEALING>;
+        //所有任务必须执行完成，线程池才可以回收所有线程资源
+        workerLoop<Task>(idle_,
+            [&](Task& task){return takeTask<QueuePolicy, STEALING>(queIndex, task);},
+            [&](){return pendingTaskSize() > 0;},
+            [&](EventCount::Key key)->bool {
+                if(!isPoolRunning_ || retireThreadSize_ > 0){
+                    idle_.cancelWait();
+                    return !exitThread(threadid, queIndex);
+                }
+                currentWorker().stats.park();
+                SlabHeap::flush();
+                growth.park(idle_, key, [](){return false;});
+                currentWorker().stats.wakeup();
+                return true;
+            },
+            [&](Task& task){
+                //当前线程负责执行这个任务
+                runTask(task, false, Growth::ELASTIC);//执行任务，把任务的返回值给到future
+                //resize减少了线程数量，正在执行任务的线程执行完手上的任务就退出，本地队列里还有任务时先执行完
+                return !(retireThreadSize_ > 0 && (!STEALING || workerQues_[queIndex]->empty()) && exitThread(threadid, queIndex, true));
+            });
+    }
+
+    //不睡眠地取一个任务：工作窃取模式先取自己的本地队列，再窃取其他线程的本地队列，都没有任务才去全局队列
+    //全局队列按线程启动时选定的队列策略直接访问，不获取taskQueMtx_，优先级队列有任务时才加锁
+    template<typename QueuePolicy, bool STEALING>
+    bool takeTask(int queIndex, Task& task){
+        if constexpr(STEALING){
+            Task* ptask = nullptr;
+            bool found = workerQues_[queIndex]->pop(ptask);
+            if(!found && stealTask(queIndex, ptask)){
+                currentWorker().stats.steal();
+                found = true;
+            }
+            if(found){
+                task = std::move(*ptask);
+                slabDelete(ptask);
+                yieldToPriority(task);
+                return true;
+            }
+        }
+        if(queueOf<QueuePolicy>(*taskQue_).tryPop(task)){
+            taskSize_--;
+            notifyBlockedSubmit();
+            yieldToPriority(task);
+            return true;
+        }
+        //队列空了，再看优先级队列
+        if(priorityTaskSize_ <= 0)
+            return false;
+        std::unique_lock<std::mutex> lock(taskQueMtx_);//锁默认出当前作用域才释放
+        return popPriorityTask(task);
+    }
+
+    //从优先级队列取任务，调用方需要持有taskQueMtx_
+    bool popPriorityTask(Task& task){
+        if(priorityQue_->empty())
+            return false;
+        priorityQue_->pop(task);
+        taskSize_--;
+        priorityTaskSize_--;
+        //取出一个任务应该通知
+        notFull_.notify_all();
+        return true;
+    }
+
+    //task是刚从本地队列、其他线程的本地队列或者全局队列取出的普通任务，这些队列不能先看队头再决定取不取，
+    //所以先取出来再和优先级队列比较：优先级队列里有更紧急的任务（高优先级任务、有截止时间的普通任务、老化以后的低优先级任务）时交换，
+    //普通任务按原来的入队时间放进优先级队列的NORMAL级别并且继续老化，不会被饿死；task换成更紧急的任务，两边的任务数量都不变
+    void yieldToPriority(Task& task){
+        if(priorityTaskSize_ <= 0)
+            return;
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        auto enqueueTime = enqueueTimePoint(task);
+        if(!priorityQue_->aheadOf((size_t)TaskPriority::PRIORITY_NORMAL, enqueueTime))
+            return;
+        Task urgent;
+        priorityQue_->pop(urgent);
+        priorityQue_->push(std::move(task), (size_t)TaskPriority::PRIORITY_NORMAL, std::chrono::steady_clock::time_point::max(), enqueueTime);
+        task = std::move(urgent);
+    }
+
+    static std::chrono::steady_clock::time_point enqueueTimePoint(const Task& task){
+        return std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(task.enqueueTime())));
+    }
+
+    //线程池结束或者控制线程/resize要求回收线程时，线程退出，返回false表示不需要退出
+    //retireOnly为true时只响应回收，线程池结束时线程要继续执行剩下的任务
+    bool exitThread(int threadid, int queIndex, bool retireOnly = false){
+        std::vector<std::unique_ptr<Thread>> exited;
+        {
+            std::unique_lock<std::mutex> lock(taskQueMtx_);
+            if(retireOnly && !isPoolRunning_)
+                return false;
+            if(isPoolRunning_){
+                //cached模式下控制线程决定回收多余的空闲线程，或者resize减少了线程数量
+                if(retireThreadSize_ <= 0)
+                    return false;
+                //记录线程数量的相关变量的值修改
+                retireThreadSize_--;
+                curThreadSize_--;
+                idleThreadSize_--;
+            }
+            //线程池要结束，回收线程资源
+            releaseWorker(queIndex);
+            //线程不能join自己：把自己的线程对象留给下一个退出的线程或者析构函数join，同时带走之前退出的线程
+            exited.swap(exitedThreads_);
+            exitedThreads_.push_back(std::move(threads_[threadid]));
+            threads_.erase(threadid);
+            exitCond_.notify_all();
+        }
+        for(auto& t : exited){
+            t->join();
+        }
+        return true;
+    }
+
+    //放入count个新任务后，唤醒需要的空闲线程数量：正在自旋的线程会取到新任务，只唤醒不够的部分
+    void wakeSleepingThread(size_t count = 1){
+        idle_.wake(count);
+    }
+
+    //从其他线程的本地队列窃取一个任务，随机选择起点，避免所有线程都盯着同一个队列
+    //线程绑定了cpu时先只窃取共享L3缓存的线程，任务的数据还在同一个缓存里，再窃取其他线程
+    bool stealTask(int self, Task*& task){
+        static thread_local std::minstd_rand rng(std::random_device{}());
+        int n = (int)workerQues_.size();
+        int start = (int)(rng() % n);
+        int domain = queDomain_[self].load(std::memory_order_relaxed);
+        for(int pass = domain >= 0 ? 0 : 1; pass < 2; pass++){
+            for(int i = 0; i < n; i++){
+                int victim = (start + i) % n;
+                if(victim == self)
+                    continue;
+                bool sameDomain = domain >= 0 && queDomain_[victim].load(std::memory_order_relaxed) == domain;
+                if(sameDomain != (pass == 0))
+                    continue;
+                if(workerQues_[victim]->steal(task)){
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    //全局队列取走任务后，如果有提交线程阻塞在notFull_上，通知它队列有空余了
+    void notifyBlockedSubmit(){
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(blockedSubmitSize_ > 0){
+            std::unique_lock<std::mutex> lock(taskQueMtx_);
+            notFull_.notify_all();
+        }
+    }
+
+    //把当前线程绑定到cpuOrder_里线程最少的cpu上，同样少时按拓扑顺序选第一个，调用方需要持有taskQueMtx_
+    //返回cpuOrder_的下标，不绑定时返回-1
+    int pinCurrentWorker(int queIndex){
+        if(cpuOrder_.empty())
+            return -1;
+        int slot = (int)(std::min_element(cpuLoad_.begin(), cpuLoad_.end()) - cpuLoad_.begin());
+        if(!pinCurrentThread(cpuOrder_[slot].cpu))
+            return -1;
+        cpuLoad_[slot]++;
+        if(queIndex >= 0)
+            queDomain_[queIndex].store(cpuOrder_[slot].l3, std::memory_order_relaxed);
+        return slot;
+    }
+
+    //线程退出时归还本地队列、绑定的cpu和统计数据，调用方需要持有taskQueMtx_
+    void releaseWorker(int queIndex){
+        if(queIndex >= 0){
+            freeQueIndex_.push_back(queIndex);
+            queDomain_[queIndex].store(-1, std::memory_order_relaxed);
+        }
+        if(currentWorker().cpuSlot >= 0)
+            cpuLoad_[currentWorker().cpuSlot]--;
+        stats_.release(currentWorker().stats);
+        currentWorker() = WorkerContext();
+    }
+
+    //记录当前线程属于哪个线程池、使用哪个本地队列和统计数据
+    struct WorkerContext{
+        ThreadPool* pool = nullptr;
+        int index = -1;//工作窃取模式下的本地队列下标，其他模式为-1
+        int cpuSlot = -1;//绑定的cpu在cpuOrder_里的下标，没有绑定为-1
+        bool (ThreadPool::*take)(int, Task&) = nullptr;//线程启动时按选定的策略实例化的takeTask
+        WorkerStatsRef stats;
+    };
+    static WorkerContext& currentWorker(){
+        static thread_local WorkerContext ctx;
+        return ctx;
+    }
+
+    bool checkRunningState() const{
+        return isPoolRunning_;
+    }
+
+    template<typename T>
+    friend class FutureState;
+    friend class PoolAnchor;
+    friend class ScheduleAwaiter;
+    friend class TaskGraph;
+    friend class ForkJoin;
+    friend class TimerHandle;
+    friend class Strand;
+    friend struct StrandRunner;
+    friend class TaskGroup;
+    friend struct GroupToken;
+
+private:
+    //    std::vector<std::unique_ptr<Thread>> threads_; //线程列表
+    std::unordered_map<int, std::unique_ptr<Thread>> threads_;
+    std::vector<std::unique_ptr<Thread>> exitedThreads_;//已经退出还没有join的线程，由taskQueMtx_保护
+    std::atomic<size_t> initThreadSize_; //初始的线程数量，resize时修改
+    int threadSizeThreshHold_; //线程数量上限阈值
+    std::atomic_int curThreadSize_;//记录当前线程池里面的线程总数量
+    std::atomic_int idleThreadSize_;//记录空闲线程的数量
+
+    std::unique_ptr<TaskQueue<Task>> taskQue_;//全局任务队列，按queueMode_选定的队列策略创建，构造时创建，start之前也可以提交
+    std::atomic_int taskSize_;//任务数量，保证原子操作，保证线程安全
+    int taskQueMaxThreshHold_; //任务队列数量上限阈值
+
+    std::mutex taskQueMtx_; //保证任务队列的线程安全
     std::condition_variable notFull_; //表示任务队列不满
-    std::condition_variable notEmpty_; //表示任务队列不空
     std::condition_variable exitCond_;//等待线程资源全部回收
 
     PoolMode poolMode_;//当前线程池的工作模式
 
     std::atomic_bool isPoolRunning_;//表示当前线程池的启动状态
+    std::atomic_bool isShutdown_;//已经调用过shutdown，不再接收外部提交的任务
+    std::atomic_bool isAborting_;//ABORT方式关闭，线程池内部的任务也不能再提交
+
+    bool workStealing_;//是否开启工作窃取模式
+    std::vector<std::unique_ptr<WorkStealingDeque<Task*>>> workerQues_;//每个线程的本地任务队列
+    std::vector<int> freeQueIndex_;//还没有线程使用的本地队列下标，由taskQueMtx_保护
+    std::vector<std::atomic_int> queDomain_;//每个本地队列的线程绑定的L3缓存域，没有绑定为-1
+
+    SpinParkIdle idle_;//空闲线程的自旋和睡眠，和v1、BasicExecutor共用
+
+    QueueMode queueMode_;//任务队列的实现方式
+    int queueShards_;//分片队列模式的分片数量，0表示按线程数量
+    std::atomic_int blockedSubmitSize_;//全局队列满时阻塞在notFull_上的提交线程数量
+
+    std::unique_ptr<PriorityTaskQueue<Task>> priorityQue_;//指定了优先级的任务，由taskQueMtx_保护，构造时创建，start之前也可以提交
+    std::atomic_int priorityTaskSize_;//优先级队列里的任务数量，为0时取任务不需要加锁检查优先级队列
+
+    ElasticConfig elasticConfig_;//cached模式弹性伸缩的参数
+    std::thread monitor_;//cached模式的控制线程
+    std::mutex monitorMtx_;
+    std::condition_variable monitorCond_;
+    std::atomic<uint64_t> completedTaskSize_;//cached模式下已经执行完的任务数量，用来计算吞吐量
+    std::atomic_int retireThreadSize_;//等待退出的空闲线程数量，只在持有taskQueMtx_时修改
+
+    bool pinThreads_;//是否绑定cpu
+    AffinityConfig affinity_;//绑定cpu的参数
+    std::vector<CpuInfo> cpuOrder_;//线程绑定cpu的顺序，start时按拓扑生成
+    std::vector<int> cpuLoad_;//每个cpu上绑定的线程数量，由taskQueMtx_保护
+
+    StatsRegistry stats_;//每个线程的计数器和直方图，THREADPOOL_STATS为0时是空对象
+    OverloadControl overload_;//任务队列满时的过载策略、回调和计数器
+
+    std::mutex timerMtx_;//保护时间轮和定时任务，和taskQueMtx_无关
+    std::condition_variable timerCond_;
+    TimerWheel timerWheel_;//submitAfter/submitAt/submitEvery的定时任务
+    std::thread timerThread_;//定时线程，第一次提交定时任务时启动
+    std::chrono::steady_clock::time_point timerStart_;//时间轮的第0个tick
+    uint64_t timerWakeTick_;//定时线程睡眠到哪个tick，0表示醒着，由timerMtx_保护
+    bool timerStop_;//由timerMtx_保护
+
+    std::mutex keyedStrandMtx_;//只在创建keyedStrands_时使用
+    int keyedStrandSize_;
+    std::atomic_bool keyedStrandsReady_;//keyedStrands_已经创建，之后只读
+    std::vector<std::shared_ptr<StrandState>> keyedStrands_;//submitKeyed使用的strand
+    GroupScheduler<Task> groups_;//任务组的队列和加权公平调度
+
+    std::shared_ptr<PoolAnchor> anchor_;//PoolFuture、BulkFuture通过它访问线程池，析构时detach
+};
+
+template<typename Pred>
+bool PoolAnchor::helpUntil(Pred done){
+    ThreadPool* pool = acquire();
+    if(pool == nullptr)
+        return false;
+    bool helped = pool->helpUntil(done);
+    release();
+    return helped;
+}
+
+inline void PoolAnchor::wakeHelpers(){
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(helpWaiters_.load(std::memory_order_relaxed) == 0)
+        return;
+    ThreadPool* pool = acquire();
+    if(pool == nullptr)
+        return;
+    pool->idle_.notifyAll();
+    release();
+}
+
+inline bool TimerHandle::cancel() const{
+    if(entry_ == nullptr)
+        return false;
+    ThreadPool* pool = entry_->pool.load(std::memory_order_acquire);
+    return pool != nullptr && pool->cancelTimer(*entry_);
+}
+
+inline void GroupToken::operator()(){
+    pool->runGroupToken();
+}
+
+inline void GroupToken::abandon(std::exception_ptr error){
+    pool->abandonGroupToken(error);
+}
+
+template<typename Func, typename... Args>
+auto TaskGroup::submitTask(Func&& func, Args&&... args) -> std::future<decltype(func(args...))>{
+    return pool_->submitGroupTask(group_, std::forward<Func>(func), std::forward<Args>(args)...);
+}
+
+inline GroupStats TaskGroup::stats() const{
+    return pool_->groups_.stats(group_);
+}
+
+inline void StrandRunner::operator()(){
+    pool->runStrand(state);
+}
+
+template<typename Func, typename... Args>
+auto Strand::submitTask(Func&& func, Args&&... args) -> std::future<decltype(func(args...))>{
+    return pool_->submitStrandTask(state_, std::forward<Func>(func), std::forward<Args>(args)...);
+}
+
+//PoolFuture的共享状态：返回值、等待方和后续任务
+//结果就绪时立即把后续任务放入线程池，不需要有线程阻塞在get()上再重新提交
+template<typename T>
+class FutureState{
+    struct Unit{};
+    using Storage = typename std::conditional<std::is_void<T>::value, Unit, T>::type;
+public:
+    explicit FutureState(std::shared_ptr<PoolAnchor> anchor):anchor_(std::move(anchor)),ready_(false){}
+    FutureState(const FutureState&) = delete;
+    FutureState& operator=(const FutureState&) = delete;
+
+    //执行f，把返回值或者异常保存下来
+    template<typename F>
+    void run(F&& f){
+        try{
+            if constexpr(std::is_void<T>::value){
+                f();
+                setValue();
+            }
+            else{
+                setValue(f());
+            }
+        }
+        catch(...){
+            setError(std::current_exception());
+        }
+    }
+    template<typename... Args>
+    void setValue(Args&&... args){
+        value_.emplace(std::forward<Args>(args)...);
+        publish();
+    }
+    void setError(std::exception_ptr error){
+        error_ = error;
+        publish();
+    }
+
+    bool ready() const{
+        return ready_.load(std::memory_order_acquire);
+    }
+    //在线程池的线程里调用时执行其他任务，不睡眠
+    void wait(){
+        if(ready())
+            return;
+        if(anchor_ != nullptr && anchor_->helpUntil([this]()->bool {return ready();}))
+            return;
+        std::unique_lock<std::mutex> lock(mtx_);
+        cond_.wait(lock, [&]()->bool {return ready_.load(std::memory_order_relaxed);});
+    }
+    template<typename Rep, typename Period>
+    bool waitFor(const std::chrono::duration<Rep, Period>& timeout){
+        if(ready())
+            return true;
+        std::unique_lock<std::mutex> lock(mtx_);
+        return cond_.wait_for(lock, timeout, [&]()->bool {return ready_.load(std::memory_order_relaxed);});
+    }
+    std::exception_ptr error() const{
+        return error_;
+    }
+    //等待结果并把返回值移出来，异常在这里重新抛出
+    T take(){
+        wait();
+        if(error_){
+            std::rethrow_exception(error_);
+        }
+        if constexpr(!std::is_void<T>::value){
+            return std::move(*value_);
+        }
+    }
+
+    //结果就绪以后执行func：onPool为true时放入线程池执行，否则在设置结果的线程里直接执行
+    //结果已经就绪时立即执行或者提交
+    void onReady(TaskFunc func, bool onPool){
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            if(!ready_.load(std::memory_order_relaxed)){
+                continuations_.push_back(Continuation{std::move(func), onPool});
+                return;
+            }
+        }
+        dispatch(func, onPool);
+    }
+
+    const std::shared_ptr<PoolAnchor>& anchor() const{
+        return anchor_;
+    }
+
+private:
+    struct Continuation{
+        TaskFunc func;
+        bool onPool;
+    };
+
+    void publish(){
+        std::vector<Continuation> continuations;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            ready_.store(true, std::memory_order_release);
+            continuations.swap(continuations_);
+            cond_.notify_all();
+        }
+        if(anchor_ != nullptr)
+            anchor_->wakeHelpers();
+        for(auto& c : continuations){
+            dispatch(c.func, c.onPool);
+        }
+    }
+    //线程池已经析构时后续任务直接在当前线程执行
+    void dispatch(TaskFunc& func, bool onPool){
+        if(onPool && anchor_ != nullptr){
+            ThreadPool* pool = anchor_->acquire();
+            if(pool != nullptr){
+                bool posted = pool->tryPostContinuation(func);
+                anchor_->release();
+                if(posted)
+                    return;
+            }
+        }
+        func();
+    }
+
+private:
+    std::shared_ptr<PoolAnchor> anchor_;//后续任务在这个线程池上执行
+    std::atomic_bool ready_;
+    std::optional<Storage> value_;
+    std::exception_ptr error_;
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::vector<Continuation> continuations_;//结果就绪前挂上来的后续任务，由mtx_保护
 };
 
+//submitAsync提交的任务：执行任务函数，把返回值交给FutureState
+template<typename RType, typename Func, typename ArgsTuple>
+struct StateTask{
+    std::shared_ptr<FutureState<RType>> state;
+    Func func;
+    ArgsTuple args;
+    void operator()(){
+        state->run([this]()->RType {return std::apply(func, args);});
+    }
+    void fail(std::exception_ptr error){
+        state->setError(error);
+    }
+    void abandon(std::exception_ptr error){
+        fail(error);
+    }
+};
+
+template<typename RType, typename Func, typename... Args>
+auto ThreadPool::makeStateTask(std::shared_ptr<FutureState<RType>> state, Func&& func, Args&&... args){
+    using Tuple = decltype(std::make_tuple(std::forward<Args>(args)...));
+    return StateTask<RType, typename std::decay<Func>::type, Tuple>{
+        std::move(state), std::forward<Func>(func), std::make_tuple(std::forward<Args>(args)...)};
+}
+
+inline void BulkFuture::wait() const{
+    if(state_->ready())
+        return;
+    if(anchor_ != nullptr && anchor_->helpUntil([this]()->bool {return state_->ready();}))
+        return;
+    state_->wait();
+}
+
+//then挂上的后续任务：src完成以后执行fn，结果交给dst，src出现异常时不调用fn，异常直接传给dst
+template<typename T, typename RType, typename Fn>
+struct ThenTask{
+    std::shared_ptr<FutureState<T>> src;
+    std::shared_ptr<FutureState<RType>> dst;
+    Fn fn;
+    void operator()(){
+        if(src->error()){
+            dst->setError(src->error());
+            return;
+        }
+        dst->run([&]()->RType {
+            if constexpr(std::is_void<T>::value){
+                return fn();
+            }
+            else{
+                return fn(src->take());
+            }
+        });
+    }
+    void abandon(std::exception_ptr error){
+        dst->setError(error);
+    }
+};
+
+//线程池感知的future：和std::future一样只能get一次，另外可以用then挂后续任务
+template<typename T>
+class PoolFuture{
+public:
+    using ValueType = T;
+
+    PoolFuture() = default;
+    explicit PoolFuture(std::shared_ptr<FutureState<T>> state):state_(std::move(state)){}
+
+    bool valid() const{
+        return state_ != nullptr;
+    }
+    bool ready() const{
+        return state_->ready();
+    }
+    void wait() const{
+        state_->wait();
+    }
+    template<typename Rep, typename Period>
+    bool waitFor(const std::chrono::duration<Rep, Period>& timeout) const{
+        return state_->waitFor(timeout);
+    }
+    //阻塞等待结果，任务抛出的异常在这里重新抛出
+    T get(){
+        auto state = std::move(state_);
+        return state->take();
+    }
+
+    //结果就绪时把fn(value)（T为void时是fn()）放入线程池执行，返回fn结果的PoolFuture
+    //这个future出现异常时不调用fn，异常直接传给返回的future
+    template<typename F>
+    auto then(F&& fn){
+        using Fn = typename std::decay<F>::type;
+        using RType = typename ThenResult<Fn>::type;
+        auto src = std::move(state_);
+        auto dst = makeSlabShared<FutureState<RType>>(src->anchor());
+        FutureState<T>* ps = src.get();
+        ps->onReady(ThenTask<T, RType, Fn>{src, dst, Fn(std::forward<F>(fn))}, true);
+        return PoolFuture<RType>(std::move(dst));
+    }
+
+    std::shared_ptr<FutureState<T>> state() const{
+        return state_;
+    }
+
+private:
+    template<typename Fn, bool = std::is_void<T>::value>
+    struct ThenResult{
+        using type = decltype(std::declval<Fn&>()());
+    };
+    template<typename Fn>
+    struct ThenResult<Fn, false>{
+        using type = decltype(std::declval<Fn&>()(std::declval<T>()));
+    };
+
+    std::shared_ptr<FutureState<T>> state_;
+};
+
+//submitAfter/submitAt返回的future：和PoolFuture一样使用，还没有到期时可以取消
+template<typename T>
+class ScheduledFuture : public PoolFuture<T>{
+public:
+    ScheduledFuture() = default;
+    ScheduledFuture(std::shared_ptr<FutureState<T>> state, TimerHandle timer)
+    :PoolFuture<T>(std::move(state)),timer_(std::move(timer)){}
+
+    //到期前取消，任务不再执行，get()抛出TaskCancelledError；已经到期时返回false
+    bool cancel(){
+        if(!timer_.cancel())
+            return false;
+        this->state()->setError(std::make_exception_ptr(TaskCancelledError()));
+        return true;
+    }
+    const TimerHandle& timer() const{
+        return timer_;
+    }
+private:
+    TimerHandle timer_;
+};
+
+//所有future都完成时完成，按输入顺序返回所有结果；有异常时返回第一个完成的异常
+//输入的future被消费，不能再get
+template<typename T>
+auto whenAll(std::vector<PoolFuture<T>> futures)
+    -> PoolFuture<typename std::conditional<std::is_void<T>::value, void, std::vector<T>>::type>{
+    using RType = typename std::conditional<std::is_void<T>::value, void, std::vector<T>>::type;
+    struct AllState{
+        std::vector<std::shared_ptr<FutureState<T>>> inputs;
+        std::shared_ptr<FutureState<RType>> output;
+        std::atomic<size_t> remaining;
+        std::atomic_bool failed;
+    };
+    auto all = makeSlabShared<AllState>();
+    std::shared_ptr<PoolAnchor> anchor;
+    for(auto& f : futures){
+        all->inputs.push_back(f.state());
+        f = PoolFuture<T>();
+        if(anchor == nullptr)
+            anchor = all->inputs.back()->anchor();
+    }
+    all->output = makeSlabShared<FutureState<RType>>(anchor);
+    all->remaining.store(all->inputs.size());
+    all->failed.store(false);
+    PoolFuture<RType> result(all->output);
+    if(all->inputs.empty()){
+        all->output->run([]()->RType {return RType();});
+        return result;
+    }
+    for(auto& input : all->inputs){
+        FutureState<T>* ps = input.get();
+        //在设置结果的线程里直接计数，只有最后一个完成的输入负责收集结果
+        ps->onReady([all, ps](){
+            if(ps->error() && !all->failed.exchange(true)){
+                all->output->setError(ps->error());
+            }
+            if(all->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1 || all->failed.load())
+                return;
+            all->output->run([&]()->RType {
+                if constexpr(!std::is_void<T>::value){
+                    RType values;
+                    values.reserve(all->inputs.size());
+                    for(auto& in : all->inputs){
+                        values.push_back(in->take());
+                    }
+                    return values;
+                }
+            });
+            all->inputs.clear();
+        }, false);
+    }
+    return result;
+}
+
+//任意一个future完成时完成，返回第一个完成的下标和结果（T为void时只有下标）
+//第一个完成的future出现异常时返回这个异常
+template<typename T>
+auto whenAny(std::vector<PoolFuture<T>> futures)
+    -> PoolFuture<typename std::conditional<std::is_void<T>::value, size_t, std::pair<size_t, T>>::type>{
+    using RType = typename std::conditional<std::is_void<T>::value, size_t, std::pair<size_t, T>>::type;
+    struct AnyState{
+        std::shared_ptr<FutureState<RType>> output;
+        std::atomic_bool done;
+    };
+    if(futures.empty()){
+        throw std::invalid_argument("whenAny needs at least one future");
+    }
+    auto any = makeSlabShared<AnyState>();
+    any->output = makeSlabShared<FutureState<RType>>(futures.front().state()->anchor());
+    any->done.store(false);
+    PoolFuture<RType> result(any->output);
+    for(size_t i = 0; i < futures.size(); i++){
+        auto input = futures[i].state();
+        FutureState<T>* ps = input.get();
+        ps->onReady([any, input, i](){
+            if(any->done.exchange(true))
+                return;
+            if(input->error()){
+                any->output->setError(input->error());
+                return;
+            }
+            any->output->run([&]()->RType {
+                if constexpr(std::is_void<T>::value){
+                    return i;
+                }
+                else{
+                    return RType(i, input->take());
+                }
+            });
+        }, false);
+    }
+    return result;
+}
+
+} //namespace v2
+
 #endif /* threadpool_hpp */
@@ -0,0 +1,202 @@
+//
+//  timerwheel.hpp
+//  ThreadPool2.0
+//
+//  分层时间轮：6层，每层64个槽，第0层一个槽是1个tick，第l层一个槽是64^l个tick
+//  插入和删除都是O(1)（侵入式双向链表），推进时用每层一个64位的位图跳过空槽，
+//  高层的槽到期时把里面的定时器重新分到低层（cascade），第0层的槽到期时定时器到期
+//  不加锁，由调用方保护
+//
+
+#ifndef timerwheel_hpp
+#define timerwheel_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+//时间轮上的节点，定时任务从它派生
+struct TimerWheelNode{
+    TimerWheelNode* prev = nullptr;
+    TimerWheelNode* next = nullptr;
+    uint64_t expiry = 0;//到期的tick
+    uint8_t level = 0;
+    uint8_t slot = 0;
+    bool linked = false;//是否在时间轮上
+};
+
+class TimerWheel{
+public:
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int SLOTS = 1 << SLOT_BITS;
+    static constexpr int LEVELS = 6;
+    static constexpr uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+    TimerWheel(){
+        for(int l = 0; l < LEVELS; l++){
+            bitmap_[l] = 0;
+            for(int s = 0; s < SLOTS; s++){
+                heads_[l][s] = nullptr;
+            }
+        }
+    }
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    //时间轮当前推进到的tick
+    uint64_t now() const{
+        return now_;
+    }
+    size_t size() const{
+        return size_;
+    }
+    bool empty() const{
+        return size_ == 0;
+    }
+
+    //按node->expiry放入时间轮，已经到期（expiry <= now()）时不放入，返回false
+    //超过时间轮范围（64^6个tick）的放在最高层最远的槽，到那时重新放入
+    bool insert(TimerWheelNode* node){
+        uint64_t expiry = node->expiry;
+        if(expiry <= now_)
+            return false;
+        uint64_t delta = expiry - now_;
+        int level = 0;
+        while(level < LEVELS - 1 && delta >= span(level + 1)){
+            level++;
+        }
+        uint64_t pos = delta >= span(LEVELS) ? now_ + span(LEVELS) - 1 : expiry;
+        int slot = (int)((pos >> (SLOT_BITS * level)) & (SLOTS - 1));
+        link(node, level, slot);
+        return true;
+    }
+
+    //从时间轮上摘下节点，节点必须在时间轮上
+    void remove(TimerWheelNode* node){
+        if(node->prev != nullptr)
+            node->prev->next = node->next;
+        else
+            heads_[node->level][node->slot] = node->next;
+        if(node->next != nullptr)
+            node->next->prev = node->prev;
+        if(heads_[node->level][node->slot] == nullptr)
+            bitmap_[node->level] &= ~(1ull << node->slot);
+        node->prev = node->next = nullptr;
+        node->linked = false;
+        size_--;
+    }
+
+    //下一个需要处理的tick：最早的第0层到期或者高层cascade，时间轮为空时返回NEVER
+    uint64_t nextEvent() const{
+        uint64_t next = NEVER;
+        for(int l = 0; l < LEVELS; l++){
+            if(bitmap_[l] == 0)
+                continue;
+            int shift = SLOT_BITS * l;
+            uint64_t base = now_ >> shift;
+            int pos = (int)(base & (SLOTS - 1));
+            //从当前位置的下一个槽开始循环找第一个非空的槽，当前槽本身表示下一圈
+            int rot = (pos + 1) & (SLOTS - 1);
+            uint64_t bits = rot == 0 ? bitmap_[l] : (bitmap_[l] >> rot) | (bitmap_[l] << (SLOTS - rot));
+            uint64_t offset = (uint64_t)__builtin_ctzll(bits) + 1;
+            uint64_t tick = (base + offset) << shift;
+            if(tick < next)
+                next = tick;
+        }
+        return next;
+    }
+
+    //推进到tick to，到期的节点从时间轮上摘下后调用onDue(node)
+    //只在有事件的tick停下，空的时间段直接跳过
+    template<typename F>
+    void advance(uint64_t to, F&& onDue){
+        for(;;){
+            uint64_t t = nextEvent();
+            if(t > to){
+                if(to > now_)
+                    now_ = to;
+                return;
+            }
+            now_ = t;
+            //先处理高层，高层分下来的节点可能正好在这个tick到期
+            for(int l = LEVELS - 1; l >= 1; l--){
+                int shift = SLOT_BITS * l;
+                if((t & (span(l) - 1)) != 0)
+                    continue;
+                int slot = (int)((t >> shift) & (SLOTS - 1));
+                TimerWheelNode* node = detach(l, slot);
+                while(node != nullptr){
+                    TimerWheelNode* next = node->next;
+                    node->prev = node->next = nullptr;
+                    if(!insert(node))
+                        onDue(node);
+                    node = next;
+                }
+            }
+            TimerWheelNode* node = detach(0, (int)(t & (SLOTS - 1)));
+            while(node != nullptr){
+                TimerWheelNode* next = node->next;
+                node->prev = node->next = nullptr;
+                onDue(node);
+                node = next;
+            }
+        }
+    }
+
+    //摘下所有节点，对每个节点调用f(node)
+    template<typename F>
+    void clear(F&& f){
+        for(int l = 0; l < LEVELS; l++){
+            for(int s = 0; s < SLOTS; s++){
+                TimerWheelNode* node = detach(l, s);
+                while(node != nullptr){
+                    TimerWheelNode* next = node->next;
+                    node->prev = node->next = nullptr;
+                    f(node);
+                    node = next;
+                }
+            }
+        }
+    }
+
+private:
+    //第l层一圈覆盖的tick数量，也是第l+1层一个槽的大小
+    static constexpr uint64_t span(int level){
+        return 1ull << (SLOT_BITS * level);
+    }
+
+    void link(TimerWheelNode* node, int level, int slot){
+        node->level = (uint8_t)level;
+        node->slot = (uint8_t)slot;
+        node->prev = nullptr;
+        node->next = heads_[level][slot];
+        if(node->next != nullptr)
+            node->next->prev = node;
+        heads_[level][slot] = node;
+        bitmap_[level] |= 1ull << slot;
+        node->linked = true;
+        size_++;
+    }
+
+    //摘下一个槽里的整条链表
+    TimerWheelNode* detach(int level, int slot){
+        TimerWheelNode* head = heads_[level][slot];
+        if(head == nullptr)
+            return nullptr;
+        heads_[level][slot] = nullptr;
+        bitmap_[level] &= ~(1ull << slot);
+        for(TimerWheelNode* node = head; node != nullptr; node = node->next){
+            node->linked = false;
+            size_--;
+        }
+        return head;
+    }
+
+private:
+    TimerWheelNode* heads_[LEVELS][SLOTS];
+    uint64_t bitmap_[LEVELS];//每层哪些槽不为空
+    uint64_t now_ = 0;
+    size_t size_ = 0;
+};
+
+#endif /* timerwheel_hpp */
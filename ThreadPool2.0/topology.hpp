@@ -0,0 +1,207 @@
+//
+//  topology.hpp
+//  ThreadPool2.0
+//
+//  CPU拓扑：从/sys/devices/system/cpu读取每个逻辑cpu所在的核、L3缓存和物理cpu，
+//  线程按拓扑顺序绑定cpu，工作窃取优先选择共享L3缓存的线程
+//
+
+#ifndef topology_hpp
+#define topology_hpp
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+//一个逻辑cpu的位置
+struct CpuInfo{
+    int cpu = -1;//逻辑cpu编号
+    int core = -1;//物理核，取这个核上最小的逻辑cpu编号，同一个核上的逻辑cpu是超线程
+    int l3 = -1;//L3缓存域，取共享这个缓存的最小cpu编号，读不到L3时按物理cpu划分
+    int package = -1;//物理cpu（插槽）
+    int smtIndex = 0;//在同一个核里的第几个超线程
+};
+
+class CpuTopology{
+public:
+    static constexpr const char* SYSFS_ROOT = "/sys/devices/system/cpu";
+
+    //读取sysfsRoot下的拓扑，root可以换成测试用的目录
+    //读不到的信息按保守的方式补全：没有核信息时每个cpu一个核，没有L3信息时按物理cpu划分
+    static CpuTopology load(const std::string& sysfsRoot = SYSFS_ROOT){
+        CpuTopology topo;
+        std::vector<int> cpus;
+        if(!parseCpuList(readFile(sysfsRoot + "/online"), cpus)){
+            //没有online文件时按编号依次探测
+            for(int cpu = 0; ; cpu++){
+                if(!exists(cpuDir(sysfsRoot, cpu) + "/topology/core_id"))
+                    break;
+                cpus.push_back(cpu);
+            }
+        }
+        std::vector<int> coreIds;
+        for(int cpu : cpus){
+            CpuInfo info;
+            info.cpu = cpu;
+            std::string dir = cpuDir(sysfsRoot, cpu);
+            info.package = readInt(dir + "/topology/physical_package_id", 0);
+            info.l3 = readL3(dir);
+            topo.cpus_.push_back(info);
+            coreIds.push_back(readInt(dir + "/topology/core_id", cpu));
+        }
+        //core_id只在同一个物理cpu内唯一，核和缓存域都用其中最小的cpu编号表示
+        for(size_t i = 0; i < topo.cpus_.size(); i++){
+            CpuInfo& c = topo.cpus_[i];
+            for(size_t j = 0; j < topo.cpus_.size(); j++){
+                const CpuInfo& other = topo.cpus_[j];
+                if(other.package == c.package && coreIds[j] == coreIds[i] && (c.core < 0 || other.cpu < c.core))
+                    c.core = other.cpu;
+            }
+        }
+        for(auto& c : topo.cpus_){
+            if(c.l3 >= 0)
+                continue;
+            for(auto& other : topo.cpus_){
+                if(other.package == c.package && (c.l3 < 0 || other.cpu < c.l3))
+                    c.l3 = other.cpu;
+            }
+        }
+        topo.assignSmtIndex();
+        return topo;
+    }
+
+    const std::vector<CpuInfo>& cpus() const{
+        return cpus_;
+    }
+
+    //物理核的数量
+    size_t coreCount() const{
+        std::vector<int> cores;
+        for(auto& c : cpus_){
+            cores.push_back(c.core);
+        }
+        std::sort(cores.begin(), cores.end());
+        return (size_t)(std::unique(cores.begin(), cores.end()) - cores.begin());
+    }
+
+    //线程绑定cpu的顺序：同一个L3缓存的cpu连在一起，缓存域内先用不同的物理核，再用超线程
+    //allowed不为空时只使用其中的cpu，useSmt为false时每个物理核只用一个逻辑cpu
+    std::vector<CpuInfo> placement(const std::vector<int>& allowed, bool useSmt) const{
+        std::vector<CpuInfo> order;
+        for(auto& c : cpus_){
+            if(!allowed.empty() && std::find(allowed.begin(), allowed.end(), c.cpu) == allowed.end())
+                continue;
+            if(!useSmt && c.smtIndex > 0)
+                continue;
+            order.push_back(c);
+        }
+        std::stable_sort(order.begin(), order.end(), [](const CpuInfo& a, const CpuInfo& b){
+            if(a.package != b.package)
+                return a.package < b.package;
+            if(a.l3 != b.l3)
+                return a.l3 < b.l3;
+            if(a.smtIndex != b.smtIndex)
+                return a.smtIndex < b.smtIndex;
+            return a.cpu < b.cpu;
+        });
+        return order;
+    }
+
+    //解析"0-3,8,10-11"格式的cpu列表
+    static bool parseCpuList(const std::string& text, std::vector<int>& cpus){
+        std::stringstream ss(text);
+        std::string range;
+        bool any = false;
+        while(std::getline(ss, range, ',')){
+            range.erase(std::remove_if(range.begin(), range.end(), [](char ch){return ch == ' ' || ch == '\n';}), range.end());
+            if(range.empty())
+                continue;
+            size_t dash = range.find('-');
+            try{
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for(int cpu = first; cpu <= last; cpu++){
+                    cpus.push_back(cpu);
+                }
+                any = true;
+            }
+            catch(const std::exception&){
+                return false;
+            }
+        }
+        return any;
+    }
+
+private:
+    static std::string cpuDir(const std::string& root, int cpu){
+        return root + "/cpu" + std::to_string(cpu);
+    }
+    static std::string readFile(const std::string& path){
+        std::ifstream in(path);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    }
+    static bool exists(const std::string& path){
+        return std::ifstream(path).good();
+    }
+    static int readInt(const std::string& path, int defaultValue){
+        std::ifstream in(path);
+        int value;
+        if(in >> value)
+            return value;
+        return defaultValue;
+    }
+    //在cache/indexN里找level为3的缓存，返回共享它的最小cpu编号，没有L3返回-1
+    static int readL3(const std::string& dir){
+        for(int index = 0; ; index++){
+            std::string cache = dir + "/cache/index" + std::to_string(index);
+            int level = readInt(cache + "/level", -1);
+            if(level < 0)
+                return -1;
+            if(level != 3)
+                continue;
+            std::vector<int> shared;
+            if(!parseCpuList(readFile(cache + "/shared_cpu_list"), shared))
+                return -1;
+            return *std::min_element(shared.begin(), shared.end());
+        }
+    }
+    //同一个核上的逻辑cpu按编号排序，依次编号为第0、1...个超线程
+    void assignSmtIndex(){
+        std::vector<CpuInfo*> sorted;
+        for(auto& c : cpus_){
+            sorted.push_back(&c);
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const CpuInfo* a, const CpuInfo* b){
+            return a->core != b->core ? a->core < b->core : a->cpu < b->cpu;
+        });
+        for(size_t i = 0; i < sorted.size(); i++){
+            sorted[i]->smtIndex = (i > 0 && sorted[i - 1]->core == sorted[i]->core) ? sorted[i - 1]->smtIndex + 1 : 0;
+        }
+    }
+
+private:
+    std::vector<CpuInfo> cpus_;
+};
+
+//把当前线程绑定到cpu上，不支持的平台什么都不做，返回false
+inline bool pinCurrentThread(int cpu){
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+#endif /* topology_hpp */
@@ -0,0 +1,133 @@
+//
+//  wsdeque.hpp
+//  ThreadPool2.0
+//
+//  Chase-Lev 工作窃取双端队列
+//  参考：Lê, Pop, Cohen, Zappa Nardelli. Correct and Efficient Work-Stealing for Weak Memory Models. PPoPP 2013
+//
+
+#ifndef wsdeque_hpp
+#define wsdeque_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <type_traits>
+
+//工作窃取队列：只有拥有者线程可以push/pop（从底部操作，LIFO，缓存友好），
+//其他线程只能steal（从顶部操作，FIFO），push/pop在无竞争时不需要任何CAS
+template<typename T>
+class WorkStealingDeque{
+    static_assert(std::is_trivially_copyable<T>::value, "WorkStealingDeque只能存放可平凡拷贝的类型（一般是指针）");
+public:
+    explicit WorkStealingDeque(int64_t capacity = 256)
+    :top_(0)
+    ,bottom_(0)
+    {
+        int64_t cap = 1;
+        while(cap < capacity) cap <<= 1;//容量必须是2的幂，下标用掩码取模
+        garbage_.emplace_back(std::make_unique<Array>(cap));
+        array_.store(garbage_.back().get(), std::memory_order_relaxed);
+    }
+    ~WorkStealingDeque() = default;
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    //拥有者线程调用：从底部压入
+    void push(T item){
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Array* a = array_.load(std::memory_order_relaxed);
+        if(b - t > a->capacity - 1){
+            a = grow(a, b, t);
+        }
+        a->put(b, item);
+        bottom_.store(b + 1, std::memory_order_release);
+    }
+
+    //拥有者线程调用：从底部弹出，队列为空返回false
+    bool pop(T& item){
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Array* a = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        if(t > b){
+            //队列已空，恢复bottom
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        item = a->get(b);
+        if(t == b){
+            //只剩最后一个元素，和窃取者竞争
+            bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    //任意线程调用：从顶部窃取，队列为空或者竞争失败返回false
+    bool steal(T& item){
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if(t >= b){
+            return false;
+        }
+        Array* a = array_.load(std::memory_order_acquire);
+        T x = a->get(t);
+        if(!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)){
+            return false;
+        }
+        item = x;
+        return true;
+    }
+
+    bool empty() const{
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return b <= t;
+    }
+
+    size_t size() const{
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+private:
+    //环形数组，扩容时旧数组不立即释放（窃取者可能还在读），统一在析构时回收
+    struct Array{
+        explicit Array(int64_t cap):capacity(cap),mask(cap - 1),buf(new std::atomic<T>[cap]){}
+        T get(int64_t i) const{
+            return buf[i & mask].load(std::memory_order_relaxed);
+        }
+        void put(int64_t i, T x){
+            buf[i & mask].store(x, std::memory_order_relaxed);
+        }
+        int64_t capacity;
+        int64_t mask;
+        std::unique_ptr<std::atomic<T>[]> buf;
+    };
+
+    Array* grow(Array* a, int64_t b, int64_t t){
+        garbage_.emplace_back(std::make_unique<Array>(a->capacity * 2));
+        Array* na = garbage_.back().get();
+        for(int64_t i = t; i < b; i++){
+            na->put(i, a->get(i));
+        }
+        array_.store(na, std::memory_order_release);
+        return na;
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> top_;//窃取端
+    alignas(64) std::atomic<int64_t> bottom_;//拥有者端
+    std::atomic<Array*> array_;
+    std::vector<std::unique_ptr<Array>> garbage_;//只有拥有者线程会修改
+};
+
+#endif /* wsdeque_hpp */
@@ -0,0 +1,104 @@
+//
+//  bench.cpp
+//  benchmark
+//
+//  线程池基准测试入口，每个测量结果输出一行JSON（JSON Lines），方便脚本汇总对比：
+//  ./bench [--threads N] [--tasks N] [--elements N] [--repeat N] [--impl v1|v2] [--config 名字] [--scenario 名字] [--quick]
+//
+
+#include "bench.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+namespace {
+
+void printUsage(const char* prog){
+    std::fprintf(stderr,
+        "usage: %s [options]\n"
+        "  --threads N      线程池线程数量，默认为cpu核数量\n"
+        "  --tasks N        吞吐量场景的任务数量，默认200000\n"
+        "  --elements N     并行算法场景的元素数量，默认10000000\n"
+        "  --repeat N       每个场景重复次数，输出中位数，默认3\n"
+        "  --impl NAME      只运行v1或v2\n"
+        "  --config NAME    只运行名字包含NAME的配置（mutex/lockfree/sharded/ws/ws-pinned/mutex-nospin/executor/coroutine/parallel）\n"
+        "  --scenario NAME  只运行名字包含NAME的场景（empty/latency_idle/latency_paced/fanout/producers/mixed/hops/\n"
+        "                   reduce/transform/scan/sort）\n"
+        "  --quick          少量任务快速跑一遍，用于检查构建\n",
+        prog);
+}
+
+//JSON字符串转义，配置和场景名字都是固定的ASCII，只需要处理引号和反斜杠
+std::string jsonString(const std::string& s){
+    std::string out = "\"";
+    for(char c : s){
+        if(c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    out += '"';
+    return out;
+}
+
+void printResult(const BenchResult& r){
+    std::string line = "{\"impl\":" + jsonString(r.impl)
+        + ",\"config\":" + jsonString(r.config)
+        + ",\"scenario\":" + jsonString(r.scenario);
+    for(auto& m : r.metrics){
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "%.6g", m.second);
+        line += "," + jsonString(m.first) + ":" + buf;
+    }
+    line += "}\n";
+    std::fputs(line.c_str(), stdout);
+    std::fflush(stdout);
+}
+
+} //namespace
+
+int main(int argc, const char* argv[]){
+    BenchOptions opt;
+    opt.threads = std::max(1, (int)std::thread::hardware_concurrency());
+    std::string impl;
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        auto value = [&]()->const char* {
+            if(i + 1 >= argc){
+                printUsage(argv[0]);
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+        if(arg == "--threads")
+            opt.threads = std::max(1, std::atoi(value()));
+        else if(arg == "--tasks")
+            opt.tasks = (size_t)std::max(1LL, std::atoll(value()));
+        else if(arg == "--elements")
+            opt.elements = (size_t)std::max(1LL, std::atoll(value()));
+        else if(arg == "--repeat")
+            opt.repeat = std::max(1, std::atoi(value()));
+        else if(arg == "--impl")
+            impl = value();
+        else if(arg == "--config")
+            opt.config = value();
+        else if(arg == "--scenario")
+            opt.scenario = value();
+        else if(arg == "--quick"){
+            opt.tasks = 20000;
+            opt.elements = 1000000;
+            opt.repeat = 1;
+        }
+        else{
+            printUsage(argv[0]);
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+
+    if(impl.empty() || impl == "v1")
+        runV1Benchmarks(opt, printResult);
+    if(impl.empty() || impl == "v2")
+        runV2Benchmarks(opt, printResult);
+    return 0;
+}
@@ -0,0 +1,45 @@
+//
+//  bench.hpp
+//  benchmark
+//
+//  v1和2.0共用的基准测试接口：每个版本在自己的源文件里实现runXxxBenchmarks，
+//  这个头文件不依赖任何一个版本的线程池类型
+//
+
+#ifndef bench_hpp
+#define bench_hpp
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+//一次测量的结果，输出成一行JSON
+struct BenchResult{
+    std::string impl;//v1 / v2
+    std::string config;//队列和调度方式，例如mutex / lockfree / ws
+    std::string scenario;//测试场景
+    std::vector<std::pair<std::string, double>> metrics;
+};
+
+struct BenchOptions{
+    int threads = 4;//线程池的线程数量
+    size_t tasks = 200000;//每个吞吐量场景的任务数量
+    size_t elements = 10000000;//并行算法场景的元素数量
+    int repeat = 3;//每个场景重复次数，输出中位数
+    std::string scenario;//只运行名字里包含这个字符串的场景，为空运行全部
+    std::string config;//只运行名字里包含这个字符串的配置，为空运行全部
+};
+
+using BenchSink = std::function<void(const BenchResult&)>;
+
+//只运行名字包含filter的场景/配置
+inline bool benchSelected(const std::string& filter, const std::string& name){
+    return filter.empty() || name.find(filter) != std::string::npos;
+}
+
+void runV1Benchmarks(const BenchOptions& opt, const BenchSink& sink);
+void runV2Benchmarks(const BenchOptions& opt, const BenchSink& sink);
+
+#endif /* bench_hpp */
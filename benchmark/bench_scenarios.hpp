@@ -0,0 +1,275 @@
+//
+//  bench_scenarios.hpp
+//  benchmark
+//
+//  测试场景，按线程池适配器类型实例化。适配器需要提供：
+//  Pool(const BenchOptions&)   按配置创建并启动线程池
+//  void post(F&& f)            提交一个不关心返回值的任务
+//
+
+#ifndef bench_scenarios_hpp
+#define bench_scenarios_hpp
+
+#include "bench.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace bench{
+
+using Clock = std::chrono::steady_clock;
+
+inline double seconds(Clock::time_point begin, Clock::time_point end){
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+inline double micros(Clock::time_point begin, Clock::time_point end){
+    return std::chrono::duration<double, std::micro>(end - begin).count();
+}
+
+//忙等一段时间，模拟CPU密集的任务
+inline void burn(double us){
+    auto end = Clock::now() + std::chrono::nanoseconds((long long)(us * 1000));
+    while(Clock::now() < end){}
+}
+
+//等待计数达到目标，主线程也要让出CPU，不和线程池抢核
+inline void waitCount(const std::atomic<size_t>& count, size_t target){
+    while(count.load(std::memory_order_acquire) < target){
+        std::this_thread::yield();
+    }
+}
+
+inline double median(std::vector<double> v){
+    std::sort(v.begin(), v.end());
+    return v.empty() ? 0 : v[v.size() / 2];
+}
+
+//按百分位输出延迟，单位微秒
+inline void addPercentiles(BenchResult& r, const std::string& prefix, std::vector<double> us){
+    if(us.empty())
+        return;
+    std::sort(us.begin(), us.end());
+    auto at = [&](double p)->double {
+        size_t i = (size_t)std::ceil(p * us.size());
+        return us[std::min(us.size() - 1, i > 0 ? i - 1 : 0)];
+    };
+    r.metrics.emplace_back(prefix + "p50_us", at(0.50));
+    r.metrics.emplace_back(prefix + "p90_us", at(0.90));
+    r.metrics.emplace_back(prefix + "p99_us", at(0.99));
+    r.metrics.emplace_back(prefix + "p999_us", at(0.999));
+    r.metrics.emplace_back(prefix + "max_us", us.back());
+}
+
+//一个外部线程连续提交空任务，测量提交+执行的吞吐量
+template<typename Pool>
+BenchResult emptyTasks(const BenchOptions& opt){
+    Pool pool(opt);
+    std::vector<double> rates;
+    for(int rep = 0; rep < opt.repeat; rep++){
+        std::atomic<size_t> done(0);
+        auto begin = Clock::now();
+        for(size_t i = 0; i < opt.tasks; i++){
+            pool.post([&done](){done.fetch_add(1, std::memory_order_release);});
+        }
+        waitCount(done, opt.tasks);
+        rates.push_back(opt.tasks / seconds(begin, Clock::now()));
+    }
+    BenchResult r;
+    r.metrics.emplace_back("tasks", (double)opt.tasks);
+    r.metrics.emplace_back("tasks_per_sec", median(rates));
+    return r;
+}
+
+//线程池空闲时提交一个任务，测量从提交到任务开始执行的时间，包含唤醒睡眠线程的开销
+template<typename Pool>
+BenchResult idleLatency(const BenchOptions& opt){
+    Pool pool(opt);
+    size_t samples = std::max<size_t>(100, std::min<size_t>(opt.tasks / 40, 5000));
+    std::vector<double> us;
+    us.reserve(samples);
+    for(size_t i = 0; i < samples; i++){
+        //让线程走完自旋进入睡眠
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        std::atomic<size_t> started(0);
+        Clock::time_point startTime;
+        auto submitTime = Clock::now();
+        pool.post([&](){
+            startTime = Clock::now();
+            started.store(1, std::memory_order_release);
+        });
+        waitCount(started, 1);
+        us.push_back(micros(submitTime, startTime));
+    }
+    BenchResult r;
+    r.metrics.emplace_back("samples", (double)samples);
+    addPercentiles(r, "", std::move(us));
+    return r;
+}
+
+//按固定速率提交短任务，线程池负载约50%，测量提交到开始执行的延迟分布
+template<typename Pool>
+BenchResult pacedLatency(const BenchOptions& opt){
+    Pool pool(opt);
+    const double workUs = 5;
+    const double load = 0.5;
+    size_t count = std::max<size_t>(1000, opt.tasks / 10);
+    auto interval = std::chrono::nanoseconds((long long)(workUs * 1000 / opt.threads / load));
+    std::vector<double> us(count);
+    std::atomic<size_t> done(0);
+    auto next = Clock::now();
+    auto begin = next;
+    for(size_t i = 0; i < count; i++){
+        while(Clock::now() < next){}
+        next += interval;
+        auto submitTime = Clock::now();
+        pool.post([&us, &done, i, submitTime, workUs](){
+            us[i] = micros(submitTime, Clock::now());
+            burn(workUs);
+            done.fetch_add(1, std::memory_order_release);
+        });
+    }
+    waitCount(done, count);
+    BenchResult r;
+    r.metrics.emplace_back("tasks", (double)count);
+    r.metrics.emplace_back("load", load);
+    r.metrics.emplace_back("seconds", seconds(begin, Clock::now()));
+    addPercentiles(r, "", std::move(us));
+    return r;
+}
+
+//扇出/扇入：每个线程一个根任务，根任务在线程池内部提交子任务，所有子任务完成算一轮
+template<typename Pool>
+BenchResult fanOut(const BenchOptions& opt){
+    Pool pool(opt);
+    size_t roots = (size_t)std::max(1, opt.threads);
+    size_t children = std::max<size_t>(1, opt.tasks / roots);
+    std::vector<double> rates;
+    for(int rep = 0; rep < opt.repeat; rep++){
+        std::atomic<size_t> done(0);
+        auto begin = Clock::now();
+        for(size_t root = 0; root < roots; root++){
+            pool.post([&pool, &done, children](){
+                for(size_t i = 0; i < children; i++){
+                    pool.post([&done](){done.fetch_add(1, std::memory_order_release);});
+                }
+            });
+        }
+        waitCount(done, roots * children);
+        rates.push_back(roots * children / seconds(begin, Clock::now()));
+    }
+    BenchResult r;
+    r.metrics.emplace_back("roots", (double)roots);
+    r.metrics.emplace_back("tasks", (double)(roots * children));
+    r.metrics.emplace_back("tasks_per_sec", median(rates));
+    return r;
+}
+
+//多个外部线程同时提交空任务，测量提交端的扩展性
+template<typename Pool>
+BenchResult producers(const BenchOptions& opt, int producerCount){
+    Pool pool(opt);
+    size_t perProducer = std::max<size_t>(1, opt.tasks / producerCount);
+    std::vector<double> rates;
+    for(int rep = 0; rep < opt.repeat; rep++){
+        std::atomic<size_t> done(0);
+        auto begin = Clock::now();
+        std::vector<std::thread> threads;
+        for(int p = 0; p < producerCount; p++){
+            threads.emplace_back([&pool, &done, perProducer](){
+                for(size_t i = 0; i < perProducer; i++){
+                    pool.post([&done](){done.fetch_add(1, std::memory_order_release);});
+                }
+            });
+        }
+        for(auto& t : threads){
+            t.join();
+        }
+        waitCount(done, perProducer * producerCount);
+        rates.push_back(perProducer * producerCount / seconds(begin, Clock::now()));
+    }
+    BenchResult r;
+    r.metrics.emplace_back("producers", (double)producerCount);
+    r.metrics.emplace_back("tasks", (double)(perProducer * producerCount));
+    r.metrics.emplace_back("tasks_per_sec", median(rates));
+    return r;
+}
+
+//长短任务混合：95%的任务1us，5%的任务200us，按70%负载提交，分别统计短任务和长任务的排队延迟
+template<typename Pool>
+BenchResult mixed(const BenchOptions& opt){
+    Pool pool(opt);
+    const double shortUs = 1;
+    const double longUs = 200;
+    const double load = 0.7;
+    size_t count = std::max<size_t>(1000, opt.tasks / 20);
+    double avgUs = 0.95 * shortUs + 0.05 * longUs;
+    auto interval = std::chrono::nanoseconds((long long)(avgUs * 1000 / opt.threads / load));
+    std::vector<double> us(count);
+    std::vector<char> isLong(count);
+    std::atomic<size_t> done(0);
+    auto next = Clock::now();
+    auto begin = next;
+    for(size_t i = 0; i < count; i++){
+        while(Clock::now() < next){}
+        next += interval;
+        isLong[i] = (i % 20 == 19);
+        double work = isLong[i] ? longUs : shortUs;
+        auto submitTime = Clock::now();
+        pool.post([&us, &done, i, submitTime, work](){
+            us[i] = micros(submitTime, Clock::now());
+            burn(work);
+            done.fetch_add(1, std::memory_order_release);
+        });
+    }
+    waitCount(done, count);
+    double elapsed = seconds(begin, Clock::now());
+    std::vector<double> shortLat, longLat;
+    for(size_t i = 0; i < count; i++){
+        (isLong[i] ? longLat : shortLat).push_back(us[i]);
+    }
+    BenchResult r;
+    r.metrics.emplace_back("tasks", (double)count);
+    r.metrics.emplace_back("load", load);
+    r.metrics.emplace_back("tasks_per_sec", count / elapsed);
+    addPercentiles(r, "short_", std::move(shortLat));
+    addPercentiles(r, "long_", std::move(longLat));
+    return r;
+}
+
+//按BenchOptions里的过滤条件运行所有场景
+template<typename Pool>
+void runAll(const char* impl, const char* config, const BenchOptions& opt, const BenchSink& sink){
+    if(!benchSelected(opt.config, config))
+        return;
+    auto emit = [&](const char* scenario, BenchResult r){
+        r.impl = impl;
+        r.config = config;
+        r.scenario = scenario;
+        r.metrics.insert(r.metrics.begin(), {"threads", (double)opt.threads});
+        sink(r);
+    };
+    if(benchSelected(opt.scenario, "empty"))
+        emit("empty", emptyTasks<Pool>(opt));
+    if(benchSelected(opt.scenario, "latency_idle"))
+        emit("latency_idle", idleLatency<Pool>(opt));
+    if(benchSelected(opt.scenario, "latency_paced"))
+        emit("latency_paced", pacedLatency<Pool>(opt));
+    if(benchSelected(opt.scenario, "fanout"))
+        emit("fanout", fanOut<Pool>(opt));
+    if(benchSelected(opt.scenario, "producers")){
+        for(int p : {1, 2, 4, 8, 16, 32}){
+            emit("producers", producers<Pool>(opt, p));
+        }
+    }
+    if(benchSelected(opt.scenario, "mixed"))
+        emit("mixed", mixed<Pool>(opt));
+}
+
+} //namespace bench
+
+#endif /* bench_scenarios_hpp */
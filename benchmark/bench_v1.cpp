@@ -0,0 +1,51 @@
+//
+//  bench_v1.cpp
+//  benchmark
+//
+//  v1线程池（ThreadPool/）的基准测试，任务通过TypedTask<void>包装一个函数对象提交
+//
+
+#include "bench.hpp"
+#include "bench_scenarios.hpp"
+#include "../ThreadPool/threadpool.hpp"
+
+namespace {
+
+//把任意可调用对象包装成v1的任务类型
+class FnTask : public TypedTask<void>{
+public:
+    explicit FnTask(std::function<void()> func):func_(std::move(func)){}
+    void run() override{
+        func_();
+    }
+private:
+    std::function<void()> func_;
+};
+
+//按配置创建并启动v1线程池
+template<QueueMode queueMode, bool spin>
+class V1Pool{
+public:
+    explicit V1Pool(const BenchOptions& opt){
+        pool_.setMode(PoolMode::MODE_FIXED);
+        pool_.setQueueMode(queueMode);
+        pool_.setTaskQueMaxThreshHold(1 << 20);
+        if(!spin)
+            pool_.setIdleSpin(0, 0);
+        pool_.start(opt.threads);
+    }
+    template<typename F>
+    void post(F&& f){
+        pool_.submitTask(makeTask<FnTask>(std::forward<F>(f)));
+    }
+private:
+    ThreadPool pool_;
+};
+
+} //namespace
+
+void runV1Benchmarks(const BenchOptions& opt, const BenchSink& sink){
+    bench::runAll<V1Pool<QueueMode::MODE_MUTEX, true>>("v1", "mutex", opt, sink);
+    bench::runAll<V1Pool<QueueMode::MODE_LOCKFREE, true>>("v1", "lockfree", opt, sink);
+    bench::runAll<V1Pool<QueueMode::MODE_MUTEX, false>>("v1", "mutex-nospin", opt, sink);
+}
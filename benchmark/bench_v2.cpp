@@ -0,0 +1,181 @@
+//
+//  bench_v2.cpp
+//  benchmark
+//
+//  2.0线程池（ThreadPool2.0/，header-only）的基准测试，任务通过submitTask提交
+//
+
+#include "bench.hpp"
+#include "bench_scenarios.hpp"
+#include "../ThreadPool2.0/threadpool.hpp"
+#include "../ThreadPool2.0/coroutine.hpp"
+#include "../ThreadPool2.0/parallel.hpp"
+#include "executor.hpp"
+#include <cmath>
+#include <functional>
+#include <numeric>
+#include <random>
+
+namespace {
+
+//按配置创建并启动2.0线程池
+template<QueueMode queueMode, bool workStealing, bool spin, bool pin = false>
+class V2Pool{
+public:
+    explicit V2Pool(const BenchOptions& opt){
+        pool_.setMode(PoolMode::MODE_FIXED);
+        pool_.setQueueMode(queueMode);
+        pool_.setWorkStealing(workStealing);
+        pool_.setTaskQueMaxThreshHold(1 << 20);
+        if(!spin)
+            pool_.setIdleSpin(0, 0);
+        if(pin)
+            pool_.setAffinity(AffinityConfig());
+        pool_.start(opt.threads);
+    }
+    template<typename F>
+    void post(F&& f){
+        pool_.submitTask(std::forward<F>(f));
+    }
+    ThreadPool& get(){
+        return pool_;
+    }
+private:
+    ThreadPool pool_;
+};
+
+//编译期策略组合的执行器（executor.hpp），和线程池的同一种队列对比去掉运行时模式判断以后的开销
+template<typename Executor>
+class ExecutorPool{
+public:
+    explicit ExecutorPool(const BenchOptions& opt):executor_(1 << 20){
+        executor_.start(opt.threads);
+    }
+    template<typename F>
+    void post(F&& f){
+        executor_.post(std::forward<F>(f));
+    }
+private:
+    Executor executor_;
+};
+
+#if defined(__cpp_impl_coroutine)
+CoTask<void> hopper(ThreadPool& pool, size_t hops, std::atomic<size_t>& done){
+    for(size_t i = 0; i < hops; i++){
+        co_await pool.schedule();
+    }
+    done.fetch_add(hops, std::memory_order_release);
+}
+
+//大量同时存在的协程，每个协程反复co_await pool.schedule()，测量协程切换到线程池线程的吞吐量
+void coroutineHops(const BenchOptions& opt, const BenchSink& sink){
+    if(!benchSelected(opt.config, "coroutine") || !benchSelected(opt.scenario, "hops"))
+        return;
+    V2Pool<QueueMode::MODE_MUTEX, true, true> pool(opt);
+    size_t inflight = std::max<size_t>(1, std::min<size_t>(10000, opt.tasks / 10));
+    size_t hops = std::max<size_t>(1, opt.tasks / inflight);
+    std::vector<double> rates;
+    for(int rep = 0; rep < opt.repeat; rep++){
+        std::atomic<size_t> done(0);
+        auto begin = bench::Clock::now();
+        std::vector<PoolFuture<void>> futures;
+        for(size_t i = 0; i < inflight; i++){
+            futures.push_back(pool.get().spawn(hopper(pool.get(), hops, done)));
+        }
+        whenAll(std::move(futures)).get();
+        rates.push_back(done.load() / bench::seconds(begin, bench::Clock::now()));
+    }
+    BenchResult r;
+    r.impl = "v2";
+    r.config = "coroutine";
+    r.scenario = "hops";
+    r.metrics.emplace_back("threads", (double)opt.threads);
+    r.metrics.emplace_back("inflight", (double)inflight);
+    r.metrics.emplace_back("hops", (double)(inflight * hops));
+    r.metrics.emplace_back("hops_per_sec", bench::median(rates));
+    sink(r);
+}
+#endif
+
+//并行算法和顺序STL算法的对比：同样的输入各跑repeat次，输出耗时的中位数和加速比
+void algorithmScenario(const BenchOptions& opt, const BenchSink& sink, const char* scenario,
+                       const std::function<void()>& reset,
+                       const std::function<void()>& sequential,
+                       const std::function<void()>& parallel){
+    if(!benchSelected(opt.scenario, scenario))
+        return;
+    auto measure = [&](const std::function<void()>& run)->double {
+        std::vector<double> ms;
+        for(int rep = 0; rep < opt.repeat; rep++){
+            reset();
+            auto begin = bench::Clock::now();
+            run();
+            ms.push_back(bench::seconds(begin, bench::Clock::now()) * 1e3);
+        }
+        return bench::median(ms);
+    };
+    double seqMs = measure(sequential);
+    double parMs = measure(parallel);
+    BenchResult r;
+    r.impl = "v2";
+    r.config = "parallel";
+    r.scenario = scenario;
+    r.metrics.emplace_back("threads", (double)opt.threads);
+    r.metrics.emplace_back("elements", (double)opt.elements);
+    r.metrics.emplace_back("seq_ms", seqMs);
+    r.metrics.emplace_back("par_ms", parMs);
+    r.metrics.emplace_back("speedup", parMs > 0 ? seqMs / parMs : 0);
+    sink(r);
+}
+
+void parallelAlgorithms(const BenchOptions& opt, const BenchSink& sink){
+    if(!benchSelected(opt.config, "parallel"))
+        return;
+    V2Pool<QueueMode::MODE_MUTEX, true, true> pool(opt);
+    ThreadPool& p = pool.get();
+    size_t n = opt.elements;
+    std::vector<double> input(n);
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> dist(0, 1);
+    for(auto& x : input){
+        x = dist(rng);
+    }
+    std::vector<double> output(n);
+    volatile double sink0 = 0;
+    auto noReset = [](){};
+    auto heavy = [](double x){return std::sqrt(x) * 3.0 + std::sin(x);};
+
+    algorithmScenario(opt, sink, "reduce", noReset,
+        [&](){sink0 = std::accumulate(input.begin(), input.end(), 0.0);},
+        [&](){sink0 = parallelReduce(p, input.begin(), input.end(), 0.0);});
+    algorithmScenario(opt, sink, "transform", noReset,
+        [&](){std::transform(input.begin(), input.end(), output.begin(), heavy);},
+        [&](){parallelTransform(p, input.begin(), input.end(), output.begin(), heavy);});
+    algorithmScenario(opt, sink, "scan", noReset,
+        [&](){std::partial_sum(input.begin(), input.end(), output.begin());},
+        [&](){parallelScan(p, input.begin(), input.end(), output.begin());});
+    std::vector<uint64_t> keys(n), work(n);
+    for(auto& k : keys){
+        k = rng();
+    }
+    algorithmScenario(opt, sink, "sort", [&](){std::copy(keys.begin(), keys.end(), work.begin());},
+        [&](){std::sort(work.begin(), work.end());},
+        [&](){parallelSort(p, work.begin(), work.end());});
+    (void)sink0;
+}
+
+} //namespace
+
+void runV2Benchmarks(const BenchOptions& opt, const BenchSink& sink){
+    bench::runAll<V2Pool<QueueMode::MODE_MUTEX, false, true>>("v2", "mutex", opt, sink);
+    bench::runAll<V2Pool<QueueMode::MODE_LOCKFREE, false, true>>("v2", "lockfree", opt, sink);
+    bench::runAll<V2Pool<QueueMode::MODE_SHARDED, false, true>>("v2", "sharded", opt, sink);
+    bench::runAll<V2Pool<QueueMode::MODE_MUTEX, true, true>>("v2", "ws", opt, sink);
+    bench::runAll<V2Pool<QueueMode::MODE_MUTEX, true, true, true>>("v2", "ws-pinned", opt, sink);
+    bench::runAll<V2Pool<QueueMode::MODE_MUTEX, false, false>>("v2", "mutex-nospin", opt, sink);
+    bench::runAll<ExecutorPool<FastExecutor>>("v2", "executor", opt, sink);
+#if defined(__cpp_impl_coroutine)
+    coroutineHops(opt, sink);
+#endif
+    parallelAlgorithms(opt, sink);
+}
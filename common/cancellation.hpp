@@ -0,0 +1,75 @@
+//
+//  cancellation.hpp
+//  common
+//
+//  协作式取消：CancellationSource取消，提交任务时传入它的CancellationToken
+//  同一个source的所有token共享一个标志，取消一组任务只需要一次原子写
+//  v1和2.0共用
+//
+
+#ifndef cancellation_hpp
+#define cancellation_hpp
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "slaballoc.hpp"
+
+//任务在开始执行前被取消，future.get()抛出这个异常
+//排队超时的TaskExpiredError也从它派生，catch这个类型可以同时处理两种情况
+class TaskCancelledError : public std::runtime_error{
+public:
+    TaskCancelledError():std::runtime_error("task cancelled"){}
+protected:
+    explicit TaskCancelledError(const std::string& what):std::runtime_error(what){}
+};
+
+class CancellationSource;
+
+//任务持有的取消标志，可以拷贝；默认构造的token永远不会被取消
+class CancellationToken{
+public:
+    CancellationToken() = default;
+
+    bool cancelled() const{
+        return state_ != nullptr && state_->load(std::memory_order_acquire);
+    }
+    //正在执行的任务检查是否已经被取消，取消时抛出TaskCancelledError，结束任务
+    void throwIfCancelled() const{
+        if(cancelled())
+            throw TaskCancelledError();
+    }
+    //能不能被取消
+    bool cancellable() const{
+        return state_ != nullptr;
+    }
+
+private:
+    friend class CancellationSource;
+    explicit CancellationToken(std::shared_ptr<std::atomic_bool> state):state_(std::move(state)){}
+
+    std::shared_ptr<std::atomic_bool> state_;
+};
+
+//取消的一方：source.cancel()以后，用source.token()提交的所有任务在取出时都不再执行
+class CancellationSource{
+public:
+    CancellationSource():state_(makeSlabShared<std::atomic_bool>(false)){}
+
+    CancellationToken token() const{
+        return CancellationToken(state_);
+    }
+    //O(1)：只设置共享的标志，不遍历任务队列，任务在被取出时检查
+    void cancel(){
+        state_->store(true, std::memory_order_release);
+    }
+    bool cancelled() const{
+        return state_->load(std::memory_order_acquire);
+    }
+
+private:
+    std::shared_ptr<std::atomic_bool> state_;
+};
+
+#endif /* cancellation_hpp */
@@ -0,0 +1,120 @@
+//
+//  elastic.hpp
+//  common
+//
+//  cached模式的弹性伸缩控制器：控制线程周期性采样排队任务数量和吞吐量，决定扩容还是缩容
+//  提交任务的线程和空闲线程都不再决定线程数量，v1和2.0共用
+//
+
+#ifndef elastic_hpp
+#define elastic_hpp
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+//cached模式弹性伸缩的参数，线程数量上限仍然由setThreadSizeThreshHold设置
+struct ElasticConfig{
+    int minThreadSize = -1;//线程数量下限，小于0表示使用start时的初始线程数量
+    std::chrono::milliseconds sampleInterval{20};//控制线程的采样周期
+    std::chrono::microseconds growWaitTime{1000};//估算的平均排队时间超过这个值需要扩容
+    int growSamples = 2;//连续多少次采样超过阈值才扩容，过滤掉短暂的毛刺
+    int maxGrowStep = 4;//一次最多创建的线程数量
+    std::chrono::microseconds shrinkWaitTime{100};//平均排队时间低于这个值并且有空闲线程才算空闲
+    std::chrono::milliseconds shrinkIdleTime = std::chrono::seconds(10);//持续空闲多久开始缩容
+    std::chrono::milliseconds cooldown{200};//两次调整之间的最小间隔
+};
+
+//每个采样周期调用一次sample：用Little定律估算平均排队时间W = L / λ（L是排队任务数量，λ是两次采样之间的吞吐量），
+//W持续超过growWaitTime就扩容；有空闲线程并且W持续低于shrinkWaitTime超过shrinkIdleTime就缩容
+//扩容和缩容的阈值不同，再加上冷却时间，避免线程数量来回抖动
+class ElasticController{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    //采样时线程池的状态
+    struct Sample{
+        uint64_t completed = 0;//累计执行完的任务数量
+        size_t queued = 0;//还没开始执行的任务数量
+        int threadSize = 0;//当前的线程数量
+        int idleThreadSize = 0;//空闲线程数量
+    };
+    //grow大于0表示创建grow个线程；shrink为true表示回收一个空闲线程，回收成功以后调用shrunk
+    struct Decision{
+        int grow = 0;
+        bool shrink = false;
+    };
+
+    ElasticController(const ElasticConfig& config, int maxThreadSize, uint64_t completed, Clock::time_point now)
+    :config_(config)
+    ,maxThreadSize_(maxThreadSize)
+    ,lastSample_(now)
+    ,lastScale_(now)
+    ,idleSince_(Clock::time_point::max())
+    ,lastCompleted_(completed)
+    ,overloadSamples_(0)
+    {}
+
+    const ElasticConfig& config() const{
+        return config_;
+    }
+
+    //线程数量下限：没有设置时是初始线程数量，resize会修改初始线程数量，所以每次采样重新计算
+    int minThreadSize(int initThreadSize) const{
+        return config_.minThreadSize >= 0 ? config_.minThreadSize : initThreadSize;
+    }
+
+    Decision sample(const Sample& s, Clock::time_point now){
+        Decision decision;
+        double seconds = std::chrono::duration<double>(now - lastSample_).count();
+        double throughput = seconds > 0 ? (s.completed - lastCompleted_) / seconds : 0;
+        lastSample_ = now;
+        lastCompleted_ = s.completed;
+
+        double waitUs = 0;
+        if(s.queued > 0){
+            //一个采样周期内一个任务都没完成，说明所有线程都被长任务占住了
+            waitUs = throughput > 0 ? s.queued / throughput * 1e6 : std::numeric_limits<double>::infinity();
+        }
+
+        //扩容：连续growSamples次采样排队时间都超过阈值
+        overloadSamples_ = waitUs > config_.growWaitTime.count() ? overloadSamples_ + 1 : 0;
+        if(overloadSamples_ >= config_.growSamples && s.threadSize < maxThreadSize_ && now - lastScale_ >= config_.cooldown){
+            decision.grow = std::min({config_.maxGrowStep, maxThreadSize_ - s.threadSize, (int)std::min<size_t>(s.queued, INT32_MAX)});
+            lastScale_ = now;
+            overloadSamples_ = 0;
+            idleSince_ = Clock::time_point::max();
+            return decision;
+        }
+
+        //缩容：持续空闲shrinkIdleTime以后，每个冷却周期回收一个线程
+        if(s.idleThreadSize > 0 && waitUs < config_.shrinkWaitTime.count()){
+            if(idleSince_ == Clock::time_point::max())
+                idleSince_ = now;
+        }
+        else{
+            idleSince_ = Clock::time_point::max();
+        }
+        decision.shrink = idleSince_ != Clock::time_point::max() && now - idleSince_ >= config_.shrinkIdleTime &&
+                          now - lastScale_ >= config_.cooldown;
+        return decision;
+    }
+
+    //回收了一个线程，开始新的冷却周期
+    void shrunk(Clock::time_point now){
+        lastScale_ = now;
+    }
+
+private:
+    const ElasticConfig config_;
+    const int maxThreadSize_;
+    Clock::time_point lastSample_;
+    Clock::time_point lastScale_;
+    Clock::time_point idleSince_;
+    uint64_t lastCompleted_;
+    int overloadSamples_;
+};
+
+#endif /* elastic_hpp */
@@ -0,0 +1,151 @@
+//
+//  eventcount.hpp
+//  common
+//
+//  空闲线程的睡眠/唤醒：eventcount，Linux上直接用futex
+//
+
+#ifndef eventcount_hpp
+#define eventcount_hpp
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <thread>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+//自旋等待时降低CPU占用，让出流水线给同一个核上的另一个超线程
+inline void cpuRelax(){
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+//用法和条件变量相反，等待方不需要持有锁：
+//  key = ec.prepareWait();     登记为等待者
+//  if(条件满足){ ec.cancelWait(); ... }
+//  else ec.wait(key);          prepareWait之后没有notify才会睡眠
+//通知方先让条件满足，再调用notify。没有等待者时notify只有一次原子读，不会进入内核
+class EventCount{
+public:
+    using Key = uint32_t;
+
+    EventCount():epoch_(0),waiters_(0){}
+    EventCount(const EventCount&) = delete;
+    EventCount& operator=(const EventCount&) = delete;
+
+    Key prepareWait(){
+        waiters_.fetch_add(1, std::memory_order_seq_cst);
+        //和notify里的fence配对：要么等待方看到条件满足，要么通知方看到等待者
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return epoch_.load(std::memory_order_acquire);
+    }
+
+    void cancelWait(){
+        waiters_.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    //睡眠直到prepareWait之后有notify，timeout为0表示一直等待，超时返回false
+    bool wait(Key key, std::chrono::nanoseconds timeout = std::chrono::nanoseconds(0)){
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        bool notified = true;
+        while(epoch_.load(std::memory_order_acquire) == key){
+            if(timeout.count() > 0){
+                auto remaining = deadline - std::chrono::steady_clock::now();
+                if(remaining.count() <= 0){
+                    notified = false;
+                    break;
+                }
+                sleep(key, std::chrono::duration_cast<std::chrono::nanoseconds>(remaining));
+            }
+            else{
+                sleep(key, timeout);
+            }
+        }
+        waiters_.fetch_sub(1, std::memory_order_seq_cst);
+        return notified;
+    }
+
+    //最多唤醒count个等待者
+    void notify(size_t count = 1){
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(waiters_.load(std::memory_order_relaxed) == 0)
+            return;
+        epoch_.fetch_add(1, std::memory_order_release);
+        wake(count);
+    }
+
+    void notifyAll(){
+        notify(INT_MAX);
+    }
+
+    //当前登记的等待者数量，近似值
+    int waiters() const{
+        return waiters_.load(std::memory_order_relaxed);
+    }
+
+private:
+#if defined(__linux__)
+    void sleep(Key key, std::chrono::nanoseconds timeout){
+        struct timespec ts;
+        struct timespec* pts = nullptr;
+        if(timeout.count() > 0){
+            ts.tv_sec = (time_t)(timeout.count() / 1000000000);
+            ts.tv_nsec = (long)(timeout.count() % 1000000000);
+            pts = &ts;
+        }
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAIT_PRIVATE, key, pts, nullptr, 0);
+    }
+    void wake(size_t count){
+        int n = count > (size_t)INT_MAX ? INT_MAX : (int)count;
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAKE_PRIVATE, n, nullptr, nullptr, 0);
+    }
+#else
+    //没有futex的平台退化成条件变量，锁只在真正睡眠和唤醒时使用
+    void sleep(Key key, std::chrono::nanoseconds timeout){
+        std::unique_lock<std::mutex> lock(mtx_);
+        auto changed = [&]()->bool {return epoch_.load(std::memory_order_acquire) != key;};
+        if(timeout.count() > 0){
+            cond_.wait_for(lock, timeout, changed);
+        }
+        else{
+            cond_.wait(lock, changed);
+        }
+    }
+    void wake(size_t count){
+        std::unique_lock<std::mutex> lock(mtx_);
+        if(count >= (size_t)waiters_.load(std::memory_order_relaxed)){
+            cond_.notify_all();
+        }
+        else{
+            for(size_t k = 0; k < count; k++){
+                cond_.notify_one();
+            }
+        }
+    }
+    std::mutex mtx_;
+    std::condition_variable cond_;
+#endif
+
+private:
+    alignas(64) std::atomic<uint32_t> epoch_;//每次notify加一，futex等待的地址
+    std::atomic<int> waiters_;//已经prepareWait还没有返回的等待者数量
+};
+
+#endif /* eventcount_hpp */
@@ -0,0 +1,689 @@
+//
+//  executor.hpp
+//  common
+//
+//  按编译期策略组合的执行器核心：队列、空闲/唤醒、线程增长、统计都是模板参数，
+//  BasicExecutor的所有策略在编译期选定，没有选用的功能不会编译进工作线程的循环
+//  v1和2.0线程池用同样的队列策略、workerLoop、SpinParkIdle和增长策略：队列模式在线程启动前选定，
+//  工作线程的循环按选中的策略实例化，取任务时不判断模式；提交一方通过TaskQueue的虚函数放入任务
+//
+
+#ifndef executor_hpp
+#define executor_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "eventcount.hpp"
+#include "mpmcqueue.hpp"
+#include "shardedqueue.hpp"
+#include "taskfunc.hpp"
+#include "poolstats.hpp"
+#include "slaballoc.hpp"
+#include "overload.hpp"
+
+//======== 空闲/唤醒策略 ========
+//工作线程没有任务时调用waitForTask(take, pending, park)：
+//  take()       不睡眠地取一个任务，取到返回true
+//  pending()    还有没被取走的任务
+//  park(key)    已经登记为等待者并且再检查一遍仍然没有任务，必须调用cancelWait()或者sleep(key)之一，
+//               返回false表示线程要退出
+//提交任务的一方放入count个任务后调用wake(count)
+
+//先自旋、再让出CPU，还是没有任务才在EventCount上睡眠，被唤醒以后重新自旋
+//有线程在自旋时提交任务不需要唤醒，最后一个自旋的线程取到任务时唤醒一个线程接替它继续找任务
+class SpinParkIdle{
+public:
+    static constexpr int DEFAULT_SPIN_COUNT = 128;//睡眠前自旋检查任务的次数
+    static constexpr int DEFAULT_YIELD_COUNT = 8;//自旋之后让出CPU再检查任务的次数
+
+    explicit SpinParkIdle(int spinCount = DEFAULT_SPIN_COUNT, int yieldCount = DEFAULT_YIELD_COUNT)
+    :spinCount_(std::max(spinCount, 0))
+    ,yieldCount_(std::max(yieldCount, 0))
+    ,spinningThreadSize_(0)
+    {}
+    SpinParkIdle(const SpinParkIdle&) = delete;
+    SpinParkIdle& operator=(const SpinParkIdle&) = delete;
+
+    //只在工作线程启动之前修改
+    void setSpin(int spinCount, int yieldCount){
+        spinCount_ = std::max(spinCount, 0);
+        yieldCount_ = std::max(yieldCount, 0);
+    }
+    int spinCount() const{
+        return spinCount_;
+    }
+    int yieldCount() const{
+        return yieldCount_;
+    }
+
+    template<typename Take, typename Pending, typename Park>
+    bool waitForTask(Take&& take, Pending&& pending, Park&& park){
+        spinningThreadSize_++;
+        for(;;){
+            for(int i = 0; i < spinCount_ + yieldCount_; i++){
+                if(i < spinCount_){
+                    cpuRelax();
+                }
+                else{
+                    std::this_thread::yield();
+                }
+                if(take()){
+                    //最后一个自旋的线程取到了任务，如果还有任务，唤醒一个线程接替它继续找任务
+                    if(spinningThreadSize_.fetch_sub(1) == 1 && pending()){
+                        wake();
+                    }
+                    return true;
+                }
+            }
+            spinningThreadSize_--;
+            //先登记为等待者再检查一遍任务和退出条件，和wake配合，避免丢失唤醒
+            EventCount::Key key = event_.prepareWait();
+            if(take()){
+                event_.cancelWait();
+                return true;
+            }
+            if(!park(key))
+                return false;
+            spinningThreadSize_++;
+        }
+    }
+
+    //登记为等待者，给在idle之外等待其他条件的线程用（2.0的helpUntil），再检查一遍条件以后cancelWait或者sleep
+    EventCount::Key prepareWait(){
+        return event_.prepareWait();
+    }
+    void cancelWait(){
+        event_.cancelWait();
+    }
+    //睡眠到被唤醒或者超时，timeout为0表示不超时，被唤醒返回true
+    bool sleep(EventCount::Key key, std::chrono::nanoseconds timeout = std::chrono::nanoseconds(0)){
+        return event_.wait(key, timeout);
+    }
+
+    //放入count个新任务后，唤醒需要的空闲线程数量：正在自旋的线程会取到新任务，只唤醒不够的部分
+    void wake(size_t count = 1){
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int spinning = spinningThreadSize_.load(std::memory_order_relaxed);
+        if(count <= (size_t)spinning)
+            return;
+        event_.notify(count - spinning);
+    }
+    //不管有没有线程在自旋，唤醒一个睡眠的线程，用于通知线程退出
+    void notify(){
+        event_.notify();
+    }
+    void notifyAll(){
+        event_.notifyAll();
+    }
+
+private:
+    int spinCount_;
+    int yieldCount_;
+    EventCount event_;//没有任务的线程在这里睡眠
+    std::atomic_int spinningThreadSize_;//正在自旋找任务的线程数量，有线程自旋时提交任务不需要唤醒
+};
+
+//不自旋，没有任务直接睡眠：空闲时不占用CPU，代价是每次提交都可能要唤醒线程
+class ParkIdle{
+public:
+    ParkIdle() = default;
+    ParkIdle(const ParkIdle&) = delete;
+    ParkIdle& operator=(const ParkIdle&) = delete;
+
+    template<typename Take, typename Pending, typename Park>
+    bool waitForTask(Take&& take, Pending&&, Park&& park){
+        for(;;){
+            EventCount::Key key = event_.prepareWait();
+            if(take()){
+                event_.cancelWait();
+                return true;
+            }
+            if(!park(key))
+                return false;
+        }
+    }
+
+    void cancelWait(){
+        event_.cancelWait();
+    }
+    bool sleep(EventCount::Key key, std::chrono::nanoseconds timeout = std::chrono::nanoseconds(0)){
+        return event_.wait(key, timeout);
+    }
+    void wake(size_t count = 1){
+        event_.notify(count);
+    }
+    void notify(){
+        event_.notify();
+    }
+    void notifyAll(){
+        event_.notifyAll();
+    }
+
+private:
+    EventCount event_;
+};
+
+//======== 队列策略 ========
+//Queue<T>提供tryPush(T&&)（满时返回false，item保持不变）、tryPop(T&)、tryPushBulk(count, gen)、size()、full()，
+//make<T>(capacity, threadSize)创建队列
+
+//互斥锁保护的有界std::deque，size是无锁读取的长度，队列空时取任务不需要加锁
+template<typename T>
+class LockedQueue{
+public:
+    explicit LockedQueue(size_t capacity)
+    :capacity_(capacity > 0 ? capacity : 1)
+    ,size_(0)
+    {}
+    LockedQueue(const LockedQueue&) = delete;
+    LockedQueue& operator=(const LockedQueue&) = delete;
+
+    bool tryPush(T&& item){
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(que_.size() >= capacity_)
+            return false;
+        que_.push_back(std::move(item));
+        size_.store(que_.size(), std::memory_order_relaxed);
+        return true;
+    }
+    bool tryPop(T& item){
+        if(size_.load(std::memory_order_acquire) == 0)
+            return false;
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(que_.empty())
+            return false;
+        item = std::move(que_.front());
+        que_.pop_front();
+        size_.store(que_.size(), std::memory_order_relaxed);
+        return true;
+    }
+    //一次加锁放入剩余容量允许的元素，gen(k)生成第k个，返回放入的数量
+    template<typename Gen>
+    size_t tryPushBulk(size_t count, Gen&& gen){
+        std::lock_guard<std::mutex> lock(mtx_);
+        size_t n = std::min(count, capacity_ - que_.size());
+        for(size_t k = 0; k < n; k++){
+            que_.push_back(gen(k));
+        }
+        size_.store(que_.size(), std::memory_order_relaxed);
+        return n;
+    }
+    size_t size() const{
+        return size_.load(std::memory_order_acquire);
+    }
+    bool full() const{
+        return size() >= capacity_;
+    }
+
+private:
+    const size_t capacity_;
+    std::mutex mtx_;
+    std::deque<T, SlabAllocator<T>> que_;//块从slab缓存分配
+    std::atomic<size_t> size_;
+};
+
+struct MutexQueuePolicy{
+    template<typename T>
+    using Queue = LockedQueue<T>;
+    template<typename T>
+    static std::unique_ptr<Queue<T>> make(size_t capacity, int){
+        return std::make_unique<Queue<T>>(capacity);
+    }
+};
+
+//有界无锁环形队列
+struct LockFreeQueuePolicy{
+    template<typename T>
+    using Queue = BoundedMpmcQueue<T>;
+    template<typename T>
+    static std::unique_ptr<Queue<T>> make(size_t capacity, int){
+        return std::make_unique<Queue<T>>(capacity);
+    }
+};
+
+//分片队列，分片数量和线程数量相同（至少2个）
+struct ShardedQueuePolicy{
+    template<typename T>
+    using Queue = ShardedQueue<T>;
+    template<typename T>
+    static std::unique_ptr<Queue<T>> make(size_t capacity, int threadSize){
+        return std::make_unique<Queue<T>>(capacity, (size_t)std::max(threadSize, 2));
+    }
+};
+
+//======== 线程池的全局任务队列 ========
+
+//v1和2.0线程池的全局任务队列：按队列模式选一个队列策略创建PolicyTaskQueue，
+//提交一方（submit、过载处理、关闭）通过虚函数访问，工作线程的循环按同一个策略实例化，
+//用queueOf<QueuePolicy>直接调用具体的队列
+template<typename T>
+class TaskQueue{
+public:
+    //批量放入时生成元素的函数引用，不分配内存，只在tryPushBulk调用期间使用
+    class Gen{
+    public:
+        template<typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Gen>::value>::type>
+        Gen(F& f)
+        :ctx_(&f)
+        ,call_([](void* ctx, size_t k)->T {return (*static_cast<F*>(ctx))(k);})
+        {}
+        T operator()(size_t k) const{
+            return call_(ctx_, k);
+        }
+    private:
+        void* ctx_;
+        T (*call_)(void*, size_t);
+    };
+
+    virtual ~TaskQueue() = default;
+    virtual bool tryPush(T&& item) = 0;
+    virtual bool tryPop(T& item) = 0;
+    virtual size_t tryPushBulk(size_t count, const Gen& gen) = 0;
+    virtual size_t size() const = 0;
+    virtual bool full() const = 0;
+};
+
+template<typename QueuePolicy, typename T>
+class PolicyTaskQueue final : public TaskQueue<T>{
+public:
+    using Queue = typename QueuePolicy::template Queue<T>;
+    using Gen = typename TaskQueue<T>::Gen;
+
+    PolicyTaskQueue(size_t capacity, int threadSize)
+    :que_(QueuePolicy::template make<T>(capacity, threadSize))
+    {}
+
+    Queue& queue(){
+        return *que_;
+    }
+    bool tryPush(T&& item) override{
+        return que_->tryPush(std::move(item));
+    }
+    bool tryPop(T& item) override{
+        return que_->tryPop(item);
+    }
+    size_t tryPushBulk(size_t count, const Gen& gen) override{
+        return que_->tryPushBulk(count, gen);
+    }
+    size_t size() const override{
+        return que_->size();
+    }
+    bool full() const override{
+        return que_->full();
+    }
+
+private:
+    std::unique_ptr<Queue> que_;
+};
+
+//按队列策略取出具体的队列，调用方保证que是用这个策略创建的
+template<typename QueuePolicy, typename T>
+typename QueuePolicy::template Queue<T>& queueOf(TaskQueue<T>& que){
+    return static_cast<PolicyTaskQueue<QueuePolicy, T>&>(que).queue();
+}
+
+//把运行时的开关换成编译期常量调用f(std::true_type())或者f(std::false_type())，线程启动时选定一次
+template<typename F>
+void withFlag(bool flag, F&& f){
+    if(flag)
+        f(std::true_type());
+    else
+        f(std::false_type());
+}
+
+//======== 线程增长策略 ========
+//ELASTIC为true时线程数量会变化，工作线程维护空闲线程数量
+//park(idle, key, retire)：空闲线程登记为等待者以后睡眠，retire()让线程退出并返回true，
+//                         或者返回false表示不能退出；park返回false表示线程要退出
+
+//固定数量的线程，不维护空闲线程数量
+struct FixedGrowth{
+    static constexpr bool ELASTIC = false;
+
+    template<typename Idle, typename Retire>
+    bool park(Idle& idle, EventCount::Key key, Retire&&) const{
+        idle.sleep(key);
+        return true;
+    }
+};
+
+//排队的任务比空闲线程多时创建新线程，最多maxThreadSize个，超过初始数量的线程空闲idleTime以后退出
+struct CachedGrowth{
+    static constexpr bool ELASTIC = true;
+    int maxThreadSize = 10;
+    std::chrono::milliseconds idleTime = std::chrono::seconds(10);
+
+    template<typename Idle, typename Retire>
+    bool park(Idle& idle, EventCount::Key key, Retire&& retire) const{
+        if(idle.sleep(key, idleTime))
+            return true;
+        return !retire();
+    }
+};
+
+//线程数量会变化，但是由外部（v1和2.0线程池的控制线程、2.0的resize）决定回收哪些线程，空闲线程自己不计时
+struct ControlledGrowth{
+    static constexpr bool ELASTIC = true;
+
+    template<typename Idle, typename Retire>
+    bool park(Idle& idle, EventCount::Key key, Retire&&) const{
+        idle.sleep(key);
+        return true;
+    }
+};
+
+//======== 统计策略 ========
+
+//不统计：记录函数全部是空的内联函数，不管THREADPOOL_STATS有没有打开
+struct NoInstrumentation{
+    struct Worker{
+        void taskRun(uint64_t, uint64_t, uint64_t){}
+        void park(){}
+        void wakeup(){}
+    };
+    static constexpr uint64_t now(){
+        return 0;
+    }
+    Worker acquire(){
+        return Worker();
+    }
+    void release(Worker&){}
+    PoolStats snapshot() const{
+        return PoolStats();
+    }
+};
+
+//和线程池的stats()相同的每线程计数器和直方图，THREADPOOL_STATS为0时和NoInstrumentation一样是空操作
+struct PoolStatsInstrumentation{
+    using Worker = WorkerStatsRef;
+    static uint64_t now(){
+        return WorkerStatsRef::now();
+    }
+    Worker acquire(){
+        return registry_.acquire();
+    }
+    void release(Worker& worker){
+        registry_.release(worker);
+    }
+    PoolStats snapshot() const{
+        return registry_.snapshot();
+    }
+private:
+    StatsRegistry registry_;
+};
+
+//======== 工作线程循环 ========
+
+//BasicExecutor、v1和2.0线程池共用的工作线程循环：取任务，没有任务时按空闲策略自旋、睡眠，执行任务
+//  take(task)  不睡眠地取一个任务，取到返回true
+//  pending()   还有没被取走的任务，空闲策略用它决定要不要唤醒接替的线程
+//  park(key)   见SpinParkIdle::waitForTask，返回false表示线程要退出
+//  run(task)   执行任务，返回false表示线程执行完这个任务就退出
+//线程池在线程启动时选定队列策略和增长策略，按它们实例化take和park，循环里没有运行时的模式判断
+template<typename Task, typename Idle, typename Take, typename Pending, typename Park, typename Run>
+void workerLoop(Idle& idle, Take&& take, Pending&& pending, Park&& park, Run&& run){
+    for(;;){
+        Task task;
+        if(!take(task) && !idle.waitForTask([&](){return take(task);}, pending, park))
+            return;
+        if(!run(task))
+            return;
+    }
+}
+
+//======== 执行器 ========
+
+//submit提交的任务：执行函数，把返回值或者异常交给promise，没有执行就被丢弃时future.get()抛出error
+template<typename RType, typename Func>
+struct ExecutorTask{
+    Func func;
+    std::promise<RType> promise;
+
+    void operator()(){
+        try{
+            if constexpr(std::is_void<RType>::value){
+                func();
+                promise.set_value();
+            }
+            else{
+                promise.set_value(func());
+            }
+        }
+        catch(...){
+            promise.set_exception(std::current_exception());
+        }
+    }
+    void abandon(std::exception_ptr error){
+        promise.set_exception(error);
+    }
+};
+
+//start之前通过idle()/growth()配置策略，shutdown（析构）时执行完已经提交的任务再退出
+//post和shutdown不能同时调用
+template<typename QueuePolicy = LockFreeQueuePolicy,
+         typename IdlePolicy = SpinParkIdle,
+         typename GrowthPolicy = FixedGrowth,
+         typename InstrumentPolicy = NoInstrumentation>
+class BasicExecutor{
+public:
+    using Task = TaskFunc;
+    using Queue = typename QueuePolicy::template Queue<Task>;
+    using Worker = typename InstrumentPolicy::Worker;
+
+    static constexpr size_t DEFAULT_CAPACITY = 1024;
+
+    explicit BasicExecutor(size_t capacity = DEFAULT_CAPACITY)
+    :capacity_(capacity)
+    ,running_(false)
+    ,initThreadSize_(0)
+    ,threadSize_(0)
+    ,idleThreadSize_(0)
+    ,nextThreadId_(0)
+    {}
+    ~BasicExecutor(){
+        shutdown();
+    }
+    BasicExecutor(const BasicExecutor&) = delete;
+    BasicExecutor& operator=(const BasicExecutor&) = delete;
+
+    IdlePolicy& idle(){
+        return idle_;
+    }
+    GrowthPolicy& growth(){
+        return growth_;
+    }
+
+    void start(int initThreadSize = (int)std::thread::hardware_concurrency()){
+        std::lock_guard<std::mutex> lock(threadMtx_);
+        if(running_)
+            return;
+        initThreadSize_ = std::max(initThreadSize, 1);
+        queue_ = QueuePolicy::template make<Task>(capacity_, initThreadSize_);
+        running_ = true;
+        for(int i = 0; i < initThreadSize_; i++){
+            addThread();
+        }
+    }
+
+    //队列满或者执行器没有运行时立即返回false，task保持不变
+    bool tryPost(Task& task){
+        if(!running_.load(std::memory_order_relaxed))
+            return false;
+        task.setEnqueueTime(InstrumentPolicy::now());
+        if(!queue_->tryPush(std::move(task)))
+            return false;
+        if constexpr(GrowthPolicy::ELASTIC){
+            growIfNeeded();
+        }
+        idle_.wake();
+        return true;
+    }
+
+    //队列满时让出CPU等待工作线程腾出位置，执行器没有运行时任务被丢弃（abandon为TaskRejectedError）
+    void post(Task task){
+        while(!tryPost(task)){
+            if(!running_.load(std::memory_order_relaxed)){
+                task.abandon(std::make_exception_ptr(TaskRejectedError()));
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    template<typename Func, typename... Args>
+    auto submit(Func&& func, Args&&... args) -> std::future<decltype(func(args...))>{
+        using RType = decltype(func(args...));
+        auto call = [f = std::forward<Func>(func), tup = std::make_tuple(std::forward<Args>(args)...)]() mutable -> RType {
+            return std::apply(f, tup);
+        };
+        ExecutorTask<RType, decltype(call)> task{std::move(call), std::promise<RType>()};
+        std::future<RType> result = task.promise.get_future();
+        post(Task(std::move(task)));
+        return result;
+    }
+
+    //执行完队列里的任务，等待所有线程退出
+    void shutdown(){
+        std::unordered_map<int, std::thread> threads;
+        std::vector<std::thread> exited;
+        {
+            std::lock_guard<std::mutex> lock(threadMtx_);
+            if(!running_)
+                return;
+            running_ = false;
+            threads.swap(threads_);
+            exited.swap(exitedThreads_);
+        }
+        idle_.notifyAll();
+        for(auto& t : threads){
+            t.second.join();
+        }
+        for(auto& t : exited){
+            t.join();
+        }
+        //和shutdown同时提交、没有被线程取走的任务
+        Task task;
+        while(queue_->tryPop(task)){
+            task.abandon(std::make_exception_ptr(TaskRejectedError()));
+            task.reset();
+        }
+    }
+
+    int threadSize() const{
+        return threadSize_.load(std::memory_order_relaxed);
+    }
+    size_t pendingTaskSize() const{
+        return queue_ != nullptr ? queue_->size() : 0;
+    }
+    PoolStats stats() const{
+        return instrument_.snapshot();
+    }
+
+private:
+    //调用方需要持有threadMtx_
+    void addThread(){
+        int threadid = nextThreadId_++;
+        threadSize_++;
+        if constexpr(GrowthPolicy::ELASTIC){
+            idleThreadSize_++;
+        }
+        threads_.emplace(threadid, std::thread(&BasicExecutor::threadFunc, this, threadid));
+    }
+
+    void threadFunc(int threadid){
+        Worker stats = instrument_.acquire();
+        workerLoop<Task>(idle_,
+            [&](Task& task){return queue_->tryPop(task);},
+            [&](){return queue_->size() > 0;},
+            [&](EventCount::Key key)->bool {
+                if(!running_.load(std::memory_order_acquire)){
+                    idle_.cancelWait();
+                    return false;
+                }
+                stats.park();
+                SlabHeap::flush();
+                if(!growth_.park(idle_, key, [&](){return retireThread(threadid);}))
+                    return false;
+                stats.wakeup();
+                return true;
+            },
+            [&](Task& task){
+                uint64_t start = InstrumentPolicy::now();
+                if constexpr(GrowthPolicy::ELASTIC){
+                    idleThreadSize_--;
+                }
+                task();
+                if constexpr(GrowthPolicy::ELASTIC){
+                    idleThreadSize_++;
+                }
+                stats.taskRun(task.enqueueTime(), start, InstrumentPolicy::now());
+                return true;
+            });
+        instrument_.release(stats);
+    }
+
+    //排队的任务比空闲线程多，并且没有达到线程数量上限时创建一个新线程
+    void growIfNeeded(){
+        if(queue_->size() <= (size_t)idleThreadSize_.load(std::memory_order_relaxed)
+           || threadSize_.load(std::memory_order_relaxed) >= growth_.maxThreadSize)
+            return;
+        std::lock_guard<std::mutex> lock(threadMtx_);
+        if(running_ && threadSize_ < growth_.maxThreadSize)
+            addThread();
+    }
+
+    //空闲超时的线程退出，线程数量不低于初始数量，返回false表示不需要退出
+    //线程不能join自己：把自己的线程对象留给下一个退出的线程或者shutdown去join
+    bool retireThread(int threadid){
+        std::vector<std::thread> exited;
+        {
+            std::lock_guard<std::mutex> lock(threadMtx_);
+            if(!running_ || threadSize_ <= initThreadSize_)
+                return false;
+            threadSize_--;
+            idleThreadSize_--;
+            exited.swap(exitedThreads_);
+            exitedThreads_.push_back(std::move(threads_[threadid]));
+            threads_.erase(threadid);
+        }
+        for(auto& t : exited){
+            t.join();
+        }
+        return true;
+    }
+
+private:
+    const size_t capacity_;
+    std::unique_ptr<Queue> queue_;
+    IdlePolicy idle_;
+    GrowthPolicy growth_;
+    InstrumentPolicy instrument_;
+
+    std::mutex threadMtx_;//保护线程列表和启动/关闭
+    std::unordered_map<int, std::thread> threads_;
+    std::vector<std::thread> exitedThreads_;//已经退出还没有join的线程
+    std::atomic_bool running_;
+    int initThreadSize_;
+    std::atomic_int threadSize_;
+    std::atomic_int idleThreadSize_;//只有ELASTIC的增长策略维护
+    int nextThreadId_;
+};
+
+//固定数量的线程、无锁队列、不统计：工作线程的循环只有出队、执行任务和空闲时的自旋-睡眠
+using FastExecutor = BasicExecutor<LockFreeQueuePolicy, SpinParkIdle, FixedGrowth, NoInstrumentation>;
+
+#endif /* executor_hpp */
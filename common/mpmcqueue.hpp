@@ -0,0 +1,163 @@
+//
+//  mpmcqueue.hpp
+//  common
+//
+//  有界无锁多生产者多消费者环形队列
+//  参考：Dmitry Vyukov, Bounded MPMC queue
+//
+
+#ifndef mpmcqueue_hpp
+#define mpmcqueue_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+//每个槽位带一个序号seq：
+//seq == pos       槽位空闲，可以写入第pos个元素
+//seq == pos + 1   槽位已写入第pos个元素，可以读出
+//入队时“容量检查”和“占位”是同一个CAS，不需要taskQue_.size() < threshhold这种加锁判断
+template<typename T>
+class BoundedMpmcQueue{
+public:
+    explicit BoundedMpmcQueue(size_t capacity)
+    :capacity_(capacity > 0 ? capacity : 1)
+    ,cells_(new Cell[capacity_])
+    ,enqueuePos_(0)
+    ,dequeuePos_(0)
+    {
+        for(size_t i = 0; i < capacity_; i++){
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+    ~BoundedMpmcQueue(){
+        T item;
+        while(tryPop(item)){}
+    }
+
+    BoundedMpmcQueue(const BoundedMpmcQueue&) = delete;
+    BoundedMpmcQueue& operator=(const BoundedMpmcQueue&) = delete;
+
+    //队列满时立即返回false，item保持不变
+    bool tryPush(T&& item){
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        for(;;){
+            cell = &cells_[pos % capacity_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if(dif == 0){
+                if(enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(dif < 0){
+                return false;//这个槽位上一轮的元素还没被取走，队列满
+            }
+            else{
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        new (cell->storage) T(std::move(item));
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    //队列空时立即返回false
+    bool tryPop(T& item){
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        for(;;){
+            cell = &cells_[pos % capacity_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+            if(dif == 0){
+                if(dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(dif < 0){
+                return false;
+            }
+            else{
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(*cell->ptr());
+        cell->ptr()->~T();
+        cell->seq.store(pos + capacity_, std::memory_order_release);
+        return true;
+    }
+
+    //批量入队：一次CAS预留从enqueuePos_开始连续的最多count个空闲槽位，
+    //再依次用gen(k)构造第k个元素，返回实际入队的数量（队列满时可能小于count）
+    //预留之后槽位必须写入，所以gen不能抛异常
+    template<typename Gen>
+    size_t tryPushBulk(size_t count, Gen&& gen){
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        size_t n;
+        for(;;){
+            n = 0;
+            bool stale = false;
+            while(n < count && n < capacity_){
+                size_t seq = cells_[(pos + n) % capacity_].seq.load(std::memory_order_acquire);
+                intptr_t dif = (intptr_t)seq - (intptr_t)(pos + n);
+                if(dif == 0){
+                    n++;
+                }
+                else{
+                    stale = dif > 0;//其他生产者已经在这个位置入队，pos过期了
+                    break;
+                }
+            }
+            if(stale){
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+                continue;
+            }
+            if(n == 0){
+                return 0;
+            }
+            if(enqueuePos_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+                break;
+        }
+        for(size_t k = 0; k < n; k++){
+            Cell& cell = cells_[(pos + k) % capacity_];
+            new (cell.storage) T(gen(k));
+            cell.seq.store(pos + k + 1, std::memory_order_release);
+        }
+        return n;
+    }
+
+    //近似值，只用于统计和判断是否需要唤醒
+    size_t size() const{
+        size_t tail = enqueuePos_.load(std::memory_order_acquire);
+        size_t head = dequeuePos_.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+    bool empty() const{
+        return size() == 0;
+    }
+    bool full() const{
+        return size() >= capacity_;
+    }
+    size_t capacity() const{
+        return capacity_;
+    }
+
+private:
+    struct Cell{
+        std::atomic<size_t> seq;
+        alignas(T) unsigned char storage[sizeof(T)];
+        T* ptr(){
+            return std::launder(reinterpret_cast<T*>(storage));
+        }
+    };
+
+    const size_t capacity_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<size_t> enqueuePos_;//生产者端
+    alignas(64) std::atomic<size_t> dequeuePos_;//消费者端
+};
+
+#endif /* mpmcqueue_hpp */
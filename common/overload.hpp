@@ -0,0 +1,125 @@
+//
+//  overload.hpp
+//  common
+//
+//  任务队列满时的过载策略（backpressure）：阻塞等待、立即拒绝、在提交线程执行、丢弃最早的任务
+//  被拒绝、被丢弃、在提交线程执行的任务都通过回调和计数器报告
+//  v1和2.0共用
+//
+
+#ifndef overload_hpp
+#define overload_hpp
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+//任务队列满时阻塞提交（submitTask/submitAsync/submitBulk）的处理方式，trySubmit总是立即返回
+enum class OverloadPolicy{
+    OVERLOAD_BLOCK, //等待队列有空余，最多等待设置的时间，超时拒绝，默认方式，默认等待1s
+    OVERLOAD_FAIL_FAST, //立即拒绝
+    OVERLOAD_CALLER_RUNS, //在提交任务的线程里直接执行，提交的速度自然降到线程池的处理速度
+    OVERLOAD_DROP_OLDEST, //丢弃队列里等待最久的任务，给新任务腾出位置
+};
+
+//报告给过载回调的事件，每个任务报告一次
+enum class OverloadEvent{
+    EVENT_REJECTED, //新提交的任务被拒绝
+    EVENT_DROPPED, //队列里的任务被丢弃
+    EVENT_CALLER_RUNS, //新提交的任务在提交线程里执行
+};
+
+//过载计数的快照
+struct OverloadStats{
+    uint64_t rejected = 0;
+    uint64_t dropped = 0;
+    uint64_t callerRuns = 0;
+};
+
+//任务队列满，任务被拒绝，get()抛出这个异常
+//被DROP_OLDEST丢弃的TaskDroppedError也从它派生，catch这个类型可以同时处理两种情况
+class TaskRejectedError : public std::runtime_error{
+public:
+    TaskRejectedError():std::runtime_error("task queue is full, task rejected"){}
+protected:
+    explicit TaskRejectedError(const std::string& what):std::runtime_error(what){}
+};
+
+//任务已经在队列里，为了给新任务腾出位置被丢弃
+class TaskDroppedError : public TaskRejectedError{
+public:
+    TaskDroppedError():TaskRejectedError("task dropped from full task queue"){}
+};
+
+//线程池内部使用：过载策略的配置、回调和计数器
+//配置只在start之前修改，运行时只读；计数器是原子的，回调在发生过载的线程上调用，不持有线程池的锁
+class OverloadControl{
+public:
+    using Handler = std::function<void(OverloadEvent)>;
+
+    OverloadControl()
+    :policy_(OverloadPolicy::OVERLOAD_BLOCK)
+    ,blockTime_(std::chrono::seconds(1))
+    ,rejected_(0)
+    ,dropped_(0)
+    ,callerRuns_(0)
+    {}
+
+    void setPolicy(OverloadPolicy policy, std::chrono::milliseconds blockTime){
+        policy_ = policy;
+        blockTime_ = blockTime;
+    }
+    void setHandler(Handler handler){
+        handler_ = std::move(handler);
+    }
+    OverloadPolicy policy() const{
+        return policy_;
+    }
+    //BLOCK策略下最多等待的时间
+    std::chrono::milliseconds blockTime() const{
+        return blockTime_;
+    }
+
+    void report(OverloadEvent event, size_t count = 1){
+        if(count == 0)
+            return;
+        switch(event){
+        case OverloadEvent::EVENT_REJECTED:
+            rejected_.fetch_add(count, std::memory_order_relaxed);
+            break;
+        case OverloadEvent::EVENT_DROPPED:
+            dropped_.fetch_add(count, std::memory_order_relaxed);
+            break;
+        case OverloadEvent::EVENT_CALLER_RUNS:
+            callerRuns_.fetch_add(count, std::memory_order_relaxed);
+            break;
+        }
+        if(handler_){
+            for(size_t i = 0; i < count; i++){
+                handler_(event);
+            }
+        }
+    }
+
+    OverloadStats stats() const{
+        OverloadStats s;
+        s.rejected = rejected_.load(std::memory_order_relaxed);
+        s.dropped = dropped_.load(std::memory_order_relaxed);
+        s.callerRuns = callerRuns_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    OverloadPolicy policy_;
+    std::chrono::milliseconds blockTime_;
+    Handler handler_;
+    std::atomic<uint64_t> rejected_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> callerRuns_;
+};
+
+#endif /* overload_hpp */
@@ -0,0 +1,292 @@
+//
+//  poolstats.hpp
+//  common
+//
+//  线程池的运行统计：每个线程一份计数器和直方图，编译时用THREADPOOL_STATS开关
+//  关闭时（默认）所有记录函数都是空的内联函数，stats()返回enabled为false的空快照
+//
+
+#ifndef poolstats_hpp
+#define poolstats_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//编译时加上-DTHREADPOOL_STATS=1打开统计
+#ifndef THREADPOOL_STATS
+#define THREADPOOL_STATS 0
+#endif
+
+//steady_clock的当前时间（纳秒），任务的入队时间都用它记录，优先级老化和排队时间统计共用，不受THREADPOOL_STATS影响
+inline uint64_t steadyNanos(){
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//HDR风格的延迟直方图：按2的幂分成数量级，每个数量级再线性分成SUB_BUCKETS份
+//相对误差不超过1/SUB_BUCKETS，单位纳秒，最大约2^(MAGNITUDES+SUB_BITS-1)ns
+struct HistogramLayout{
+    static constexpr int SUB_BITS = 3;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr int MAGNITUDES = 40;
+    static constexpr int BUCKETS = MAGNITUDES * SUB_BUCKETS;
+
+    static int bucketOf(uint64_t v){
+        if(v < (uint64_t)SUB_BUCKETS)
+            return (int)v;
+        int msb = 63 - __builtin_clzll(v);
+        int magnitude = msb - SUB_BITS + 1;
+        if(magnitude >= MAGNITUDES)
+            return BUCKETS - 1;
+        int sub = (int)((v >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1));
+        return magnitude * SUB_BUCKETS + sub;
+    }
+    //桶的上界，百分位按上界报告，不会低估延迟
+    static uint64_t upperBound(int bucket){
+        if(bucket < SUB_BUCKETS)
+            return (uint64_t)bucket;
+        int magnitude = bucket / SUB_BUCKETS;
+        int sub = bucket % SUB_BUCKETS;
+        int shift = magnitude - 1;
+        return ((uint64_t)(SUB_BUCKETS + sub + 1) << shift) - 1;
+    }
+};
+
+//直方图快照，可以合并多个线程的直方图
+struct HistogramSnapshot{
+    std::vector<uint64_t> buckets;
+    uint64_t count = 0;
+    uint64_t sum = 0;//纳秒
+    uint64_t max = 0;//纳秒
+
+    //第p（0~1）百分位的延迟，单位纳秒
+    uint64_t percentile(double p) const{
+        if(count == 0)
+            return 0;
+        uint64_t target = (uint64_t)(p * count);
+        if(target < 1)
+            target = 1;
+        uint64_t seen = 0;
+        for(size_t i = 0; i < buckets.size(); i++){
+            seen += buckets[i];
+            if(seen >= target)
+                return std::min(HistogramLayout::upperBound((int)i), max);
+        }
+        return max;
+    }
+    double mean() const{
+        return count > 0 ? (double)sum / count : 0;
+    }
+    //直接记录一个值（纳秒），调用方负责同步，用在有锁保护、不需要每线程直方图的地方
+    void record(uint64_t ns){
+        if(buckets.empty())
+            buckets.resize(HistogramLayout::BUCKETS, 0);
+        buckets[HistogramLayout::bucketOf(ns)]++;
+        count++;
+        sum += ns;
+        max = std::max(max, ns);
+    }
+    void merge(const HistogramSnapshot& other){
+        if(buckets.size() < other.buckets.size())
+            buckets.resize(other.buckets.size(), 0);
+        for(size_t i = 0; i < other.buckets.size(); i++){
+            buckets[i] += other.buckets[i];
+        }
+        count += other.count;
+        sum += other.sum;
+        max = std::max(max, other.max);
+    }
+};
+
+//一个线程的计数器快照
+struct WorkerCounters{
+    uint64_t tasksRun = 0;//执行的任务数量
+    uint64_t steals = 0;//从其他线程窃取的任务数量
+    uint64_t parks = 0;//自旋没有取到任务进入睡眠的次数
+    uint64_t wakeups = 0;//从睡眠中被唤醒的次数
+
+    void merge(const WorkerCounters& other){
+        tasksRun += other.tasksRun;
+        steals += other.steals;
+        parks += other.parks;
+        wakeups += other.wakeups;
+    }
+};
+
+//ThreadPool::stats()返回的快照，已经退出的线程的计数仍然计入总数
+struct PoolStats{
+    bool enabled = false;//编译时是否打开了统计
+    WorkerCounters total;
+    std::vector<WorkerCounters> workers;//每个线程一项
+    HistogramSnapshot queueWait;//任务从入队到开始执行的时间
+    HistogramSnapshot execTime;//任务的执行时间
+};
+
+#if THREADPOOL_STATS
+
+//只由一个线程写的直方图，写入不需要原子的读-改-写
+class LatencyHistogram{
+public:
+    LatencyHistogram():sum_(0),max_(0){
+        for(auto& b : buckets_){
+            b.store(0, std::memory_order_relaxed);
+        }
+    }
+    void record(uint64_t ns){
+        bump(buckets_[HistogramLayout::bucketOf(ns)]);
+        sum_.store(sum_.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+        if(ns > max_.load(std::memory_order_relaxed))
+            max_.store(ns, std::memory_order_relaxed);
+    }
+    void snapshot(HistogramSnapshot& out) const{
+        HistogramSnapshot s;
+        s.buckets.resize(HistogramLayout::BUCKETS);
+        for(int i = 0; i < HistogramLayout::BUCKETS; i++){
+            s.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        }
+        //总数按桶求和，和并发写入时读到的桶保持一致
+        for(uint64_t b : s.buckets){
+            s.count += b;
+        }
+        s.sum = sum_.load(std::memory_order_relaxed);
+        s.max = max_.load(std::memory_order_relaxed);
+        out.merge(s);
+    }
+private:
+    static void bump(std::atomic<uint64_t>& v){
+        v.store(v.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    std::atomic<uint64_t> buckets_[HistogramLayout::BUCKETS];
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+//一个线程的统计数据，按缓存行对齐，计数器单独占一个缓存行，线程之间没有伪共享
+struct alignas(64) WorkerStats{
+    std::atomic<uint64_t> tasksRun{0};
+    std::atomic<uint64_t> steals{0};
+    std::atomic<uint64_t> parks{0};
+    std::atomic<uint64_t> wakeups{0};
+    alignas(64) LatencyHistogram queueWait;
+    LatencyHistogram execTime;
+
+    void snapshot(WorkerCounters& out) const{
+        out.tasksRun = tasksRun.load(std::memory_order_relaxed);
+        out.steals = steals.load(std::memory_order_relaxed);
+        out.parks = parks.load(std::memory_order_relaxed);
+        out.wakeups = wakeups.load(std::memory_order_relaxed);
+    }
+};
+
+//线程持有的统计句柄，只有拥有它的线程写入
+class WorkerStatsRef{
+public:
+    WorkerStatsRef() = default;
+    explicit WorkerStatsRef(WorkerStats* stats):stats_(stats){}
+
+    static uint64_t now(){
+        return steadyNanos();
+    }
+    void taskRun(uint64_t enqueueTime, uint64_t start, uint64_t end){
+        if(stats_ == nullptr)
+            return;
+        bump(stats_->tasksRun);
+        if(enqueueTime != 0 && start > enqueueTime)
+            stats_->queueWait.record(start - enqueueTime);
+        stats_->execTime.record(end > start ? end - start : 0);
+    }
+    void steal(){
+        if(stats_ != nullptr)
+            bump(stats_->steals);
+    }
+    void park(){
+        if(stats_ != nullptr)
+            bump(stats_->parks);
+    }
+    void wakeup(){
+        if(stats_ != nullptr)
+            bump(stats_->wakeups);
+    }
+    WorkerStats* get() const{
+        return stats_;
+    }
+private:
+    static void bump(std::atomic<uint64_t>& v){
+        v.store(v.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    WorkerStats* stats_ = nullptr;
+};
+
+//线程池的所有统计数据，线程启动时领取一份，退出时归还给后来的线程复用，计数一直累加
+class StatsRegistry{
+public:
+    WorkerStatsRef acquire(){
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(!free_.empty()){
+            WorkerStats* s = free_.back();
+            free_.pop_back();
+            return WorkerStatsRef(s);
+        }
+        all_.push_back(std::make_unique<WorkerStats>());
+        return WorkerStatsRef(all_.back().get());
+    }
+    void release(WorkerStatsRef ref){
+        if(ref.get() == nullptr)
+            return;
+        std::lock_guard<std::mutex> lock(mtx_);
+        free_.push_back(ref.get());
+    }
+    PoolStats snapshot() const{
+        PoolStats out;
+        out.enabled = true;
+        std::lock_guard<std::mutex> lock(mtx_);
+        for(auto& s : all_){
+            WorkerCounters c;
+            s->snapshot(c);
+            out.total.merge(c);
+            out.workers.push_back(c);
+            s->queueWait.snapshot(out.queueWait);
+            s->execTime.snapshot(out.execTime);
+        }
+        return out;
+    }
+private:
+    mutable std::mutex mtx_;
+    std::vector<std::unique_ptr<WorkerStats>> all_;
+    std::vector<WorkerStats*> free_;
+};
+
+#else
+
+//统计关闭：空对象，调用全部内联成空操作
+class WorkerStatsRef{
+public:
+    static constexpr uint64_t now(){
+        return 0;
+    }
+    void taskRun(uint64_t, uint64_t, uint64_t){}
+    void steal(){}
+    void park(){}
+    void wakeup(){}
+};
+
+class StatsRegistry{
+public:
+    WorkerStatsRef acquire(){
+        return WorkerStatsRef();
+    }
+    void release(WorkerStatsRef){}
+    PoolStats snapshot() const{
+        return PoolStats();
+    }
+};
+
+#endif
+
+#endif /* poolstats_hpp */
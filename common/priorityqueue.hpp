@@ -0,0 +1,165 @@
+//
+//  priorityqueue.hpp
+//  common
+//
+//  带优先级和截止时间的任务队列：级别之间按优先级（带老化），级别内部按最早截止时间优先
+//
+
+#ifndef priorityqueue_hpp
+#define priorityqueue_hpp
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//每个级别一个小根堆，按(截止时间, 入队时间, 入队序号)排序：有截止时间的任务按EDF，没有截止时间的任务按FIFO
+//老化：把任务看成在 入队时间 + 级别 * aging 这个虚拟时间入队的最高级任务，
+//选虚拟时间最早的级别出队，低级别的任务每多等aging就相当于提升一级，不会饿死
+//级别的虚拟时间按这个级别里等得最久的任务算，而不是EDF堆顶：截止时间晚的老任务同样会老化，
+//每个级别另外用两个小根堆记录还在队列里的入队时间（已出队的延迟删除）
+//不是线程安全的，由调用方加锁
+template<typename T>
+class PriorityTaskQueue{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    PriorityTaskQueue(size_t levels, Clock::duration aging)
+    :levels_(levels > 0 ? levels : 1)
+    ,aging_(aging)
+    ,size_(0)
+    ,seq_(0)
+    {}
+
+    PriorityTaskQueue(const PriorityTaskQueue&) = delete;
+    PriorityTaskQueue& operator=(const PriorityTaskQueue&) = delete;
+
+    //deadline为Clock::time_point::max()表示没有截止时间
+    //now是任务的入队时间，老化从这个时间开始算
+    void push(T item, size_t level, Clock::time_point deadline, Clock::time_point now){
+        Level& lv = levels_[std::min(level, levels_.size() - 1)];
+        Stamp stamp{now, seq_++};
+        lv.heap.push_back(Entry{deadline, stamp, std::move(item)});
+        std::push_heap(lv.heap.begin(), lv.heap.end(), Later());
+        lv.born.push_back(stamp);
+        std::push_heap(lv.born.begin(), lv.born.end(), StampLater());
+        size_++;
+    }
+
+    //取出老化后最紧急的任务，队列为空返回false
+    bool pop(T& item){
+        int level = frontLevel();
+        if(level < 0)
+            return false;
+        Level& lv = levels_[level];
+        std::pop_heap(lv.heap.begin(), lv.heap.end(), Later());
+        Stamp stamp = lv.heap.back().stamp;
+        item = std::move(lv.heap.back().item);
+        lv.heap.pop_back();
+        lv.retire(stamp);
+        size_--;
+        return true;
+    }
+
+    //队列里有没有比队列外level级别、enqueueTime入队的任务更紧急的任务（按老化后的虚拟时间比较）
+    //用来决定队列外的普通任务和这个队列谁先执行
+    bool aheadOf(size_t level, Clock::time_point enqueueTime) const{
+        int front = frontLevel();
+        if(front < 0)
+            return false;
+        return virtualTime(front) < enqueueTime + aging_ * (Clock::rep)level;
+    }
+
+    //修改老化的时间，级别内部的顺序和老化无关，已经在队列里的任务不需要重新排序
+    void setAging(Clock::duration aging){
+        aging_ = aging;
+    }
+
+    size_t size() const{
+        return size_;
+    }
+    bool empty() const{
+        return size_ == 0;
+    }
+
+private:
+    //入队时间和入队序号，序号保证唯一
+    struct Stamp{
+        Clock::time_point enqueueTime;
+        uint64_t seq;
+        bool operator==(const Stamp& other) const{
+            return seq == other.seq;
+        }
+    };
+    //std::push_heap是大根堆，比较器反过来得到小根堆
+    struct StampLater{
+        bool operator()(const Stamp& a, const Stamp& b) const{
+            if(a.enqueueTime != b.enqueueTime)
+                return a.enqueueTime > b.enqueueTime;
+            return a.seq > b.seq;
+        }
+    };
+    struct Entry{
+        Clock::time_point deadline;
+        Stamp stamp;
+        T item;
+    };
+    struct Later{
+        bool operator()(const Entry& a, const Entry& b) const{
+            if(a.deadline != b.deadline)
+                return a.deadline > b.deadline;
+            return StampLater()(a.stamp, b.stamp);
+        }
+    };
+
+    struct Level{
+        std::vector<Entry> heap;//按截止时间出队
+        std::vector<Stamp> born;//队列里所有任务的入队时间，可能含有已经出队的
+        std::vector<Stamp> gone;//已经出队但还没从born删掉的
+
+        //等得最久的任务的入队时间，heap不为空时才有意义
+        Clock::time_point oldest() const{
+            return born.front().enqueueTime;
+        }
+        void retire(const Stamp& stamp){
+            gone.push_back(stamp);
+            std::push_heap(gone.begin(), gone.end(), StampLater());
+            while(!gone.empty() && gone.front() == born.front()){
+                std::pop_heap(gone.begin(), gone.end(), StampLater());
+                gone.pop_back();
+                std::pop_heap(born.begin(), born.end(), StampLater());
+                born.pop_back();
+            }
+        }
+    };
+
+    Clock::time_point virtualTime(size_t level) const{
+        return levels_[level].oldest() + aging_ * (Clock::rep)level;
+    }
+
+    //各级别队头里虚拟时间最早的级别，全部为空返回-1
+    int frontLevel() const{
+        int best = -1;
+        Clock::time_point bestTime;
+        for(size_t i = 0; i < levels_.size(); i++){
+            if(levels_[i].heap.empty())
+                continue;
+            Clock::time_point vt = virtualTime(i);
+            if(best < 0 || vt < bestTime){
+                best = (int)i;
+                bestTime = vt;
+            }
+        }
+        return best;
+    }
+
+private:
+    std::vector<Level> levels_;
+    Clock::duration aging_;
+    size_t size_;
+    uint64_t seq_;
+};
+
+#endif /* priorityqueue_hpp */
@@ -0,0 +1,155 @@
+//
+//  shardedqueue.hpp
+//  common
+//
+//  分片的有界多生产者多消费者队列：K个各自加锁的子队列，总容量是全局的
+//  生产者随机选两个分片放入较短的一个（power of two choices），消费者从随机位置开始依次扫描所有分片，
+//  多个提交线程大多落在不同的分片上，不再争同一把锁
+//
+
+#ifndef shardedqueue_hpp
+#define shardedqueue_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <utility>
+#include "slaballoc.hpp"
+
+//接口和BoundedMpmcQueue相同，线程池可以用同样的方式处理队列满
+//每个分片内部是FIFO，生产者总是放入较短的分片，各个分片的长度接近，整体上近似FIFO
+template<typename T>
+class ShardedQueue{
+public:
+    //shards向上取整到2的幂
+    ShardedQueue(size_t capacity, size_t shards)
+    :capacity_(capacity > 0 ? capacity : 1)
+    ,mask_(roundUp(shards) - 1)
+    ,shards_(new Shard[mask_ + 1])
+    ,size_(0)
+    {}
+
+    ShardedQueue(const ShardedQueue&) = delete;
+    ShardedQueue& operator=(const ShardedQueue&) = delete;
+
+    //队列满时立即返回false，item保持不变
+    bool tryPush(T&& item){
+        if(reserve(1) == 0)
+            return false;
+        Shard& shard = pickShard();
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        shard.que.push_back(std::move(item));
+        shard.size.store(shard.que.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    //队列空时立即返回false
+    bool tryPop(T& item){
+        if(size_.load(std::memory_order_acquire) == 0)
+            return false;
+        size_t start = random();
+        for(size_t i = 0; i <= mask_; i++){
+            Shard& shard = shards_[(start + i) & mask_];
+            if(shard.size.load(std::memory_order_relaxed) == 0)
+                continue;
+            std::lock_guard<std::mutex> lock(shard.mtx);
+            if(shard.que.empty())
+                continue;
+            item = std::move(shard.que.front());
+            shard.que.pop_front();
+            shard.size.store(shard.que.size(), std::memory_order_relaxed);
+            size_.fetch_sub(1, std::memory_order_release);
+            return true;
+        }
+        return false;
+    }
+
+    //批量入队：一次预留最多count个容量，每BATCH个任务选一次分片、加一次锁，
+    //用gen(k)构造第k个元素，返回实际入队的数量（队列满时可能小于count）
+    //预留之后必须写入，所以gen不能抛异常
+    template<typename Gen>
+    size_t tryPushBulk(size_t count, Gen&& gen){
+        size_t n = reserve(count);
+        for(size_t k = 0; k < n;){
+            size_t end = std::min(n, k + BATCH);
+            Shard& shard = pickShard();
+            std::lock_guard<std::mutex> lock(shard.mtx);
+            for(; k < end; k++){
+                shard.que.push_back(gen(k));
+            }
+            shard.size.store(shard.que.size(), std::memory_order_relaxed);
+        }
+        return n;
+    }
+
+    //近似值，只用于统计和判断是否需要唤醒
+    size_t size() const{
+        return size_.load(std::memory_order_acquire);
+    }
+    bool empty() const{
+        return size() == 0;
+    }
+    bool full() const{
+        return size() >= capacity_;
+    }
+    size_t capacity() const{
+        return capacity_;
+    }
+    size_t shardCount() const{
+        return mask_ + 1;
+    }
+
+private:
+    static constexpr size_t BATCH = 64;//批量入队时一个分片一次最多放入的数量
+
+    //每个分片独占缓存行，size是无锁读取的长度，生产者和消费者用它选分片、跳过空分片
+    struct alignas(64) Shard{
+        std::mutex mtx;
+        std::deque<T, SlabAllocator<T>> que;//块从slab缓存分配
+        std::atomic<size_t> size{0};
+    };
+
+    static size_t roundUp(size_t n){
+        size_t p = 1;
+        while(p < n){
+            p <<= 1;
+        }
+        return p;
+    }
+
+    static size_t random(){
+        static thread_local std::minstd_rand rng(std::random_device{}());
+        return rng();
+    }
+
+    //随机选两个分片，取较短的一个
+    Shard& pickShard(){
+        size_t r = random();
+        Shard& a = shards_[r & mask_];
+        Shard& b = shards_[(r >> 16) & mask_];
+        return b.size.load(std::memory_order_relaxed) < a.size.load(std::memory_order_relaxed) ? b : a;
+    }
+
+    //在全局容量里预留最多count个位置，返回预留的数量
+    size_t reserve(size_t count){
+        size_t cur = size_.load(std::memory_order_relaxed);
+        for(;;){
+            if(cur >= capacity_)
+                return 0;
+            size_t n = std::min(count, capacity_ - cur);
+            if(size_.compare_exchange_weak(cur, cur + n, std::memory_order_acq_rel, std::memory_order_relaxed))
+                return n;
+        }
+    }
+
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<Shard[]> shards_;
+    alignas(64) std::atomic<size_t> size_;//已经预留的数量（包括正在写入的），全局容量限制
+};
+
+#endif /* shardedqueue_hpp */
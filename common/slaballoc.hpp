@@ -0,0 +1,472 @@
+//
+//  slaballoc.hpp
+//  common
+//
+//  任务节点和返回值状态的小对象分配器：每个线程一个缓存，按大小分级的空闲链表，
+//  分配和释放大多只访问本线程的链表，不经过全局malloc的锁
+//  v1和2.0共用，编译时用THREADPOOL_SLAB=0关闭（直接用operator new，方便内存检查工具）
+//
+
+#ifndef slaballoc_hpp
+#define slaballoc_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifndef THREADPOOL_SLAB
+#define THREADPOOL_SLAB 1
+#endif
+
+//分配器计数器的快照，SlabHeap::stats()返回所有线程的总和
+struct SlabStats{
+    bool enabled = false;//编译时是否打开了分配器
+    uint64_t hits = 0;//直接从本线程的空闲链表分配
+    uint64_t misses = 0;//本线程的空闲链表为空，回收归还的块、从全局取一批或者切新的slab
+    uint64_t largeAllocs = 0;//超过最大的大小等级，直接用operator new
+    uint64_t remoteFrees = 0;//释放其他线程分配的块，攒成一批再归还给那个线程
+    uint64_t slabs = 0;//向系统申请的slab数量
+    uint64_t caches = 0;//创建过的线程缓存数量，线程退出后缓存给后来的线程复用
+};
+
+#if THREADPOOL_SLAB
+
+class SlabCache;
+
+//每个块前面的头部，16字节，块的数据部分按max_align_t对齐
+//分配出去时记录分配它的线程缓存，在空闲链表里时next指向下一个空闲块
+struct SlabBlock{
+    union{
+        SlabCache* owner;
+        SlabBlock* next;
+    };
+    uint32_t sizeClass;
+    uint32_t reserved;
+};
+static_assert(sizeof(SlabBlock) % alignof(std::max_align_t) == 0, "slab block header breaks alignment");
+
+//大小等级：数据部分的字节数，块的大小再加上头部
+struct SlabLayout{
+    static constexpr size_t CLASS_COUNT = 10;
+    static constexpr size_t LARGE = CLASS_COUNT;//超过最大等级，sizeClass记为LARGE
+    static constexpr size_t SLAB_BYTES = 64 * 1024;//一次向系统申请的内存
+    static constexpr uint32_t BATCH = 32;//线程之间、线程和全局之间一次移动的块数量
+    static constexpr uint32_t LOCAL_MAX = 1024;//每个等级本线程最多保留的空闲块，超过的一批还给全局
+
+    static constexpr size_t classSize(size_t cls){
+        constexpr size_t sizes[CLASS_COUNT] = {32, 64, 96, 128, 192, 256, 384, 512, 768, 1024};
+        return sizes[cls];
+    }
+    static size_t classOf(size_t bytes){
+        for(size_t cls = 0; cls < CLASS_COUNT; cls++){
+            if(bytes <= classSize(cls))
+                return cls;
+        }
+        return LARGE;
+    }
+};
+
+//一串用next连起来的块
+struct SlabChain{
+    SlabBlock* head = nullptr;
+    SlabBlock* tail = nullptr;
+    uint32_t count = 0;
+};
+
+//一个线程的缓存，线程第一次分配时领取，退出时归还给SlabRegistry，由后来的线程复用，不会被释放
+//空闲链表只由拥有它的线程访问；其他线程释放的块攒成一批压到remote_上，拥有者链表为空时一次取走
+class SlabCache{
+public:
+    SlabCache(){
+        remote_.store(nullptr, std::memory_order_relaxed);
+    }
+
+    //其他线程把一串块归还给这个缓存，一次CAS
+    void pushRemote(SlabChain chain){
+        SlabBlock* head = remote_.load(std::memory_order_relaxed);
+        do{
+            chain.tail->next = head;
+        }while(!remote_.compare_exchange_weak(head, chain.head, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+private:
+    friend class SlabHeap;
+    friend class SlabRegistry;
+
+    //最近归还给其他线程的块，按拥有者分开攒，满BATCH个或者线程睡眠/退出时一起归还
+    struct PendingBatch{
+        SlabCache* owner = nullptr;
+        SlabChain chain;
+    };
+    static constexpr size_t PENDING_SLOTS = 4;
+
+    static void bump(std::atomic<uint64_t>& v){
+        v.store(v.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    SlabChain free_[SlabLayout::CLASS_COUNT];
+    PendingBatch pending_[PENDING_SLOTS];
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> largeAllocs_{0};
+    std::atomic<uint64_t> remoteFrees_{0};
+    alignas(64) std::atomic<SlabBlock*> remote_;//其他线程归还的块，单独占一个缓存行
+};
+
+//所有线程缓存、全局的空闲块和slab，进程结束前一直存在
+class SlabRegistry{
+public:
+    //故意不释放：线程退出和静态对象析构时仍然可能释放块
+    static SlabRegistry& instance(){
+        static SlabRegistry* registry = new SlabRegistry();
+        return *registry;
+    }
+
+    SlabCache* acquire(){
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(!free_.empty()){
+            SlabCache* cache = free_.back();
+            free_.pop_back();
+            return cache;
+        }
+        all_.push_back(std::make_unique<SlabCache>());
+        return all_.back().get();
+    }
+    void release(SlabCache* cache){
+        std::lock_guard<std::mutex> lock(mtx_);
+        free_.push_back(cache);
+    }
+
+    //线程缓存里多出来的一批空闲块
+    void putChain(size_t cls, SlabChain chain){
+        std::lock_guard<std::mutex> lock(mtx_);
+        depot_[cls].push_back(chain);
+    }
+    bool takeChain(size_t cls, SlabChain& chain){
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(depot_[cls].empty())
+            return false;
+        chain = depot_[cls].back();
+        depot_[cls].pop_back();
+        return true;
+    }
+
+    //向系统申请一个slab，切成cls等级的块
+    SlabChain carve(size_t cls){
+        size_t blockSize = sizeof(SlabBlock) + SlabLayout::classSize(cls);
+        size_t n = SlabLayout::SLAB_BYTES / blockSize;
+        char* slab = static_cast<char*>(::operator new(SlabLayout::SLAB_BYTES));
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            slabs_.push_back(slab);
+        }
+        SlabChain chain;
+        for(size_t i = n; i-- > 0; ){
+            SlabBlock* block = reinterpret_cast<SlabBlock*>(slab + i * blockSize);
+            block->sizeClass = (uint32_t)cls;
+            block->next = chain.head;
+            if(chain.head == nullptr)
+                chain.tail = block;
+            chain.head = block;
+        }
+        chain.count = (uint32_t)n;
+        return chain;
+    }
+
+    SlabStats snapshot() const{
+        SlabStats out;
+        out.enabled = true;
+        std::lock_guard<std::mutex> lock(mtx_);
+        for(auto& c : all_){
+            out.hits += c->hits_.load(std::memory_order_relaxed);
+            out.misses += c->misses_.load(std::memory_order_relaxed);
+            out.largeAllocs += c->largeAllocs_.load(std::memory_order_relaxed);
+            out.remoteFrees += c->remoteFrees_.load(std::memory_order_relaxed);
+        }
+        out.slabs = slabs_.size();
+        out.caches = all_.size();
+        return out;
+    }
+
+private:
+    SlabRegistry() = default;
+
+    mutable std::mutex mtx_;
+    std::vector<std::unique_ptr<SlabCache>> all_;
+    std::vector<SlabCache*> free_;//线程已经退出，等待复用的缓存
+    std::vector<SlabChain> depot_[SlabLayout::CLASS_COUNT];
+    std::vector<void*> slabs_;
+};
+
+//分配和释放的入口
+class SlabHeap{
+public:
+    //返回的内存按max_align_t对齐
+    static void* allocate(size_t bytes){
+        size_t cls = SlabLayout::classOf(bytes);
+        SlabCache* cache = current();
+        if(cls == SlabLayout::LARGE || cache == nullptr){
+            //线程已经在退出，缓存归还以后的分配也走这里
+            SlabBlock* block = static_cast<SlabBlock*>(::operator new(sizeof(SlabBlock) + bytes));
+            block->sizeClass = (uint32_t)SlabLayout::LARGE;
+            block->owner = nullptr;
+            if(cache != nullptr)
+                SlabCache::bump(cache->largeAllocs_);
+            return block + 1;
+        }
+        SlabChain& list = cache->free_[cls];
+        if(list.head != nullptr){
+            SlabCache::bump(cache->hits_);
+        }
+        else{
+            SlabCache::bump(cache->misses_);
+            refill(cache, cls);
+        }
+        SlabBlock* block = list.head;
+        list.head = block->next;
+        list.count--;
+        block->owner = cache;
+        return block + 1;
+    }
+
+    static void free(void* p) noexcept{
+        if(p == nullptr)
+            return;
+        SlabBlock* block = static_cast<SlabBlock*>(p) - 1;
+        if(block->sizeClass == SlabLayout::LARGE){
+            ::operator delete(block);
+            return;
+        }
+        SlabCache* owner = block->owner;
+        SlabCache* cache = current(false);
+        if(cache == owner){
+            pushLocal(cache, block);
+            return;
+        }
+        block->next = nullptr;
+        if(cache == nullptr){
+            //这个线程没有缓存（或者已经归还），单独归还给拥有者
+            owner->pushRemote(SlabChain{block, block, 1});
+            return;
+        }
+        SlabCache::bump(cache->remoteFrees_);
+        //按拥有者的地址选择一个槽位，槽位被其他拥有者占用时先把那一批归还
+        auto& slot = cache->pending_[(reinterpret_cast<uintptr_t>(owner) >> 6) % SlabCache::PENDING_SLOTS];
+        if(slot.owner != owner){
+            flushSlot(slot);
+            slot.owner = owner;
+        }
+        block->next = slot.chain.head;
+        if(slot.chain.head == nullptr)
+            slot.chain.tail = block;
+        slot.chain.head = block;
+        if(++slot.chain.count >= SlabLayout::BATCH)
+            flushSlot(slot);
+    }
+
+    //把本线程攒着的块都归还给拥有者，线程池的线程睡眠前调用，避免块在一个空闲的线程里放太久
+    static void flush() noexcept{
+        SlabCache* cache = current(false);
+        if(cache == nullptr)
+            return;
+        for(auto& slot : cache->pending_){
+            flushSlot(slot);
+        }
+    }
+
+    static SlabStats stats(){
+        return SlabRegistry::instance().snapshot();
+    }
+
+private:
+    //线程的缓存，平凡析构，线程退出过程中（其他thread_local析构时）仍然可以访问
+    struct ThreadState{
+        SlabCache* cache;
+        bool exited;
+    };
+    static ThreadState& state(){
+        static thread_local ThreadState s{nullptr, false};
+        return s;
+    }
+
+    //线程退出时把攒着的块和多出来的空闲块交出去，缓存归还给SlabRegistry
+    struct ThreadGuard{
+        ~ThreadGuard(){
+            ThreadState& s = state();
+            flush();
+            SlabRegistry& registry = SlabRegistry::instance();
+            for(size_t cls = 0; cls < SlabLayout::CLASS_COUNT; cls++){
+                SlabChain& list = s.cache->free_[cls];
+                while(list.count > 0){
+                    registry.putChain(cls, takeBatch(list));
+                }
+            }
+            registry.release(s.cache);
+            s.cache = nullptr;
+            s.exited = true;
+        }
+    };
+
+    //当前线程的缓存，create为false时没有就返回nullptr；线程退出以后总是返回nullptr
+    static SlabCache* current(bool create = true){
+        ThreadState& s = state();
+        if(s.cache == nullptr && create && !s.exited){
+            static thread_local ThreadGuard guard;
+            (void)guard;
+            s.cache = SlabRegistry::instance().acquire();
+        }
+        return s.cache;
+    }
+
+    static void pushLocal(SlabCache* cache, SlabBlock* block){
+        size_t cls = block->sizeClass;
+        SlabChain& list = cache->free_[cls];
+        block->next = list.head;
+        if(list.head == nullptr)
+            list.tail = block;
+        list.head = block;
+        if(++list.count > SlabLayout::LOCAL_MAX)
+            SlabRegistry::instance().putChain(cls, takeBatch(list));
+    }
+
+    //从链表头部取下最多BATCH个块
+    static SlabChain takeBatch(SlabChain& list){
+        SlabChain batch;
+        batch.head = list.head;
+        SlabBlock* block = list.head;
+        uint32_t n = 1;
+        while(n < SlabLayout::BATCH && n < list.count){
+            block = block->next;
+            n++;
+        }
+        batch.tail = block;
+        batch.count = n;
+        list.head = block->next;
+        list.count -= n;
+        if(list.count == 0)
+            list.tail = nullptr;
+        block->next = nullptr;
+        return batch;
+    }
+
+    //本线程cls等级的链表为空：先取回其他线程归还的块，再从全局取一批，最后切一个新的slab
+    static void refill(SlabCache* cache, size_t cls){
+        SlabBlock* remote = cache->remote_.exchange(nullptr, std::memory_order_acquire);
+        while(remote != nullptr){
+            SlabBlock* next = remote->next;
+            SlabChain& list = cache->free_[remote->sizeClass];
+            remote->next = list.head;
+            if(list.head == nullptr)
+                list.tail = remote;
+            list.head = remote;
+            list.count++;
+            remote = next;
+        }
+        SlabChain& list = cache->free_[cls];
+        if(list.head != nullptr)
+            return;
+        SlabRegistry& registry = SlabRegistry::instance();
+        if(!registry.takeChain(cls, list))
+            list = registry.carve(cls);
+    }
+
+    static void flushSlot(SlabCache::PendingBatch& slot) noexcept{
+        if(slot.chain.count > 0)
+            slot.owner->pushRemote(slot.chain);
+        slot.owner = nullptr;
+        slot.chain = SlabChain();
+    }
+};
+
+#else
+
+//分配器关闭：直接使用operator new/delete
+class SlabHeap{
+public:
+    static void* allocate(size_t bytes){
+        return ::operator new(bytes);
+    }
+    static void free(void* p) noexcept{
+        ::operator delete(p);
+    }
+    static void flush() noexcept{}
+    static SlabStats stats(){
+        return SlabStats();
+    }
+};
+
+#endif
+
+//标准库风格的分配器，给std::allocate_shared、std::promise这类需要分配器的地方使用
+//对齐要求超过max_align_t的类型直接用对齐的operator new
+template<typename T>
+class SlabAllocator{
+public:
+    using value_type = T;
+
+    SlabAllocator() noexcept = default;
+    template<typename U>
+    SlabAllocator(const SlabAllocator<U>&) noexcept{}
+
+    T* allocate(size_t n){
+        if constexpr(alignof(T) > alignof(std::max_align_t)){
+            return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+        }
+        else{
+            return static_cast<T*>(SlabHeap::allocate(n * sizeof(T)));
+        }
+    }
+    void deallocate(T* p, size_t) noexcept{
+        if constexpr(alignof(T) > alignof(std::max_align_t)){
+            ::operator delete(p, std::align_val_t(alignof(T)));
+        }
+        else{
+            SlabHeap::free(p);
+        }
+    }
+
+    template<typename U>
+    bool operator==(const SlabAllocator<U>&) const noexcept{
+        return true;
+    }
+    template<typename U>
+    bool operator!=(const SlabAllocator<U>&) const noexcept{
+        return false;
+    }
+};
+
+//用分配器创建和销毁单个对象，代替new/delete
+template<typename T, typename... Args>
+T* slabNew(Args&&... args){
+    SlabAllocator<T> alloc;
+    T* p = alloc.allocate(1);
+    try{
+        return new (p) T(std::forward<Args>(args)...);
+    }
+    catch(...){
+        alloc.deallocate(p, 1);
+        throw;
+    }
+}
+
+template<typename T>
+void slabDelete(T* p) noexcept{
+    if(p == nullptr)
+        return;
+    p->~T();
+    SlabAllocator<T>().deallocate(p, 1);
+}
+
+//用分配器创建shared_ptr，控制块和对象在同一个块里
+template<typename T, typename... Args>
+std::shared_ptr<T> makeSlabShared(Args&&... args){
+    return std::allocate_shared<T>(SlabAllocator<T>(), std::forward<Args>(args)...);
+}
+
+#endif /* slaballoc_hpp */
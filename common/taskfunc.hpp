@@ -0,0 +1,185 @@
+//
+//  taskfunc.hpp
+//  common
+//
+//  只能移动的任务函数对象，代替std::function<void()>
+//
+
+#ifndef taskfunc_hpp
+#define taskfunc_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "poolstats.hpp"
+#include "slaballoc.hpp"
+
+//和std::function<void()>相比：
+//1.只能移动不能拷贝，所以可以保存std::promise这种只能移动的对象，不需要再包一层shared_ptr
+//2.内部缓冲区INLINE_SIZE字节，普通的lambda加一个std::promise可以直接放在里面，不需要堆分配
+//3.整个对象正好一个缓存行大小
+class TaskFunc{
+public:
+    static constexpr size_t INLINE_SIZE = 48;
+
+    TaskFunc() noexcept : ops_(nullptr){}
+    TaskFunc(std::nullptr_t) noexcept : ops_(nullptr){}
+
+    template<typename F, typename Fn = typename std::decay<F>::type,
+             typename = typename std::enable_if<!std::is_same<Fn, TaskFunc>::value>::type>
+    TaskFunc(F&& f){
+        if constexpr(isInline<Fn>()){
+            new (buf_) Fn(std::forward<F>(f));
+            ops_ = &InlineOps<Fn>::ops;
+        }
+        else{
+            //大对象只能放到堆上（线程的slab缓存），缓冲区里存指针
+            *reinterpret_cast<Fn**>(buf_) = slabNew<Fn>(std::forward<F>(f));
+            ops_ = &HeapOps<Fn>::ops;
+        }
+    }
+
+    TaskFunc(TaskFunc&& other) noexcept : ops_(other.ops_), enqueueTime_(other.enqueueTime_){
+        if(ops_ != nullptr){
+            ops_->move(other.buf_, buf_);
+            other.ops_ = nullptr;
+        }
+    }
+    TaskFunc& operator=(TaskFunc&& other) noexcept{
+        if(this != &other){
+            reset();
+            ops_ = other.ops_;
+            enqueueTime_ = other.enqueueTime_;
+            if(ops_ != nullptr){
+                ops_->move(other.buf_, buf_);
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+    TaskFunc(const TaskFunc&) = delete;
+    TaskFunc& operator=(const TaskFunc&) = delete;
+
+    ~TaskFunc(){
+        reset();
+    }
+
+    void operator()(){
+        ops_->invoke(buf_);
+    }
+
+    //任务没有执行就被丢弃（线程池ABORT关闭、提交失败、过载时被丢弃）时调用，可调用对象有abandon(error)成员时调用它，
+    //让等待这个任务的future完成为异常error，而不是永远等下去
+    void abandon(std::exception_ptr error){
+        if(ops_ != nullptr)
+            ops_->abandon(buf_, error);
+    }
+
+    void reset() noexcept{
+        if(ops_ != nullptr){
+            ops_->destroy(buf_);
+            ops_ = nullptr;
+        }
+    }
+
+    explicit operator bool() const noexcept{
+        return ops_ != nullptr;
+    }
+    bool operator==(std::nullptr_t) const noexcept{
+        return ops_ == nullptr;
+    }
+    bool operator!=(std::nullptr_t) const noexcept{
+        return ops_ != nullptr;
+    }
+
+    //入队时间（steadyNanos()），普通任务和优先级任务比较先后（老化）、统计排队时间都用它
+    void setEnqueueTime(uint64_t t) noexcept{
+        enqueueTime_ = t;
+    }
+    uint64_t enqueueTime() const noexcept{
+        return enqueueTime_;
+    }
+
+    //可调用对象能不能直接放在内部缓冲区里
+    template<typename Fn>
+    static constexpr bool isInline(){
+        return sizeof(Fn) <= INLINE_SIZE && alignof(Fn) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+private:
+    //手写的虚函数表，每种可调用对象类型一份
+    struct Ops{
+        void (*invoke)(void* buf);
+        void (*move)(void* src, void* dst) noexcept;
+        void (*destroy)(void* buf) noexcept;
+        void (*abandon)(void* buf, std::exception_ptr error);
+    };
+
+    template<typename Fn, typename = void>
+    struct HasAbandon : std::false_type{};
+    template<typename Fn>
+    struct HasAbandon<Fn, decltype(std::declval<Fn&>().abandon(std::declval<std::exception_ptr>()))> : std::true_type{};
+
+    template<typename Fn>
+    static void abandonFn(Fn& fn, std::exception_ptr error){
+        if constexpr(HasAbandon<Fn>::value){
+            fn.abandon(std::move(error));
+        }
+        else{
+            (void)fn;
+            (void)error;
+        }
+    }
+
+    template<typename Fn>
+    struct InlineOps{
+        static Fn* get(void* buf){
+            return std::launder(reinterpret_cast<Fn*>(buf));
+        }
+        static void invoke(void* buf){
+            (*get(buf))();
+        }
+        static void move(void* src, void* dst) noexcept{
+            new (dst) Fn(std::move(*get(src)));
+            get(src)->~Fn();
+        }
+        static void destroy(void* buf) noexcept{
+            get(buf)->~Fn();
+        }
+        static void abandon(void* buf, std::exception_ptr error){
+            abandonFn(*get(buf), std::move(error));
+        }
+        static constexpr Ops ops = {&invoke, &move, &destroy, &abandon};
+    };
+
+    template<typename Fn>
+    struct HeapOps{
+        static Fn*& get(void* buf){
+            return *reinterpret_cast<Fn**>(buf);
+        }
+        static void invoke(void* buf){
+            (*get(buf))();
+        }
+        static void move(void* src, void* dst) noexcept{
+            *reinterpret_cast<Fn**>(dst) = get(src);
+        }
+        static void destroy(void* buf) noexcept{
+            slabDelete(get(buf));
+        }
+        static void abandon(void* buf, std::exception_ptr error){
+            abandonFn(*get(buf), std::move(error));
+        }
+        static constexpr Ops ops = {&invoke, &move, &destroy, &abandon};
+    };
+
+private:
+    const Ops* ops_;
+    uint64_t enqueueTime_ = 0;//x86-64上正好放在ops_和buf_之间的对齐空隙里，不增加对象大小
+    alignas(std::max_align_t) unsigned char buf_[INLINE_SIZE];
+};
+
+#endif /* taskfunc_hpp */
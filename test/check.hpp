@@ -0,0 +1,35 @@
+//
+//  check.hpp
+//  test
+//
+//  测试用的断言：失败时打印位置并继续执行，main最后用checkResult()返回是否全部通过
+//
+
+#ifndef check_hpp
+#define check_hpp
+
+#include <cstdio>
+
+inline int& checkFailures(){
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond) \
+    do{ \
+        if(!(cond)){ \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            checkFailures()++; \
+        } \
+    }while(0)
+
+//全部通过返回0，作为main的返回值给ctest
+inline int checkResult(){
+    if(checkFailures() > 0){
+        std::fprintf(stderr, "%d check(s) failed\n", checkFailures());
+        return 1;
+    }
+    return 0;
+}
+
+#endif /* check_hpp */
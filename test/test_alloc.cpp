@@ -0,0 +1,130 @@
+//
+//  test_alloc.cpp
+//  test
+//
+//  替换全局operator new计数，检查提交小的可调用对象时每个任务的堆分配次数
+//  TaskFunc的内部缓冲区放得下任务函数和std::promise，promise的共享状态和任务队列的块从slab缓存分配，
+//  预热以后稳定状态下提交任务不应该再调用operator new
+//
+
+#include "check.hpp"
+#include "../ThreadPool2.0/threadpool.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <new>
+#include <vector>
+
+namespace {
+
+std::atomic_bool counting(false);
+std::atomic<uint64_t> allocations(0);
+
+void* countedAlloc(size_t bytes, size_t align = 0){
+    if(counting.load(std::memory_order_relaxed))
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    if(bytes == 0)
+        bytes = 1;
+    void* p = align > alignof(std::max_align_t) ? std::aligned_alloc(align, (bytes + align - 1) / align * align) : std::malloc(bytes);
+    if(p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+}
+
+void* operator new(size_t bytes){
+    return countedAlloc(bytes);
+}
+void* operator new[](size_t bytes){
+    return countedAlloc(bytes);
+}
+void* operator new(size_t bytes, std::align_val_t align){
+    return countedAlloc(bytes, (size_t)align);
+}
+void* operator new[](size_t bytes, std::align_val_t align){
+    return countedAlloc(bytes, (size_t)align);
+}
+void operator delete(void* p) noexcept{
+    std::free(p);
+}
+void operator delete[](void* p) noexcept{
+    std::free(p);
+}
+void operator delete(void* p, size_t) noexcept{
+    std::free(p);
+}
+void operator delete[](void* p, size_t) noexcept{
+    std::free(p);
+}
+void operator delete(void* p, std::align_val_t) noexcept{
+    std::free(p);
+}
+void operator delete[](void* p, std::align_val_t) noexcept{
+    std::free(p);
+}
+void operator delete(void* p, size_t, std::align_val_t) noexcept{
+    std::free(p);
+}
+void operator delete[](void* p, size_t, std::align_val_t) noexcept{
+    std::free(p);
+}
+
+namespace {
+
+int add(int a, int b){
+    return a + b;
+}
+
+const size_t TASKS = 100000;
+
+//提交TASKS个小任务并等待完成，返回每个任务的operator new次数；先跑一轮预热slab缓存和队列
+template<typename Submit>
+double allocsPerTask(ThreadPool& pool, Submit submit){
+    std::vector<std::future<int>> futures;
+    futures.reserve(TASKS);
+    for(int round = 0; round < 2; round++){
+        futures.clear();
+        allocations = 0;
+        counting = round == 1;
+        for(size_t i = 0; i < TASKS; i++){
+            futures.push_back(submit(pool, (int)i));
+        }
+        for(auto& f : futures){
+            f.get();
+        }
+        counting = false;
+    }
+    return (double)allocations.load() / TASKS;
+}
+
+void measure(const char* name, QueueMode mode, bool workStealing){
+    ThreadPool pool;
+    pool.setQueueMode(mode);
+    pool.setWorkStealing(workStealing);
+    pool.setTaskQueMaxThreshHold((int)TASKS);
+    pool.start(2);
+    double fn = allocsPerTask(pool, [](ThreadPool& p, int i){return p.submitTask(add, i, 1);});
+    double lambda = allocsPerTask(pool, [](ThreadPool& p, int i){return p.submitTask([i](){return i + 1;});});
+    std::printf("%-10s submitTask(add, i, 1): %.4f allocs/task, submitTask([i]{...}): %.4f allocs/task\n", name, fn, lambda);
+#if THREADPOOL_SLAB
+    //偶尔扩充deque的索引数组或者切新的slab，平均下来接近0
+    CHECK(fn < 0.01);
+    CHECK(lambda < 0.01);
+#else
+    //关闭slab时std::promise的共享状态和返回值各分配一次，互斥锁队列的deque每8个任务分配一个块
+    CHECK(fn < 2.2);
+    CHECK(lambda < 2.2);
+#endif
+}
+
+}
+
+int main(){
+    measure("mutex", QueueMode::MODE_MUTEX, false);
+    measure("lockfree", QueueMode::MODE_LOCKFREE, false);
+    measure("sharded", QueueMode::MODE_SHARDED, false);
+    measure("ws", QueueMode::MODE_MUTEX, true);
+    return checkResult();
+}
@@ -0,0 +1,178 @@
+//
+//  test_coroutine.cpp
+//  test
+//
+//  协程在线程池ABORT关闭、关闭以后和队列满时的行为：等待恢复的协程不能永远挂起，也不能在当前线程悄悄继续
+//
+
+#include "check.hpp"
+#include "../ThreadPool2.0/coroutine.hpp"
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+namespace {
+
+CoTask<int> hop(ThreadPool& pool){
+    co_await pool.schedule();
+    co_return 1;
+}
+
+template<typename T>
+CoTask<T> awaitFuture(PoolFuture<T> future){
+    T value = co_await std::move(future);
+    co_return value;
+}
+
+//唯一的线程被占住时提交的协程只能排队，ABORT关闭丢弃它以后syncWait抛出PoolShutdownError，而不是一直等下去
+void scheduleAbandonedOnAbort(){
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(64);
+    pool.start(1);
+    std::promise<void> started;
+    pool.submitTask([&](){
+        started.set_value();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    });
+    started.get_future().wait();
+    auto waiter = std::async(std::launch::async, [&]()->bool {
+        try{
+            syncWait(hop(pool));
+        }
+        catch(const PoolShutdownError&){
+            return true;
+        }
+        return false;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    pool.shutdown(ShutdownMode::SHUTDOWN_ABORT);
+    CHECK(waiter.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    CHECK(waiter.get());
+}
+
+//co_await PoolFuture：结果在另一个线程池上就绪，恢复协程的任务排在这个线程池的队列里被ABORT丢弃，co_await抛出PoolShutdownError
+void awaitAbandonedOnAbort(){
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(64);
+    pool.start(1);
+    ThreadPool other;
+    other.setTaskQueMaxThreshHold(64);
+    other.start(1);
+    std::vector<PoolFuture<int>> parts;
+    parts.push_back(pool.submitAsync([](){return 1;}));
+    parts.front().wait();
+    parts.push_back(other.submitAsync([](){
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return 2;
+    }));
+    //whenAll的结果属于第一个输入的线程池，协程在pool上恢复
+    auto all = whenAll(std::move(parts));
+    std::promise<void> started;
+    pool.submitTask([&](){
+        started.set_value();
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    });
+    started.get_future().wait();
+    auto waiter = std::async(std::launch::async, [&]()->bool {
+        try{
+            syncWait(awaitFuture(std::move(all)));
+        }
+        catch(const PoolShutdownError&){
+            return true;
+        }
+        return false;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    pool.shutdown(ShutdownMode::SHUTDOWN_ABORT);
+    CHECK(waiter.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    CHECK(waiter.get());
+}
+
+//spawn的协程在线程池ABORT关闭前没有开始，返回的PoolFuture完成为PoolShutdownError
+void spawnAbandonedOnAbort(){
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(64);
+    pool.start(1);
+    std::promise<void> started;
+    pool.submitTask([&](){
+        started.set_value();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    });
+    started.get_future().wait();
+    PoolFuture<int> future = pool.spawn(hop(pool));
+    pool.shutdown(ShutdownMode::SHUTDOWN_ABORT);
+    bool shutdownError = false;
+    try{
+        future.get();
+    }
+    catch(const PoolShutdownError&){
+        shutdownError = true;
+    }
+    CHECK(shutdownError);
+}
+
+//线程池关闭以后co_await pool.schedule()抛出PoolShutdownError，不在当前线程继续执行
+void scheduleAfterShutdown(){
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(64);
+    pool.start(1);
+    pool.shutdown(ShutdownMode::SHUTDOWN_DRAIN);
+    bool shutdownError = false;
+    try{
+        syncWait(hop(pool));
+    }
+    catch(const PoolShutdownError&){
+        shutdownError = true;
+    }
+    CHECK(shutdownError);
+}
+
+//FAIL_FAST策略下任务队列满时co_await pool.schedule()抛出TaskRejectedError
+void scheduleRejectedWhenFull(){
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(1);
+    pool.setOverloadPolicy(OverloadPolicy::OVERLOAD_FAIL_FAST);
+    pool.start(1);
+    std::promise<void> started;
+    std::promise<void> release;
+    auto releaseFuture = release.get_future().share();
+    pool.submitTask([&started, releaseFuture](){
+        started.set_value();
+        releaseFuture.wait();
+    });
+    started.get_future().wait();
+    auto queued = pool.submitTask([](){});
+    bool rejected = false;
+    try{
+        syncWait(hop(pool));
+    }
+    catch(const TaskRejectedError&){
+        rejected = true;
+    }
+    CHECK(rejected);
+    release.set_value();
+    CHECK(queued.wait_for(std::chrono::seconds(2)) == std::future_status::ready);
+}
+
+//正常情况下协程照常在线程池上恢复
+void scheduleRuns(){
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(64);
+    pool.start(2);
+    CHECK(syncWait(hop(pool)) == 1);
+    CHECK(syncWait(awaitFuture(pool.submitAsync([](){return 2;}))) == 2);
+    CHECK(pool.spawn(hop(pool)).get() == 1);
+}
+
+}
+
+int main(){
+    scheduleRuns();
+    scheduleAbandonedOnAbort();
+    awaitAbandonedOnAbort();
+    spawnAbandonedOnAbort();
+    scheduleAfterShutdown();
+    scheduleRejectedWhenFull();
+    return checkResult();
+}
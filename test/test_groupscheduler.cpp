@@ -0,0 +1,165 @@
+//
+//  test_groupscheduler.cpp
+//  test
+//
+//  任务组调度：deficit round-robin按权重分配执行机会，maxConcurrency限制同时执行的任务数量，
+//  令牌没能放入线程池时拒绝最新提交的任务，组内仍然是FIFO
+//
+
+#include "check.hpp"
+#include "../ThreadPool2.0/threadpool.hpp"
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Scheduler = GroupScheduler<int>;
+
+//权重3:1的两个组都有任务排队时，每一轮a执行3个、b执行1个，组内按提交顺序
+void drrWeights(){
+    Scheduler scheduler;
+    auto* a = scheduler.addGroup("a", 3, 0);
+    auto* b = scheduler.addGroup("b", 1, 0);
+    size_t tokens = 0;
+    for(int i = 0; i < 12; i++){
+        tokens += scheduler.push(a, (int)i);
+        tokens += scheduler.push(b, 100 + i);
+    }
+    CHECK(tokens == 24);
+    int fromA = 0, fromB = 0, nextA = 0, nextB = 100;
+    for(int i = 0; i < 16; i++){
+        int task = -1;
+        auto* g = scheduler.pop(task);
+        CHECK(g == a || g == b);
+        if(g == a){
+            fromA++;
+            CHECK(task == nextA++);
+        }
+        else{
+            fromB++;
+            CHECK(task == nextB++);
+        }
+        CHECK(scheduler.finish(g, 0) == 0);
+        //每一轮4个任务里a占3个
+        if(i % 4 == 3){
+            CHECK(fromA == (i + 1) / 4 * 3);
+            CHECK(fromB == (i + 1) / 4);
+        }
+    }
+    //a的任务执行完以后b独占执行机会
+    for(int i = 0; i < 8; i++){
+        int task = -1;
+        CHECK(scheduler.pop(task) == b);
+        CHECK(task == nextB++);
+        scheduler.finish(b, 0);
+    }
+    int task = -1;
+    CHECK(scheduler.pop(task) == nullptr);
+    CHECK(scheduler.stats(a).completed == 12);
+    CHECK(scheduler.stats(b).completed == 12);
+}
+
+//达到并发上限的组不发令牌，执行完一个任务才补一个令牌
+void maxConcurrency(){
+    Scheduler scheduler;
+    auto* g = scheduler.addGroup("limited", 1, 2);
+    size_t tokens = 0;
+    for(int i = 0; i < 5; i++){
+        tokens += scheduler.push(g, (int)i);
+    }
+    CHECK(tokens == 2);
+    int first = -1, second = -1;
+    CHECK(scheduler.pop(first) == g);
+    CHECK(scheduler.pop(second) == g);
+    CHECK(first == 0 && second == 1);
+    CHECK(scheduler.stats(g).running == 2);
+    CHECK(scheduler.stats(g).queued == 3);
+    CHECK(scheduler.finish(g, 0) == 1);
+    int third = -1;
+    CHECK(scheduler.pop(third) == g && third == 2);
+    CHECK(scheduler.finish(g, 0) == 1);
+    CHECK(scheduler.finish(g, 0) == 1);
+    CHECK(scheduler.stats(g).running == 0);
+}
+
+//令牌放不进线程池时拒绝最新提交的任务；丢弃的令牌按DRR取出一个任务不执行
+void rejectAndDrop(){
+    Scheduler scheduler;
+    auto* g = scheduler.addGroup("g", 1, 0);
+    for(int i = 0; i < 4; i++){
+        scheduler.push(g, (int)i);
+    }
+    std::vector<int> rejected;
+    scheduler.reject(g, 2, rejected);
+    CHECK(rejected == std::vector<int>({3, 2}));
+    int task = -1;
+    CHECK(scheduler.drop(task) && task == 0);
+    CHECK(scheduler.pop(task) == g && task == 1);
+    CHECK(scheduler.pop(task) == nullptr);
+    GroupStats stats = scheduler.stats(g);
+    CHECK(stats.submitted == 4);
+    CHECK(stats.rejected == 3);
+    CHECK(stats.queued == 0);
+
+    bool threw = false;
+    try{
+        scheduler.addGroup("g", 1, 0);
+    }
+    catch(const std::invalid_argument&){
+        threw = true;
+    }
+    CHECK(threw);
+    threw = false;
+    try{
+        scheduler.addGroup("zero", 0, 0);
+    }
+    catch(const std::invalid_argument&){
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+//线程池上maxConcurrency为1的组即使有多个空闲线程也一个一个执行
+void poolGroupConcurrency(){
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(64);
+    pool.start(4);
+    TaskGroup group = pool.createGroup("serial", 1, 1);
+    std::atomic_int running(0);
+    std::atomic_int peak(0);
+    std::vector<std::future<void>> futures;
+    for(int i = 0; i < 20; i++){
+        futures.push_back(group.submitTask([&](){
+            int now = ++running;
+            int seen = peak.load();
+            while(now > seen && !peak.compare_exchange_weak(seen, now)){}
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            running--;
+        }));
+    }
+    for(auto& f : futures){
+        CHECK(f.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    }
+    CHECK(peak == 1);
+    //future先完成，组的统计随后才更新
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while(group.stats().completed < 20 && std::chrono::steady_clock::now() < deadline){
+        std::this_thread::yield();
+    }
+    CHECK(group.stats().completed == 20);
+}
+
+}
+
+int main(){
+    drrWeights();
+    maxConcurrency();
+    rejectAndDrop();
+    poolGroupConcurrency();
+    return checkResult();
+}
@@ -0,0 +1,203 @@
+//
+//  test_queue_modes.cpp
+//  test
+//
+//  2.0线程池各种任务队列模式下提交的任务都要执行，包括start之前提交的任务
+//
+
+#include "check.hpp"
+#include "../ThreadPool2.0/threadpool.hpp"
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <exception>
+#include <future>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int TASKS = 16;
+
+bool ready(std::future<int>& f){
+    return f.wait_for(std::chrono::seconds(2)) == std::future_status::ready;
+}
+
+//start之前提交的任务：start换成无锁队列或者分片队列以后也要执行
+void submitBeforeStart(QueueMode mode){
+    ThreadPool pool;
+    pool.setQueueMode(mode);
+    pool.setTaskQueMaxThreshHold(64);
+    std::vector<std::future<int>> futures;
+    for(int i = 0; i < TASKS; i++){
+        futures.push_back(pool.submitTask([i](){return i;}));
+    }
+    pool.start(2);
+    for(int i = 0; i < TASKS; i++){
+        CHECK(ready(futures[i]));
+        if(ready(futures[i]))
+            CHECK(futures[i].get() == i);
+    }
+}
+
+//提交以后又调小了队列容量：新队列放得下的任务执行，放不下的任务完成为TaskRejectedError，不会一直挂着
+void thresholdLoweredBeforeStart(QueueMode mode){
+    ThreadPool pool;
+    pool.setQueueMode(mode);
+    pool.setTaskQueMaxThreshHold(64);
+    std::vector<std::future<int>> futures;
+    for(int i = 0; i < TASKS; i++){
+        futures.push_back(pool.submitTask([i](){return i;}));
+    }
+    pool.setTaskQueMaxThreshHold(4);
+    pool.start(2);
+    int done = 0;
+    int rejected = 0;
+    for(auto& f : futures){
+        CHECK(ready(f));
+        if(!ready(f))
+            continue;
+        try{
+            f.get();
+            done++;
+        }
+        catch(const TaskRejectedError&){
+            rejected++;
+        }
+    }
+    CHECK(done >= 4);
+    CHECK(done + rejected == TASKS);
+    CHECK(pool.overloadStats().rejected == (uint64_t)rejected);
+}
+
+//start之前提交、没有等待结果就析构线程池：DRAIN关闭要执行完这些任务，不能把它们留在taskQue_里丢掉
+void destroyedAfterStartDrains(QueueMode mode){
+    std::atomic_int ran(0);
+    {
+        ThreadPool pool;
+        pool.setQueueMode(mode);
+        pool.setTaskQueMaxThreshHold(64);
+        for(int i = 0; i < TASKS; i++){
+            pool.submitTask([&](){ran++;});
+        }
+        pool.start(2);
+    }
+    CHECK(ran == TASKS);
+}
+
+//start之前按优先级提交：优先级队列在构造时就存在，start以后高优先级的任务先执行
+void priorityBeforeStart(QueueMode mode){
+    ThreadPool pool;
+    pool.setQueueMode(mode);
+    pool.setTaskQueMaxThreshHold(64);
+    pool.setPriorityAging(std::chrono::seconds(10));
+    std::mutex mtx;
+    std::vector<int> order;
+    std::vector<std::future<int>> futures;
+    auto record = [&](int i){
+        std::lock_guard<std::mutex> lock(mtx);
+        order.push_back(i);
+        return i;
+    };
+    futures.push_back(pool.submitTask(TaskPriority::PRIORITY_LOW, record, 2));
+    futures.push_back(pool.submitTask(TaskPriority::PRIORITY_NORMAL, record, 1));
+    futures.push_back(pool.submitTask(TaskPriority::PRIORITY_HIGH, record, 0));
+    pool.start(1);
+    for(int i = 0; i < 3; i++){
+        CHECK(ready(futures[i]));
+        if(ready(futures[i]))
+            CHECK(futures[i].get() == 2 - i);
+    }
+    CHECK(order == std::vector<int>({0, 1, 2}));
+}
+
+//start以后提交的任务
+void submitAfterStart(QueueMode mode){
+    ThreadPool pool;
+    pool.setQueueMode(mode);
+    pool.setTaskQueMaxThreshHold(64);
+    pool.start(2);
+    std::vector<std::future<int>> futures;
+    for(int i = 0; i < TASKS; i++){
+        futures.push_back(pool.submitTask([i](){return i;}));
+    }
+    for(int i = 0; i < TASKS; i++){
+        CHECK(ready(futures[i]));
+        if(ready(futures[i]))
+            CHECK(futures[i].get() == i);
+    }
+}
+
+//工作窃取模式下fixed模式的resize：本地队列按线程数量上限创建，setThreadSizeThreshHold在fixed模式下也生效
+void resizeWorkStealing(){
+    {
+        ThreadPool pool;
+        pool.setWorkStealing(true);
+        pool.setThreadSizeThreshHold(32);
+        pool.setTaskQueMaxThreshHold(64);
+        pool.start(4);
+        CHECK(pool.resize(32) == 32);
+        CHECK(pool.resize(64) == 32);
+        auto f = pool.submitTask([](){return 1;});
+        CHECK(ready(f));
+        CHECK(pool.resize(2) == 2);
+    }
+    {
+        //没有设置时至少可以扩到cpu核数
+        ThreadPool pool;
+        pool.setWorkStealing(true);
+        pool.start(1);
+        int cpus = std::max(10, (int)std::thread::hardware_concurrency());
+        CHECK(pool.resize(cpus) == cpus);
+    }
+}
+
+
+//嵌套的fork-join：子任务已经在另一个线程上执行时，等待的工作线程没有任务可做，应该睡眠而不是一直自旋占用CPU，子任务完成后被唤醒
+void helpUntilParks(bool stealing){
+    ThreadPool pool;
+    pool.setWorkStealing(stealing);
+    pool.setTaskQueMaxThreshHold(64);
+    pool.start(2);
+    std::clock_t cpuStart = std::clock();
+    auto f = pool.submitTask([&pool]()->int {
+        std::atomic_int ran(0);
+        std::atomic_bool started(false);
+        auto bulk = pool.submitBulk(0, 1, [&](int){
+            started = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+            ran++;
+        });
+        while(!started){
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        bulk.wait();
+        return ran.load();
+    });
+    CHECK(ready(f));
+    CHECK(f.get() == 1);
+    double cpuMs = (std::clock() - cpuStart) * 1000.0 / CLOCKS_PER_SEC;
+    CHECK(cpuMs < 150);
+}
+
+}
+
+int main(){
+    for(QueueMode mode : {QueueMode::MODE_MUTEX, QueueMode::MODE_LOCKFREE, QueueMode::MODE_SHARDED}){
+        submitAfterStart(mode);
+        submitBeforeStart(mode);
+    }
+    thresholdLoweredBeforeStart(QueueMode::MODE_MUTEX);
+    thresholdLoweredBeforeStart(QueueMode::MODE_LOCKFREE);
+    thresholdLoweredBeforeStart(QueueMode::MODE_SHARDED);
+    destroyedAfterStartDrains(QueueMode::MODE_SHARDED);
+    for(QueueMode mode : {QueueMode::MODE_MUTEX, QueueMode::MODE_LOCKFREE, QueueMode::MODE_SHARDED}){
+        priorityBeforeStart(mode);
+    }
+    resizeWorkStealing();
+    helpUntilParks(false);
+    helpUntilParks(true);
+    return checkResult();
+}
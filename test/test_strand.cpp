@@ -0,0 +1,128 @@
+//
+//  test_strand.cpp
+//  test
+//
+//  strand和submitKeyed：多个线程同时提交，同一个strand（同一个key）的任务按提交顺序一个一个执行，
+//  不同的strand仍然并行；执行任务重新排队（超过STRAND_BATCH_SIZE）以后顺序也不变
+//
+
+#include "check.hpp"
+#include "../ThreadPool2.0/threadpool.hpp"
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int PRODUCERS = 4;
+const int PER_PRODUCER = 500;
+
+//同一个strand里只能有一个任务在执行，每个提交线程自己的任务按它提交的顺序执行
+struct StrandLog{
+    std::atomic_int running{0};
+    std::atomic_int overlaps{0};
+    std::vector<int> last = std::vector<int>(PRODUCERS, -1);//不加锁，只有正在执行的那个任务访问
+    int outOfOrder = 0;
+    int ran = 0;
+
+    void record(int producer, int seq){
+        if(running.fetch_add(1) != 0)
+            overlaps++;
+        if(seq != last[producer] + 1)
+            outOfOrder++;
+        last[producer] = seq;
+        ran++;
+        running.fetch_sub(1);
+    }
+};
+
+void strandFifo(bool stealing){
+    ThreadPool pool;
+    pool.setWorkStealing(stealing);
+    pool.setTaskQueMaxThreshHold(1024);
+    pool.start(4);
+    Strand strand = pool.strand();
+    StrandLog log;
+    std::vector<std::thread> producers;
+    std::vector<std::future<void>> last(PRODUCERS);
+    for(int p = 0; p < PRODUCERS; p++){
+        producers.emplace_back([&, p](){
+            for(int i = 0; i < PER_PRODUCER; i++){
+                auto f = strand.submitTask([&log, p, i](){log.record(p, i);});
+                if(i == PER_PRODUCER - 1)
+                    last[p] = std::move(f);
+            }
+        });
+    }
+    for(auto& t : producers){
+        t.join();
+    }
+    for(auto& f : last){
+        CHECK(f.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    }
+    CHECK(log.overlaps == 0);
+    CHECK(log.outOfOrder == 0);
+    CHECK(log.ran == PRODUCERS * PER_PRODUCER);
+    //future先完成，pending随后才减到0
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while(strand.pendingTaskSize() != 0 && std::chrono::steady_clock::now() < deadline){
+        std::this_thread::yield();
+    }
+    CHECK(strand.pendingTaskSize() == 0);
+}
+
+//同一个key的任务串行并且有序
+void keyedOrdering(){
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(1024);
+    pool.setKeyedStrandSize(64);
+    pool.start(4);
+    const int KEYS = 8;
+    std::vector<StrandLog> logs(KEYS);
+    std::vector<std::future<void>> futures;
+    for(int i = 0; i < PER_PRODUCER; i++){
+        for(int k = 0; k < KEYS; k++){
+            futures.push_back(pool.submitKeyed(k, [&logs, k, i](){logs[k].record(0, i);}));
+        }
+    }
+    for(auto& f : futures){
+        CHECK(f.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    }
+    for(auto& log : logs){
+        CHECK(log.overlaps == 0);
+        CHECK(log.outOfOrder == 0);
+        CHECK(log.ran == PER_PRODUCER);
+    }
+}
+
+//两个strand各有一个任务等对方开始，只有不同的strand能同时执行才会完成
+void strandsRunInParallel(){
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(64);
+    pool.start(2);
+    std::atomic_int started(0);
+    auto wait = [&started](){
+        started++;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while(started < 2 && std::chrono::steady_clock::now() < deadline){
+            std::this_thread::yield();
+        }
+        return started.load();
+    };
+    auto a = pool.strand().submitTask(wait);
+    auto b = pool.strand().submitTask(wait);
+    CHECK(a.get() == 2);
+    CHECK(b.get() == 2);
+}
+
+}
+
+int main(){
+    strandFifo(false);
+    strandFifo(true);
+    keyedOrdering();
+    strandsRunInParallel();
+    return checkResult();
+}
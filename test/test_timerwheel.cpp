@@ -0,0 +1,154 @@
+//
+//  test_timerwheel.cpp
+//  test
+//
+//  分层时间轮：跨层的定时器经过cascade以后正好在到期的tick被取出，槽位绕回一圈以后也一样；
+//  nextEvent不会越过最早的到期时间；线程池关闭以后submitEvery返回无效的TimerHandle
+//
+
+#include "check.hpp"
+#include "../ThreadPool2.0/threadpool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct Node : TimerWheelNode{
+    int fired = 0;
+    uint64_t firedAt = 0;
+};
+
+//推进到to，检查每个节点都在自己到期的tick被取出
+void advanceTo(TimerWheel& wheel, uint64_t to){
+    wheel.advance(to, [&](TimerWheelNode* n){
+        Node* node = static_cast<Node*>(n);
+        node->fired++;
+        node->firedAt = wheel.now();
+    });
+}
+
+//跨越每一层边界的定时器，一次推进到最远的到期时间
+void cascadeAcrossLevels(){
+    TimerWheel wheel;
+    std::vector<uint64_t> expiries;
+    for(int l = 0; l <= TimerWheel::LEVELS; l++){
+        uint64_t span = 1ull << (TimerWheel::SLOT_BITS * l);
+        for(uint64_t e : {span - 1, span, span + 1, span * 3 + 7}){
+            if(e > 0)
+                expiries.push_back(e);
+        }
+    }
+    std::vector<Node> nodes(expiries.size());
+    for(size_t i = 0; i < nodes.size(); i++){
+        nodes[i].expiry = expiries[i];
+        CHECK(wheel.insert(&nodes[i]));
+    }
+    CHECK(wheel.size() == nodes.size());
+    advanceTo(wheel, *std::max_element(expiries.begin(), expiries.end()));
+    CHECK(wheel.empty());
+    for(auto& node : nodes){
+        CHECK(node.fired == 1);
+        CHECK(node.firedAt == node.expiry);
+    }
+}
+
+//随机的到期时间，按nextEvent一步一步推进，中途在当前时间之后再插入新的定时器，
+//让低层和高层的槽都绕回好几圈
+void wrapAround(){
+    TimerWheel wheel;
+    std::mt19937_64 rng(42);
+    std::vector<Node> nodes(4000);
+    size_t inserted = 0;
+    auto insertSome = [&](size_t count){
+        for(size_t i = 0; i < count && inserted < nodes.size(); i++, inserted++){
+            int level = (int)(rng() % 4);
+            uint64_t range = 1ull << (TimerWheel::SLOT_BITS * level + TimerWheel::SLOT_BITS);
+            nodes[inserted].expiry = wheel.now() + 1 + rng() % range;
+            CHECK(wheel.insert(&nodes[inserted]));
+        }
+    };
+    insertSome(1000);
+    while(!wheel.empty()){
+        uint64_t earliest = TimerWheel::NEVER;
+        for(size_t i = 0; i < inserted; i++){
+            if(nodes[i].fired == 0)
+                earliest = std::min(earliest, nodes[i].expiry);
+        }
+        uint64_t next = wheel.nextEvent();
+        CHECK(next > wheel.now());
+        CHECK(next <= earliest);
+        //有时一步一步推进，有时一次跳过好几个事件
+        uint64_t to = rng() % 2 == 0 ? next : next + rng() % 5000;
+        advanceTo(wheel, to);
+        CHECK(wheel.now() == to);
+        insertSome(rng() % 40);
+    }
+    CHECK(inserted == nodes.size());
+    for(auto& node : nodes){
+        CHECK(node.fired == 1);
+        CHECK(node.firedAt == node.expiry);
+    }
+}
+
+//超过时间轮范围的定时器先放在最高层，到时候重新放入，仍然在到期的tick被取出
+void beyondRange(){
+    TimerWheel wheel;
+    advanceTo(wheel, 12345);
+    Node far;
+    far.expiry = wheel.now() + (1ull << (TimerWheel::SLOT_BITS * TimerWheel::LEVELS)) + 100;
+    CHECK(wheel.insert(&far));
+    Node past;
+    past.expiry = wheel.now();
+    CHECK(!wheel.insert(&past));
+    advanceTo(wheel, far.expiry - 1);
+    CHECK(far.fired == 0);
+    advanceTo(wheel, far.expiry);
+    CHECK(far.fired == 1);
+    CHECK(far.firedAt == far.expiry);
+}
+
+//摘下的定时器不再到期，位图随着清空
+void removeBeforeDue(){
+    TimerWheel wheel;
+    Node a, b;
+    a.expiry = 5000;
+    b.expiry = 5000;
+    CHECK(wheel.insert(&a));
+    CHECK(wheel.insert(&b));
+    wheel.remove(&a);
+    CHECK(!a.linked);
+    CHECK(wheel.size() == 1);
+    advanceTo(wheel, 10000);
+    CHECK(a.fired == 0);
+    CHECK(b.fired == 1);
+    CHECK(wheel.nextEvent() == TimerWheel::NEVER);
+}
+
+void submitEveryAfterShutdown(){
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(64);
+    pool.start(1);
+    TimerHandle running = pool.submitEvery(std::chrono::milliseconds(5), [](){});
+    CHECK(running.valid());
+    CHECK(running.pending());
+    pool.shutdown(ShutdownMode::SHUTDOWN_DRAIN);
+    CHECK(!running.pending());
+    TimerHandle stopped = pool.submitEvery(std::chrono::milliseconds(5), [](){});
+    CHECK(!stopped.valid());
+    CHECK(!stopped.pending());
+    CHECK(!stopped.cancel());
+}
+
+}
+
+int main(){
+    cascadeAcrossLevels();
+    wrapAround();
+    beyondRange();
+    removeBeforeDue();
+    submitEveryAfterShutdown();
+    return checkResult();
+}
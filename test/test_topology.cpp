@@ -0,0 +1,119 @@
+//
+//  test_topology.cpp
+//  test
+//
+//  CpuTopology::load读取临时目录里伪造的sysfs：两个物理cpu，每个核两个超线程，每个物理cpu一个L3
+//
+
+#include "check.hpp"
+#include "../ThreadPool2.0/topology.hpp"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void writeFile(const fs::path& path, const std::string& text){
+    fs::create_directories(path.parent_path());
+    std::ofstream(path) << text << "\n";
+}
+
+//伪造的/sys/devices/system/cpu，析构时删除
+class FakeSysfs{
+public:
+    FakeSysfs(){
+        std::string pattern = (fs::temp_directory_path() / "topologyXXXXXX").string();
+        root_ = mkdtemp(pattern.data());
+    }
+    ~FakeSysfs(){
+        std::error_code ec;
+        fs::remove_all(root_, ec);
+    }
+    const fs::path& root() const{
+        return root_;
+    }
+    void cpu(int cpu, int package, int coreId, const std::string& l3Shared){
+        fs::path dir = root_ / ("cpu" + std::to_string(cpu));
+        writeFile(dir / "topology/physical_package_id", std::to_string(package));
+        writeFile(dir / "topology/core_id", std::to_string(coreId));
+        if(l3Shared.empty())
+            return;
+        writeFile(dir / "cache/index0/level", "1");
+        writeFile(dir / "cache/index0/shared_cpu_list", std::to_string(cpu));
+        writeFile(dir / "cache/index1/level", "2");
+        writeFile(dir / "cache/index1/shared_cpu_list", std::to_string(cpu));
+        writeFile(dir / "cache/index2/level", "3");
+        writeFile(dir / "cache/index2/shared_cpu_list", l3Shared);
+    }
+private:
+    fs::path root_;
+};
+
+std::vector<int> cpusOf(const std::vector<CpuInfo>& order){
+    std::vector<int> cpus;
+    for(auto& c : order){
+        cpus.push_back(c.cpu);
+    }
+    return cpus;
+}
+
+//Linux常见的编号方式：先给每个物理核编号，超线程排在后面
+//物理cpu0：核{0,4}、{1,5}；物理cpu1：核{2,6}、{3,7}；core_id只在物理cpu内唯一
+void twoPackagesWithSmt(){
+    FakeSysfs sysfs;
+    writeFile(sysfs.root() / "online", "0-7");
+    sysfs.cpu(0, 0, 0, "0-1,4-5");
+    sysfs.cpu(1, 0, 1, "0-1,4-5");
+    sysfs.cpu(2, 1, 0, "2-3,6-7");
+    sysfs.cpu(3, 1, 1, "2-3,6-7");
+    sysfs.cpu(4, 0, 0, "0-1,4-5");
+    sysfs.cpu(5, 0, 1, "0-1,4-5");
+    sysfs.cpu(6, 1, 0, "2-3,6-7");
+    sysfs.cpu(7, 1, 1, "2-3,6-7");
+    CpuTopology topo = CpuTopology::load(sysfs.root().string());
+
+    CHECK(topo.cpus().size() == 8);
+    CHECK(topo.coreCount() == 4);
+    for(auto& c : topo.cpus()){
+        CHECK(c.package == (c.cpu % 4 < 2 ? 0 : 1));
+        CHECK(c.l3 == (c.package == 0 ? 0 : 2));
+        CHECK(c.core == c.cpu % 4);
+        CHECK(c.smtIndex == (c.cpu < 4 ? 0 : 1));
+    }
+    //同一个L3的cpu连在一起，缓存域内先用不同的物理核，再用超线程
+    CHECK(cpusOf(topo.placement({}, true)) == (std::vector<int>{0, 1, 4, 5, 2, 3, 6, 7}));
+    CHECK(cpusOf(topo.placement({}, false)) == (std::vector<int>{0, 1, 2, 3}));
+    //allowed里的顺序不影响结果
+    CHECK(cpusOf(topo.placement({7, 5, 2, 0}, true)) == (std::vector<int>{0, 5, 2, 7}));
+    CHECK(cpusOf(topo.placement({7, 5, 2, 0}, false)) == (std::vector<int>{0, 2}));
+}
+
+//没有online文件和缓存信息：按编号探测cpu，L3按物理cpu划分
+void missingOnlineAndCache(){
+    FakeSysfs sysfs;
+    sysfs.cpu(0, 0, 0, "");
+    sysfs.cpu(1, 0, 0, "");
+    sysfs.cpu(2, 1, 0, "");
+    sysfs.cpu(3, 1, 0, "");
+    CpuTopology topo = CpuTopology::load(sysfs.root().string());
+
+    CHECK(topo.cpus().size() == 4);
+    CHECK(topo.coreCount() == 2);
+    for(auto& c : topo.cpus()){
+        CHECK(c.l3 == (c.package == 0 ? 0 : 2));
+    }
+    CHECK(cpusOf(topo.placement({}, true)) == (std::vector<int>{0, 1, 2, 3}));
+    CHECK(cpusOf(topo.placement({}, false)) == (std::vector<int>{0, 2}));
+}
+
+}
+
+int main(){
+    twoPackagesWithSmt();
+    missingOnlineAndCache();
+    return checkResult();
+}
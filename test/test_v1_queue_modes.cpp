@@ -0,0 +1,222 @@
+//
+//  test_v1_queue_modes.cpp
+//  test
+//
+//  v1线程池各种任务队列模式下提交的任务都要执行，包括start之前提交的任务
+//
+
+#include "check.hpp"
+#include "../ThreadPool/threadpool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+const int TASKS = 16;
+
+class ValueTask : public TypedTask<int>{
+public:
+    explicit ValueTask(int value) : value_(value){}
+    int run() override{
+        return value_;
+    }
+private:
+    int value_;
+};
+
+//等待任务完成，最多等待2s，结果没有完成说明任务被丢在了某个队列里
+template<typename T>
+bool finished(TypedResult<T>& res){
+    for(int i = 0; i < 200 && !res.ready(); i++){
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return res.ready();
+}
+
+//start之前提交的任务：start换成无锁队列以后也要执行
+void submitBeforeStart(QueueMode mode){
+    ThreadPool pool;
+    pool.setQueueMode(mode);
+    std::vector<TypedResult<int>> results;
+    for(int i = 0; i < TASKS; i++){
+        results.push_back(pool.submitTask(makeTask<ValueTask>(i)));
+    }
+    pool.start(2);
+    for(int i = 0; i < TASKS; i++){
+        CHECK(results[i].isVaild());
+        CHECK(finished(results[i]));
+        if(results[i].ready())
+            CHECK(results[i].get() == i);
+    }
+}
+
+//提交以后又调小了队列容量：环形队列放不下的任务完成为TaskRejectedError
+void thresholdLoweredBeforeStart(){
+    ThreadPool pool;
+    pool.setQueueMode(QueueMode::MODE_LOCKFREE);
+    std::vector<TypedResult<int>> results;
+    for(int i = 0; i < TASKS; i++){
+        results.push_back(pool.submitTask(makeTask<ValueTask>(i)));
+    }
+    pool.setTaskQueMaxThreshHold(4);
+    pool.start(2);
+    int done = 0;
+    int rejected = 0;
+    for(auto& res : results){
+        CHECK(finished(res));
+        if(!res.ready())
+            continue;
+        try{
+            res.get();
+            done++;
+        }
+        catch(const TaskRejectedError&){
+            rejected++;
+        }
+    }
+    CHECK(done >= 4);
+    CHECK(done + rejected == TASKS);
+}
+
+//start之前按优先级提交：优先级队列在构造时就存在，start以后高优先级的任务先执行
+class OrderTask : public TypedTask<int>{
+public:
+    OrderTask(int value, std::vector<int>& order, std::mutex& mtx) : value_(value), order_(order), mtx_(mtx){}
+    int run() override{
+        std::lock_guard<std::mutex> lock(mtx_);
+        order_.push_back(value_);
+        return value_;
+    }
+private:
+    int value_;
+    std::vector<int>& order_;
+    std::mutex& mtx_;
+};
+
+void priorityBeforeStart(QueueMode mode){
+    ThreadPool pool;
+    pool.setQueueMode(mode);
+    pool.setPriorityAging(std::chrono::seconds(10));
+    std::mutex mtx;
+    std::vector<int> order;
+    std::vector<TypedResult<int>> results;
+    results.push_back(pool.submitTask(makeTask<OrderTask>(2, order, mtx), TaskPriority::PRIORITY_LOW));
+    results.push_back(pool.submitTask(makeTask<OrderTask>(1, order, mtx), TaskPriority::PRIORITY_NORMAL));
+    results.push_back(pool.submitTask(makeTask<OrderTask>(0, order, mtx), TaskPriority::PRIORITY_HIGH));
+    pool.start(1);
+    for(auto& res : results){
+        CHECK(res.isVaild());
+        CHECK(finished(res));
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    CHECK(order == std::vector<int>({0, 1, 2}));
+}
+
+void submitAfterStart(QueueMode mode){
+    ThreadPool pool;
+    pool.setQueueMode(mode);
+    pool.start(2);
+    std::vector<TypedResult<int>> results;
+    for(int i = 0; i < TASKS; i++){
+        results.push_back(pool.submitTask(makeTask<ValueTask>(i)));
+    }
+    for(int i = 0; i < TASKS; i++){
+        CHECK(finished(results[i]));
+        if(results[i].ready())
+            CHECK(results[i].get() == i);
+    }
+}
+
+//cached模式：控制线程看到任务排队就扩容，提交任务的线程不创建线程
+class SleepTask : public TypedTask<int>{
+public:
+    SleepTask(std::atomic_int& running, std::atomic_int& peak) : running_(running), peak_(peak){}
+    int run() override{
+        int now = ++running_;
+        int prev = peak_.load();
+        while(now > prev && !peak_.compare_exchange_weak(prev, now)){}
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        running_--;
+        return 0;
+    }
+private:
+    std::atomic_int& running_;
+    std::atomic_int& peak_;
+};
+
+void cachedGrowsUnderLoad(){
+    ThreadPool pool;
+    pool.setMode(PoolMode::MODE_CACHED);
+    pool.setThreadSizeThreshHold(4);
+    ElasticConfig config;
+    config.sampleInterval = std::chrono::milliseconds(5);
+    config.growSamples = 1;
+    config.cooldown = std::chrono::milliseconds(0);
+    pool.setElasticConfig(config);
+    pool.start(1);
+    std::atomic_int running(0);
+    std::atomic_int peak(0);
+    std::vector<TypedResult<int>> results;
+    for(int i = 0; i < TASKS; i++){
+        results.push_back(pool.submitTask(makeTask<SleepTask>(running, peak)));
+    }
+    for(auto& res : results){
+        CHECK(finished(res));
+    }
+    CHECK(peak > 1);
+    CHECK(peak <= 4);
+}
+
+
+//Result有效当且仅当任务被接受或者已经完成为异常：队列满时trySubmit返回无效的结果，
+//FAIL_FAST的submitTask返回有效的结果，get()抛出TaskRejectedError
+void resultValidity(QueueMode mode){
+    ThreadPool pool;
+    pool.setQueueMode(mode);
+    pool.setTaskQueMaxThreshHold(2);
+    pool.setOverloadPolicy(OverloadPolicy::OVERLOAD_FAIL_FAST);
+    std::vector<TypedResult<int>> accepted;
+    for(int i = 0; i < 2; i++){
+        accepted.push_back(pool.submitTask(makeTask<ValueTask>(i)));
+        CHECK(accepted.back().isVaild());
+    }
+    auto full = pool.trySubmit(makeTask<ValueTask>(2));
+    CHECK(!full.isVaild());
+    auto rejected = pool.submitTask(makeTask<ValueTask>(3));
+    CHECK(rejected.isVaild());
+    CHECK(rejected.ready());
+    bool threw = false;
+    try{
+        rejected.get();
+    }
+    catch(const TaskRejectedError&){
+        threw = true;
+    }
+    CHECK(threw);
+    pool.start(1);
+    for(int i = 0; i < 2; i++){
+        CHECK(finished(accepted[i]));
+        if(accepted[i].ready())
+            CHECK(accepted[i].get() == i);
+    }
+}
+
+}
+
+int main(){
+    for(QueueMode mode : {QueueMode::MODE_MUTEX, QueueMode::MODE_LOCKFREE}){
+        submitAfterStart(mode);
+        submitBeforeStart(mode);
+    }
+    thresholdLoweredBeforeStart();
+    for(QueueMode mode : {QueueMode::MODE_MUTEX, QueueMode::MODE_LOCKFREE}){
+        priorityBeforeStart(mode);
+    }
+    cachedGrowsUnderLoad();
+    for(QueueMode mode : {QueueMode::MODE_MUTEX, QueueMode::MODE_LOCKFREE}){
+        resultValidity(mode);
+    }
+    return checkResult();
+}
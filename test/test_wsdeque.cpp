@@ -0,0 +1,107 @@
+//
+//  test_wsdeque.cpp
+//  test
+//
+//  Chase-Lev工作窃取队列：拥有者pop是LIFO、steal是FIFO；拥有者push/pop和多个窃取者同时steal时，
+//  包括扩容和只剩最后一个元素的竞争，每个元素恰好被取走一次
+//
+
+#include "check.hpp"
+#include "../ThreadPool2.0/wsdeque.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int STEALERS = 3;
+
+void singleThreadOrder(){
+    WorkStealingDeque<intptr_t> deque(2);
+    for(intptr_t i = 1; i <= 10; i++){
+        deque.push(i);//从容量2扩容到16
+    }
+    CHECK(deque.size() == 10);
+    intptr_t item = 0;
+    CHECK(deque.steal(item) && item == 1);
+    CHECK(deque.pop(item) && item == 10);
+    CHECK(deque.steal(item) && item == 2);
+    CHECK(deque.pop(item) && item == 9);
+    while(deque.pop(item)){}
+    CHECK(deque.empty());
+    CHECK(!deque.steal(item));
+    CHECK(!deque.pop(item));
+}
+
+//拥有者一边push一边pop，窃取者同时steal，每个元素恰好被取走一次
+//队列从很小的容量开始，拥有者扩容时窃取者还在读旧数组
+void ownerAndStealers(int total, int burst, int pops){
+    WorkStealingDeque<intptr_t> deque(2);
+    std::unique_ptr<std::atomic_int[]> taken(new std::atomic_int[total + 1]);
+    for(int i = 0; i <= total; i++){
+        taken[i] = 0;
+    }
+    std::atomic_bool done(false);
+    std::atomic_int ready(0);
+    std::vector<std::thread> stealers;
+    for(int s = 0; s < STEALERS; s++){
+        stealers.emplace_back([&](){
+            intptr_t item = 0;
+            ready++;
+            for(;;){
+                if(deque.steal(item)){
+                    taken[item]++;
+                }
+                else if(done.load()){
+                    if(deque.empty())
+                        break;
+                }
+            }
+        });
+    }
+    //窃取者都开始以后拥有者才开始push
+    while(ready < STEALERS){
+        std::this_thread::yield();
+    }
+    intptr_t next = 1;
+    intptr_t item = 0;
+    while(next <= total){
+        for(int i = 0; i < burst && next <= total; i++){
+            deque.push(next++);
+        }
+        //pops等于burst时每次都和窃取者争最后一个元素，小于burst时剩下的留给窃取者
+        for(int i = 0; i < pops; i++){
+            if(!deque.pop(item))
+                break;
+            taken[item]++;
+        }
+    }
+    while(deque.pop(item)){
+        taken[item]++;
+    }
+    done = true;
+    for(auto& t : stealers){
+        t.join();
+    }
+    int missing = 0, duplicated = 0;
+    for(int i = 1; i <= total; i++){
+        missing += taken[i] == 0;
+        duplicated += taken[i] > 1;
+    }
+    CHECK(missing == 0);
+    CHECK(duplicated == 0);
+    CHECK(deque.empty());
+}
+
+}
+
+int main(){
+    singleThreadOrder();
+    ownerAndStealers(200000, 1, 1);
+    ownerAndStealers(200000, 2, 1);
+    ownerAndStealers(200000, 64, 64);
+    ownerAndStealers(200000, 1000, 500);
+    return checkResult();
+}